@@ -0,0 +1,75 @@
+#include <Interpreter.hpp>
+#include <Parser.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <util/InputSource.hpp>
+using namespace std;
+
+/* Measures the cost per statement of parsing redirections and interpolated words, and of
+ * expanding the words when the statement is evaluated.
+ * Usage: expansion_bench [statements] [rounds] */
+
+namespace tish {
+  namespace details {
+    /// @brief Generate `num_stmts` statements of a builtin, whose words are interpolated and
+    /// whose redirections carry file descriptors.
+    [[nodiscard]] type::String generate_script( size_t num_stmts, bool redirected )
+    {
+      constexpr type::StrView words =
+        "true ~/docs/$TISH_VERSION/file\\$1 \"$HOME/x y\" a$$ b$TISH_VERSION c ~ plain words";
+      constexpr type::StrView redirections = " 2>>/dev/null 3>/dev/null 1>&2 2>&1";
+      type::String script;
+      for ( size_t i = 0; i < num_stmts; ++i ) {
+        script.append( words );
+        if ( redirected )
+          script.append( redirections );
+        script.push_back( '\n' );
+      }
+      return script;
+    }
+
+    /// @brief Returns the seconds it takes to parse the script, and to evaluate each statement if
+    /// `interp` isn't null.
+    double run( const type::String& script, Interpreter* interp )
+    {
+      const auto begin = chrono::steady_clock::now();
+      Parser prsr( LineBuffer( make_unique<util::StringSource>( script ) ) );
+      SyntaxTree tree;
+      while ( !prsr.empty() ) {
+        prsr.parse( tree );
+        if ( interp != nullptr )
+          static_cast<void>( interp->evaluate( tree ) );
+      }
+      return chrono::duration<double>( chrono::steady_clock::now() - begin ).count();
+    }
+  } // namespace details
+} // namespace tish
+
+int main( int argc, char** argv )
+{
+  const auto num_stmts = argc > 1 ? max( atol( argv[1] ), 1L ) : 200'000L;
+  const auto rounds    = argc > 2 ? max( atoi( argv[2] ), 1 ) : 5;
+
+  tish::Interpreter interp;
+  const auto report = [&]( const char* what, const tish::type::String& script, bool evaluated ) {
+    // The best round is reported, it's the least disturbed by the rest of the system.
+    double best_seconds = 0;
+    for ( int round = 0; round < rounds; ++round ) {
+      const auto seconds = tish::details::run( script, evaluated ? &interp : nullptr );
+      if ( round == 0 || seconds < best_seconds )
+        best_seconds = seconds;
+    }
+    printf( "%-40s%8.1f ns per statement\n", what, best_seconds * 1e9 / num_stmts );
+  };
+
+  const auto interpolated = tish::details::generate_script( num_stmts, false );
+  const auto redirected   = tish::details::generate_script( num_stmts, true );
+  printf( "%ld statements, best of %d rounds\n", num_stmts, rounds );
+  report( "parse interpolated words", interpolated, false );
+  report( "parse words and redirections", redirected, false );
+  // The statements are builtins, so this adds the expansion of the words and the dispatch.
+  report( "parse and evaluate interpolated words", interpolated, true );
+}
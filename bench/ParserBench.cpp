@@ -0,0 +1,79 @@
+#include <Parser.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <util/InputSource.hpp>
+using namespace std;
+
+/* Measures the time the parser takes on long chains of operators and on deeply nested statements.
+ * Usage: parser_bench [operands] [rounds] */
+
+namespace tish {
+  namespace details {
+    /// @brief Generate `true && true && ...`, with `num_operands` commands in the chain.
+    [[nodiscard]] type::String generate_chain( size_t num_operands, type::StrView op )
+    {
+      type::String script;
+      for ( size_t i = 0; i < num_operands; ++i ) {
+        if ( i > 0 )
+          script.append( op );
+        script.append( "true" );
+      }
+      script.push_back( '\n' );
+      return script;
+    }
+
+    /// @brief Generate `( ! ( ! ... true ... ) )`, where the groups and negations are nested
+    /// `depth` levels deep.
+    [[nodiscard]] type::String generate_nesting( size_t depth )
+    {
+      type::String script;
+      for ( size_t i = 0; i < depth; ++i )
+        script.append( i % 2 == 0 ? "( " : "! " );
+      script.append( "true" );
+      for ( size_t i = 0; i < depth; ++i )
+        if ( i % 2 == 0 )
+          script.append( " )" );
+      script.push_back( '\n' );
+      return script;
+    }
+
+    /// @brief Returns the seconds it takes to parse every statement of the script.
+    double parse( const type::String& script )
+    {
+      const auto begin = chrono::steady_clock::now();
+      Parser prsr( LineBuffer( make_unique<util::StringSource>( script ) ) );
+      SyntaxTree tree;
+      while ( !prsr.empty() )
+        prsr.parse( tree );
+      return chrono::duration<double>( chrono::steady_clock::now() - begin ).count();
+    }
+  } // namespace details
+} // namespace tish
+
+int main( int argc, char** argv )
+{
+  const auto num_operands = argc > 1 ? max( atol( argv[1] ), 1L ) : 100'000L;
+  const auto rounds       = argc > 2 ? max( atoi( argv[2] ), 1 ) : 5;
+
+  const auto report = [&]( const char* what, const tish::type::String& script ) {
+    // The best round is reported, it's the least disturbed by the rest of the system.
+    double best_seconds = 0;
+    for ( int round = 0; round < rounds; ++round ) {
+      const auto seconds = tish::details::parse( script );
+      if ( round == 0 || seconds < best_seconds )
+        best_seconds = seconds;
+    }
+    printf( "%-24s%10.3f ms, %8.1f ns per operand\n",
+            what,
+            best_seconds * 1e3,
+            best_seconds * 1e9 / num_operands );
+  };
+
+  printf( "%ld operands, best of %d rounds\n", num_operands, rounds );
+  report( "`&&` chain", tish::details::generate_chain( num_operands, " && " ) );
+  report( "`|` chain", tish::details::generate_chain( num_operands, " | " ) );
+  report( "`(` and `!` nesting", tish::details::generate_nesting( num_operands ) );
+}
@@ -0,0 +1,75 @@
+#include <Tokenizer.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <util/InputSource.hpp>
+using namespace std;
+
+/* Measures the throughput of the tokenizer on a generated script.
+ * Usage: tokenizer_bench [megabytes] [rounds] */
+
+namespace tish {
+  namespace details {
+    /// @brief Generate a script of at least `min_size` bytes, mixing long command runs, string
+    /// bodies and comments, which are the parts scanned in runs, with the other tokens.
+    [[nodiscard]] type::String generate_script( size_t min_size )
+    {
+      constexpr type::StrView lines[] = {
+        "gcc -O2 -Wall -Wextra -I/usr/local/include/project/subdir -o build/output src/main.c\n",
+        "echo \"a rather long string body which contains spaces, digits 0123456789 and $HOME\"\n",
+        "# a comment describing the next command, which is skipped as a whole by the tokenizer\n",
+        "cat /var/log/messages | grep -v debug | sort -u > /tmp/filtered.log 2>&1 && wc -l\n",
+        "find . -name \"*.cpp\" ; ls -la /usr/share/doc/packages/documentation & jobs\n",
+        "(cd /tmp && tar -czf archive.tar.gz directory_with_a_long_name) || echo failed\n",
+      };
+      type::String script;
+      script.reserve( min_size + 128 );
+      for ( size_t i = 0; script.size() < min_size; ++i )
+        script.append( lines[i % size( lines )] );
+      return script;
+    }
+
+    /// @brief Returns the number of tokens in the script.
+    size_t tokenize( const type::String& script )
+    {
+      Tokenizer tknizr( LineBuffer( make_unique<util::StringSource>( script ) ) );
+      size_t num_tokens = 0;
+      for ( auto tkn_tp = tknizr.peek().type_; tkn_tp != Tokenizer::TokenKind::ENDFILE;
+            tkn_tp      = tknizr.peek().type_ ) {
+        tknizr.consume( tkn_tp );
+        ++num_tokens;
+      }
+      return num_tokens;
+    }
+  } // namespace details
+} // namespace tish
+
+int main( int argc, char** argv )
+{
+  const auto megabytes = argc > 1 ? max( atof( argv[1] ), 0.001 ) : 64.0;
+  const auto rounds    = argc > 2 ? max( atoi( argv[2] ), 1 ) : 5;
+
+  const auto script =
+    tish::details::generate_script( static_cast<size_t>( megabytes * 1024 * 1024 ) );
+
+  // The best round is reported, it's the least disturbed by the rest of the system.
+  double best_seconds = 0;
+  size_t num_tokens   = 0;
+  for ( int round = 0; round < rounds; ++round ) {
+    const auto begin = chrono::steady_clock::now();
+    num_tokens       = tish::details::tokenize( script );
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    if ( round == 0 || elapsed.count() < best_seconds )
+      best_seconds = elapsed.count();
+  }
+
+  const auto mebibytes = static_cast<double>( script.size() ) / ( 1024 * 1024 );
+  printf( "%.1f MiB, %zu tokens, best of %d rounds: %.3f s, %.1f MiB/s\n",
+          mebibytes,
+          num_tokens,
+          rounds,
+          best_seconds,
+          mebibytes / best_seconds );
+}
@@ -0,0 +1,36 @@
+# Measures the throughput of copying a file through a pipe into another file, with the builtin
+# `cat` and with `/bin/cat` on the same file.
+# Usage: sh bench/cat_throughput.sh path/to/tish [megabytes] [rounds]
+
+tish=$1
+megabytes=${2:-256}
+rounds=${3:-5}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+head -c "$((megabytes * 1024 * 1024))" /dev/urandom > "$work/in"
+
+# run <name> <cat>, the best round is reported, it's the least disturbed by the rest of the system.
+run() {
+  best=0
+  round=0
+  while [ "$round" -lt "$rounds" ]; do
+    begin=$(date +%s%N)
+    "$tish" -c "$2 $work/in | $2 > $work/out"
+    elapsed=$(($(date +%s%N) - begin))
+    if [ "$round" -eq 0 ] || [ "$elapsed" -lt "$best" ]; then
+      best=$elapsed
+    fi
+    round=$((round + 1))
+  done
+  if ! cmp -s "$work/in" "$work/out"; then
+    echo "$1: the copy differs from the file" >&2
+    exit 1
+  fi
+  awk -v name="$1" -v bytes="$((megabytes * 1024 * 1024))" -v ns="$best" \
+    'BEGIN { printf "%-10s%8.3f s, %6.2f GB/s\n", name, ns / 1e9, bytes / ns }'
+}
+
+echo "$megabytes MiB, file -> pipe -> file, best of $rounds rounds"
+run builtin cat
+run /bin/cat /bin/cat
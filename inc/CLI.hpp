@@ -3,9 +3,19 @@
 
 #include <Interpreter.hpp>
 #include <Parser.hpp>
+#include <ScriptCache.hpp>
+#include <TreeNode.hpp>
+#include <array>
 #include <atomic>
+#include <condition_variable>
 #include <csignal>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <unistd.h>
 #include <util/Config.hpp>
 #include <util/Exception.hpp>
 #include <util/Term.hpp>
@@ -22,9 +32,14 @@ namespace tish {
     protected:
       Parser prsr_;
       Interpreter interp_;
+      // The syntax tree of the current statement, its memory is reused by every statement.
+      SyntaxTree tree_;
+
+      /// @brief Set the signal handlers and the logger prefix of a non-interactive shell.
+      void prepare();
 
     public:
-      BaseCLI( Parser&& prsr ) : prsr_ { std::move( prsr ) }, interp_ {}
+      BaseCLI( Parser&& prsr ) : prsr_ { std::move( prsr ) }, interp_ {}, tree_ {}
       {
         if ( _existed ) [[unlikely]]
           throw error::RuntimeError( "BaseCLI: CLI already exists" );
@@ -43,6 +58,70 @@ namespace tish {
       virtual int run();
     };
 
+    /// @brief A shell which runs the statements precompiled in the cache of a script.
+    class CachedCLI : public BaseCLI {
+      ScriptCache cache_;
+
+    public:
+      CachedCLI( ScriptCache&& cache ) : BaseCLI(), cache_ { std::move( cache ) } {}
+      virtual ~CachedCLI() = default;
+
+      virtual int run();
+    };
+
+    /// @brief A shell which parses the following statements of a script in another thread, while
+    /// the current one is evaluated.
+    /// @brief The input source must not block, otherwise the shell can't stop the parser on exit.
+    class PipelinedCLI : public BaseCLI {
+      // The maximum number of statements parsed ahead.
+      static constexpr std::size_t _queue_size = 32;
+      /* Held by the parser while it parses a statement, and by `fork` through `pthread_atfork`.
+       * Otherwise a forked stage may inherit a lock of the runtime which the parser was holding,
+       * e.g. the one of the unwinder while a syntax error is thrown. */
+      static std::mutex _parsing;
+
+      struct Slot {
+        SyntaxTree tree_;
+        // The exception thrown by the parser, it's rethrown when the statement is reached.
+        std::exception_ptr error_;
+        // Nothing follows the statement in the script.
+        bool last_;
+      };
+      // A ring of statements, each tree is reused once it has been evaluated.
+      std::array<Slot, _queue_size> slots_;
+      // The next slot to be evaluated and the next one to be parsed, they only increase.
+      std::size_t head_, tail_;
+      bool parsed_all_, stopped_;
+
+      struct Channel {
+        std::mutex mtx_;
+        std::condition_variable ready_, vacant_;
+      };
+      /* It's leaked in a forked stage, whose copy of the condition variables still counts the
+       * parser as a waiter, so destroying them would wait forever. */
+      std::unique_ptr<Channel> channel_;
+      std::thread parser_;
+      // The process which started the parser, a forked stage must not join it.
+      pid_t owner_;
+
+      void parse_ahead();
+
+    public:
+      PipelinedCLI( Parser&& prsr )
+        : BaseCLI( std::move( prsr ) )
+        , slots_ {}
+        , head_ {}
+        , tail_ {}
+        , parsed_all_ { false }
+        , stopped_ { false }
+        , channel_ { std::make_unique<Channel>() }
+        , owner_ {}
+      {}
+      virtual ~PipelinedCLI() noexcept;
+
+      virtual int run();
+    };
+
     /// @brief A shell with prompt.
     class CLI : public BaseCLI {
       static constexpr type::StrView _default_fmt = LINEWIPE LINESTART FG_GREEN BOLD_TXT
@@ -10,13 +10,19 @@ namespace tish {
       return { "Single statement:\n\tcommand\n\tcommand;\n"
                "Connect statement:\n\tcommand1 [&& | || | ;] command2\n"
                "Pipeline:\n\tcommand1 | command2\n"
+               "Background job:\n\tcommand &\n"
                "Redirection:\n\tcommand [> | >> | &> | &>> | <] filename "
                "[>&]\n\tcommand >&\n"
                "Logical not:\n\t!command\n"
+               "Measure:\n\ttime [-j] command\n"
                "Nested statement:\n\t(command1 && (command2 || command3))\n"
                "Comment:\n\tcommand # Here is a comment.\n"
                "Built-in commands:\n\texit\n\thelp\n\tcd path\n\ttype "
-               "command-name\n\texec command-name\n" };
+               "command-name\n\texec command-name\n\thash [-r] [-p path] [command-name]\n"
+               "\techo [-neE] [arg ...]\n\tprintf format [arguments]\n\ttrue\n\tfalse\n\tpwd\n"
+               "\ttest expr\n\t[ expr ]\n\tcat [file ...]\n\ttee [-a] [file ...]\n"
+               "\tcp source ... target\n\tjobs [-l | -p]\n\twait [-n] [id ...]\n\tfg [id]\n"
+               "\tbg [id]\n\tparallel [-j jobs] [-f] [command ...]\n\tstats [-p]\n" };
     }
   }
 } // namespace tish
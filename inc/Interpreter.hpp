@@ -1,12 +1,20 @@
 #ifndef TISH_INTERPRETER
 #define TISH_INTERPRETER
 
+#include <Program.hpp>
 #include <TreeNode.hpp>
+#include <cstddef>
 #include <cstdlib>
 #include <optional>
+#include <span>
+#include <unordered_map>
 #include <unordered_set>
+#include <util/CommandCache.hpp>
 #include <util/Config.hpp>
 #include <util/Constant.hpp>
+#include <util/FdGuard.hpp>
+#include <util/JobTable.hpp>
+#include <util/Spawn.hpp>
 #include <variant>
 #include <vector>
 
@@ -22,37 +30,122 @@ namespace tish {
         std::nullopt;
       std::vector<type::String> message = {};
       type::Eval value;
+      // Exit status of each stage of the most recently evaluated pipeline, like `PIPESTATUS`.
+      std::vector<type::Eval> pipe_status = {};
 
       [[nodiscard]] explicit operator bool() const noexcept { return value == success; }
     };
 
   private:
-    using StmtNodeT = StmtNode* const;
-    using ExprNodeT = ExprNode* const;
-    static const std::unordered_set<type::String> _built_in_cmds;
+    using StmtNodeT = const StmtNode;
+    using ExprNodeT = const ExprNode;
+    // The expanded words of a command, the first one is the command name.
+    using Argv = std::span<const type::StrView>;
+    static const std::unordered_set<type::StrView> _built_in_cmds;
 
     std::unordered_map<type::StrView, std::variant<type::String, type::Eval>> variables_;
+    util::CommandCache cmd_cache_;
+    // The current statement lowered by `evaluate`, its memory is reused by every statement.
+    Program program_;
+    // The messages reported during the current evaluation.
+    std::vector<type::String> messages_;
+    // The external command started by the last `spawn` instruction, if it's not waited yet.
+    std::optional<util::SpawnGuard> child_;
+    // The background jobs, the finished ones are reaped before each evaluation.
+    util::JobTable jobs_;
 
-    void interpolate( ExprNodeT node ) const;
+    /* Reused buffers of the expanded command, each word in `words_` is followed by a '\0'.
+     * `exec_argv_` is the null-terminated form of `argv_` which is passed to `exec`. */
+    type::String words_;
+    std::vector<std::size_t> word_ends_;
+    std::vector<type::StrView> argv_;
+    std::vector<char*> exec_argv_;
+    // Reused buffer of the output of a builtin, it's written to the standard output at once.
+    type::String output_;
 
-    [[nodiscard]] EvalResult sequential_stmt( StmtNodeT seq_stmt ) const;
-    [[nodiscard]] EvalResult logical_and( StmtNodeT and_stmt ) const;
-    [[nodiscard]] EvalResult logical_or( StmtNodeT or_stmt ) const;
-    [[nodiscard]] EvalResult logical_not( StmtNodeT not_stmt ) const;
-    [[nodiscard]] EvalResult pipeline_stmt( StmtNodeT pipeline_stmt ) const;
-    [[nodiscard]] EvalResult output_redirection( StmtNodeT oup_redr ) const;
-    [[nodiscard]] EvalResult merge_stream( StmtNodeT merg_redr ) const;
-    [[nodiscard]] EvalResult input_redirection( StmtNodeT inp_redr ) const;
+    /// @brief Render the templates of the command and its arguments into `argv_` and `exec_argv_`,
+    /// the tree is not modified.
+    void expand( ExprNodeT expr );
 
-    [[nodiscard]] EvalResult atom( ExprNodeT expr ) const;
+    /// @brief Record the message of the current evaluation.
+    /// @return `status`, so that a failure can be reported and returned at once.
+    type::Eval report( type::String message, type::Eval status = EvalResult::abort );
+    /// @brief Write the diagnostic of a builtin to the standard error at once, like a program
+    /// does, so it follows the redirections of the builtin and isn't lost in a forked stage.
+    /// @return `status`.
+    type::Eval diagnose( type::StrView message, type::Eval status );
+
+    /// @brief Open the files of the redirection `redr` and the redirections nested in it with
+    /// `fd_guard`, and append the file descriptor operations of all of them to `actions`.
+    /// @return false if the redirection can't be made, the reason is reported.
+    [[nodiscard]] bool redirection( StmtNodeT redr,
+                                    util::FdGuard& fd_guard,
+                                    util::SpawnActions& actions );
+    [[nodiscard]] bool output_redirection( StmtNodeT oup_redr,
+                                           util::FdGuard& fd_guard,
+                                           util::SpawnActions& actions );
+    [[nodiscard]] bool merge_stream( StmtNodeT merg_redr, util::SpawnActions& actions );
+    [[nodiscard]] bool input_redirection( StmtNodeT inp_redr,
+                                          util::FdGuard& fd_guard,
+                                          util::SpawnActions& actions );
+
+    /// @brief Start the command, an external one is left in `child_` and waited later.
+    /// @brief An external command receives the actions when it is spawned, otherwise they're
+    /// applied to the shell itself and restored after the evaluation.
+    /// @param replace Nothing is left to run after the command, so an external one replaces the
+    /// shell process instead of being spawned.
+    [[nodiscard]] type::Eval spawn( ExprNodeT expr,
+                                    const util::SpawnActions& actions,
+                                    bool replace );
 
     /// @brief Internal instruction execution, not cross-process.
-    [[nodiscard]] EvalResult builtin_exec( ExprNodeT expr ) const;
+    [[nodiscard]] type::Eval builtin_exec( Argv argv );
+    [[nodiscard]] type::Eval hash_builtin( Argv args );
+    [[nodiscard]] type::Eval echo_builtin( Argv args );
+    [[nodiscard]] type::Eval printf_builtin( Argv args );
+    [[nodiscard]] type::Eval pwd_builtin();
+    /// @brief `test` and `[`, the last argument of `[` must be `]`.
+    [[nodiscard]] type::Eval test_builtin( Argv argv );
+    /* The options of `cat`, `tee` and `cp` are left to their external programs, and so is an
+     * interactive input, which can only be interrupted in another process. */
+    [[nodiscard]] type::Eval cat_builtin( Argv argv );
+    [[nodiscard]] type::Eval tee_builtin( Argv argv );
+    [[nodiscard]] type::Eval cp_builtin( Argv argv );
+    [[nodiscard]] type::Eval jobs_builtin( Argv args );
+    [[nodiscard]] type::Eval wait_builtin( Argv args );
+    [[nodiscard]] type::Eval fg_builtin( Argv args );
+    [[nodiscard]] type::Eval bg_builtin( Argv args );
+    /// @brief Run each argument, or each line of the input, as a command in a job of its own, at
+    /// most `-j` (the number of online CPUs by default) of them at once.
+    /// @brief The output of a job is written out when it's done, `-f` stops all jobs once one
+    /// fails, and the status is the one of the first failed job.
+    [[nodiscard]] type::Eval parallel_builtin( Argv args );
+    /// @brief Print the counters of the shell, `-p` prints them in the text exposition format of
+    /// Prometheus, which is also written to `TISH_METRICS_FILE` on exit.
+    [[nodiscard]] type::Eval stats_builtin( Argv args );
+
+    /// @brief Reap the background jobs, and report the ones which are done since the last check.
+    void notify_jobs();
+
+    /// @brief Write `output_` to the standard output of the builtin `name`.
+    /// @return `status`, or the failure status if the output can't be written.
+    [[nodiscard]] type::Eval flush_output( type::StrView name, type::Eval status );
 
-    /// @brief Execute the expression, and return 0 or 1 (a boolean),
-    /// indicating whether the expression was successful.
-    /// @brief The 'successful' means that the return value of child process was `EXIT_SUCCESS`.
-    [[nodiscard]] EvalResult external_exec( ExprNodeT expr ) const;
+    /// @brief Returns the path used to execute the command, or an empty string if it's not found.
+    /// @brief The result is only valid until the next lookup.
+    [[nodiscard]] type::StrView resolve( type::StrView name );
+
+    /// @brief Spawn the external command into `child_`, the failure to start it is reported.
+    /// @brief `exec_argv_` must be the expanded form of `argv`.
+    /// @brief If `replace` is set, the command is executed in place of the shell, and it's only
+    /// spawned if that fails.
+    [[nodiscard]] type::Eval external_exec( Argv argv,
+                                            const util::SpawnActions& actions,
+                                            bool replace );
+
+    /// @brief Run `program_` in a single loop, the result of the whole statement is built once.
+    /// @param last Nothing is evaluated after the statement.
+    [[nodiscard]] EvalResult execute( bool last );
 
   public:
     Interpreter();
@@ -64,9 +157,16 @@ namespace tish {
 
     /// @brief Evaluates the statement. If it is an atom statement (expression),
     /// @brief returns the expression evaluation result.
-    /// @brief Otherwise, the two sides of the child node are evaluated recursively according to the
-    /// grammar rules
-    EvalResult evaluate( StmtNodeT stmt_node ) const noexcept( false );
+    /// @brief Otherwise, the statement is compiled into a `Program` and run without recursion.
+    /// @param last The statement is the final one of a non-interactive input, so a simple command
+    /// in its tail position replaces the shell process, like `exec` does.
+    EvalResult evaluate( StmtNodeT stmt_node, bool last = false ) noexcept( false );
+
+    /// @brief Evaluates the root statement of the syntax tree.
+    EvalResult evaluate( SyntaxTree& tree, bool last = false ) noexcept( false )
+    {
+      return evaluate( tree.root(), last );
+    }
   };
 } // namespace tish
 
@@ -3,43 +3,100 @@
 
 #include <Tokenizer.hpp>
 #include <TreeNode.hpp>
-#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <util/Config.hpp>
+#include <utility>
+#include <vector>
 
 namespace tish {
-  /// @brief Recursive descent parser.
+  /// @brief Parser of the language in `Grammar.txt`.
+  /// @brief Nested statements are tracked by an explicit stack instead of recursion.
   class Parser {
-    static constexpr type::StrView _pattern_redirection { R"(^(\d*)>{1,2}$)" };
-    static constexpr type::StrView _pattern_combined_redir { R"(^(\d*)>&(\d*)$)" };
-
-    using StmtNodePtr = std::unique_ptr<StmtNode>;
-    using ExprNodePtr = std::unique_ptr<ExprNode>;
+    using NodeIndex = SyntaxTree::Index;
     Tokenizer tknizr_;
+    // The tree being built by `parse()`.
+    SyntaxTree* tree_;
+    // Reused buffer of the arguments of a command, or the stages of a pipeline.
+    std::vector<NodeIndex> arguments_;
+    // Reused buffer of the template of a word.
+    std::vector<ExprNode::Segment> segments_;
+
+    /// @brief Something which waits for the operand being parsed.
+    struct Frame {
+      enum class Kind : uint8_t { connector, group, negation, timing } kind_;
+      // The statement made by a connector, and its left operand.
+      // For a `time`, the left operand is the value node of its output format.
+      StmtNode::StmtKind connector_;
+      NodeIndex left_;
+    };
+    // The frames of the statement being parsed, it replaces the recursion over nested statements.
+    std::vector<Frame> frames_;
+    // The number of `Frame::Kind::group` in `frames_`.
+    std::size_t open_groups_;
+
+    /// @brief Parse a whole statement with an explicit stack of pending frames, so the depth of
+    /// nesting is only limited by the memory.
+    [[nodiscard]] NodeIndex statement();
+    /// @brief Parse an operand of a connector, or push a frame and return `StmtNode::null_index` if
+    /// it's a `(`, `!` or `time` which is followed by the actual operand.
+    [[nodiscard]] NodeIndex operand();
+    /// @brief Apply the pending `!` to the operand.
+    [[nodiscard]] NodeIndex negate( NodeIndex operand );
+    /// @brief Join the pending connectors of the innermost group with their right operands.
+    /// @brief A pending `time` is joined like a connector of the lowest precedence, so it measures
+    /// the rest of the statement.
+    /// @param sequential Whether a pending `;` is joined too, otherwise it stops the reduction.
+    [[nodiscard]] NodeIndex reduce( NodeIndex right_stmt, bool sequential = true );
+    /// @brief Finish the innermost parenthesized statement, whose last operand is `stmt`.
+    [[nodiscard]] NodeIndex close_group( NodeIndex stmt );
 
-    [[nodiscard]] StmtNodePtr statement();
-    [[nodiscard]] StmtNodePtr nonempty_statement();
-    [[nodiscard]] StmtNodePtr statement_extension( StmtNodePtr left_stmt );
+    /// @brief Append the statement to the stages of a pipeline in `arguments_`, a nested pipeline
+    /// is flattened.
+    void append_stage( NodeIndex stmt );
 
-    [[nodiscard]] StmtNodePtr inner_statement();
-    [[nodiscard]] StmtNodePtr inner_statement_extension( StmtNodePtr left_stmt );
+    [[nodiscard]] NodeIndex redirection( NodeIndex left_stmt );
+    [[nodiscard]] NodeIndex output_redirection( NodeIndex left_stmt );
+    [[nodiscard]] NodeIndex combined_redirection_extension( NodeIndex left_stmt );
 
-    [[nodiscard]] StmtNodePtr redirection( StmtNodePtr left_stmt );
-    [[nodiscard]] StmtNodePtr output_redirection( StmtNodePtr left_stmt );
-    [[nodiscard]] StmtNodePtr combined_redirection_extension( StmtNodePtr left_stmt );
+    /// @brief Consume the redirection token and store each file descriptor in it into `fds` as a
+    /// value node, `fds` holds the descriptor before the operator and the one after it (if any).
+    void extract_fds( std::span<NodeIndex> fds, Tokenizer::TokenKind expecting );
+    /// @brief Returns a value node of the file descriptor, which is invalid if `digits` is empty.
+    [[nodiscard]] NodeIndex fd_value( type::StrView digits );
 
-    [[nodiscard]] StmtNodePtr logical_not();
-    [[nodiscard]] ExprNodePtr expression();
+    [[nodiscard]] NodeIndex expression();
+    /// @brief Compile the word into `segments_`, which is left empty if nothing is to be expanded.
+    /// @brief The text of each segment refers to a part of `word`.
+    void compile_word( type::StrView word, Tokenizer::TokenKind word_type );
 
   public:
     Parser();
-    Parser( LineBuffer&& line_buf ) noexcept : tknizr_ { std::move( line_buf ) } {}
-    Parser( Tokenizer&& tknizr ) noexcept : tknizr_ { std::move( tknizr ) } {}
-    Parser( Parser&& rhs ) noexcept : tknizr_ { std::move( rhs.tknizr_ ) } {}
+    Parser( LineBuffer&& line_buf ) noexcept
+      : tknizr_ { std::move( line_buf ) }, tree_ { nullptr }, open_groups_ {}
+    {}
+    Parser( Tokenizer&& tknizr ) noexcept
+      : tknizr_ { std::move( tknizr ) }, tree_ { nullptr }, open_groups_ {}
+    {}
+    Parser( Parser&& rhs ) noexcept
+      : tknizr_ { std::move( rhs.tknizr_ ) }
+      , tree_ { std::exchange( rhs.tree_, nullptr ) }
+      , arguments_ { std::move( rhs.arguments_ ) }
+      , segments_ { std::move( rhs.segments_ ) }
+      , frames_ { std::move( rhs.frames_ ) }
+      , open_groups_ { rhs.open_groups_ }
+    {}
     ~Parser() = default;
     Parser& operator=( Parser&& rhs ) noexcept
     {
       using std::swap;
       swap( tknizr_, rhs.tknizr_ );
+      swap( tree_, rhs.tree_ );
+      swap( arguments_, rhs.arguments_ );
+      swap( segments_, rhs.segments_ );
+      swap( frames_, rhs.frames_ );
+      swap( open_groups_, rhs.open_groups_ );
       return *this;
     }
 
@@ -52,9 +109,12 @@ namespace tish {
     Tokenizer& tokenizer() noexcept { return tknizr_; }
     const Tokenizer& tokenizer() const noexcept { return tknizr_; }
 
-    /// @return The root node of a syntax tree.
-    [[nodiscard]] StmtNodePtr parse();
+    /// @brief Parse a statement into `tree`, the nodes it held before are discarded.
+    void parse( SyntaxTree& tree );
     [[nodiscard]] bool empty() const noexcept { return tknizr_.empty(); }
+    /// @brief Whether the statement parsed last is the final one of the input.
+    /// @brief Unlike `empty()`, it's known without parsing the end of input as another statement.
+    [[nodiscard]] bool exhausted() const noexcept { return tknizr_.exhausted(); }
   };
 } // namespace tish
 
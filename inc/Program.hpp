@@ -0,0 +1,85 @@
+#ifndef TISH_PROGRAM
+#define TISH_PROGRAM
+
+#include <TreeNode.hpp>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace tish {
+  /// @brief A statement lowered into a flat instruction stream.
+  /// @brief The control flow of the syntax tree becomes jumps, so the interpreter runs the program
+  /// in a loop, no matter how deep the tree is.
+  class Program {
+  public:
+    using Index = StmtNode::Index;
+
+    enum class OpCode : uint8_t {
+      spawn,        // Start the atom `node_`, an external command keeps running until `wait`.
+      wait,         // Wait for the command started by the last `spawn`.
+      wire,         // Redirect the shell itself by `node_` and the redirections nested in it.
+      bind,         // Like `wire`, but the redirection is handed to the next `spawn`.
+      restore,      // Undo the innermost `wire` or `bind`.
+      jump_if_fail, // Jump to `operand_` if the status is a failure.
+      jump_if_ok,   // Jump to `operand_` if the status is a success.
+      negate,
+      pipeline,     // Create the pipes between the stages of the pipeline or job `node_`.
+      stage,        // Fork the next stage of the innermost pipeline, the parent jumps to
+                    // `operand_`.
+      launch,       // Spawn the external command `node_` as the next stage and jump to `operand_`.
+      exit,         // Terminate the process of a stage with the status.
+      join,         // Wait for all stages of the innermost pipeline.
+      detach,       // Leave the stages of the innermost pipeline running as a background job.
+      clock,        // Start measuring the statement `node_` for `time`.
+      measure,      // Report the innermost measurement.
+      mark,         // Record the status as the left operand of the root statement.
+      pair          // Record the status as the right operand of the root statement.
+    };
+    struct Instruction {
+      OpCode op_;
+      Index node_;
+      /* The jump target of `jump_if_fail`, `jump_if_ok`, `stage` and `launch`.
+       * For `wire` and `bind`, the target if the redirection fails. */
+      Index operand_;
+    };
+
+  private:
+    struct Task {
+      enum class Kind : uint8_t { visit, emit, emit_jump, patch } kind_;
+      // Only the root statement, or the statement redirected by the root, records its operands.
+      bool root_;
+      OpCode op_;
+      Index node_;
+    };
+
+    SyntaxTree* tree_;
+    std::vector<Instruction> code_;
+    // The work stack of `compile`, it replaces the recursion over the tree.
+    std::vector<Task> tasks_;
+    // Jumps waiting for their targets, they're patched in the reverse order.
+    std::vector<Index> jumps_;
+
+    void visit( StmtNode node, bool root );
+    void emit( OpCode op, Index node, Index operand = StmtNode::null_index );
+
+  public:
+    Program() noexcept : tree_ { nullptr } {}
+
+    /// @brief Lower the statement into instructions, the previous ones are discarded.
+    /// @brief The program refers to the nodes of the tree, so they must live longer than it.
+    void compile( StmtNode root );
+
+    [[nodiscard]] SyntaxTree& tree() const noexcept
+    {
+      assert( tree_ != nullptr );
+      return *tree_;
+    }
+    [[nodiscard]] std::span<const Instruction> code() const noexcept { return code_; }
+    [[nodiscard]] bool empty() const noexcept { return code_.empty(); }
+    [[nodiscard]] std::size_t size() const noexcept { return code_.size(); }
+  };
+} // namespace tish
+
+#endif // TISH_PROGRAM
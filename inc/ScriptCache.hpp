@@ -0,0 +1,114 @@
+#ifndef TISH_SCRIPTCACHE
+#define TISH_SCRIPTCACHE
+
+#include <TreeNode.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <sys/stat.h>
+#include <util/Config.hpp>
+
+namespace tish {
+  class Parser;
+
+  /// @brief The parsed statements of a script file, they're stored in a cache file (`.tishc`) so
+  /// that later runs of the same script skip tokenizing and parsing.
+  /// @brief The cache file is mapped as a whole. Its statements are packed one after another, and
+  /// the text of their tokens is stored once in a string table shared by the whole script, which
+  /// a loaded `SyntaxTree` reads directly.
+  /// @brief Each statement is checked when it's loaded. If it's damaged, the cache file is removed
+  /// so the next run rebuilds it, and the rest of the script is parsed from its source.
+  class ScriptCache {
+  public:
+    // Smaller scripts are parsed faster than their cache files are written.
+    static constexpr std::size_t _min_script_size = 16 * 1024;
+
+  private:
+    using Index = SyntaxTree::Index;
+
+    struct Header;
+    class Writer;
+    class StringTable;
+
+    const std::byte* image_;
+    std::size_t image_size_;
+    // The text of every token and diagnostic, each of them is followed by a '\0'.
+    type::StrView strings_;
+    // The packed statements which are not loaded yet.
+    const std::byte* cursor_;
+    const std::byte* end_;
+    std::size_t num_statements_;
+    // The number of statements loaded so far.
+    std::size_t next_;
+    // Whether nothing follows the statement loaded last.
+    bool last_;
+    type::String script_path_, cache_path_;
+    // Parses the rest of the script once a damaged statement is found.
+    std::unique_ptr<Parser> fallback_;
+
+    ScriptCache( const std::byte* image,
+                 std::size_t image_size,
+                 type::String script_path,
+                 type::String cache_path ) noexcept;
+
+    /// @brief Returns the layout of the file, a cache file built by another layout is not used.
+    [[nodiscard]] static std::uint32_t layout() noexcept;
+
+    /// @brief Map the cache file if it was built from the same script by the same version.
+    [[nodiscard]] static std::optional<ScriptCache> map( const type::String& cache_path,
+                                                         type::StrView script_path,
+                                                         const struct stat& script_stat );
+    /// @brief Parse the whole script into a new cache file and map it.
+    [[nodiscard]] static std::optional<ScriptCache> build( const type::String& cache_path,
+                                                           type::StrView script_path,
+                                                           const struct stat& script_stat );
+
+    /// @brief Pack the statement of `tree`, or the diagnostic if `tree` is null.
+    static void store( Writer& writer,
+                       StringTable& strings,
+                       const SyntaxTree* tree,
+                       type::StrView diagnostic,
+                       bool last );
+
+    /// @brief Check that every index of the tree refers to something inside its arrays, that
+    /// children precede their parents, and that each statement has the children and arguments of
+    /// its kind, so a damaged cache file can't be evaluated.
+    [[nodiscard]] static bool verify( const SyntaxTree& tree ) noexcept;
+
+    /// @brief Unpack the next statement into `tree`, or its diagnostic into `diagnostic`.
+    /// @return false if the statement is damaged.
+    [[nodiscard]] bool unpack( SyntaxTree& tree, std::optional<type::StrView>& diagnostic );
+
+    /// @brief Remove the damaged cache file and parse the rest of the script from its source, the
+    /// statements which are loaded already are skipped.
+    void fall_back();
+
+  public:
+    ScriptCache( const ScriptCache& )            = delete;
+    ScriptCache& operator=( const ScriptCache& ) = delete;
+    ScriptCache& operator=( ScriptCache&& )      = delete;
+
+    ScriptCache( ScriptCache&& rhs ) noexcept;
+    ~ScriptCache() noexcept;
+
+    /// @brief Map the cache of the script, it's rebuilt if it's missing or out of date.
+    /// @brief A cache is keyed by the path, size and modification time of the script and the
+    /// version of tish, it's stored in `$XDG_CACHE_HOME/tish` or `$HOME/.cache/tish`.
+    /// @return nullopt if the script is too small or the cache can't be written, the script should
+    /// be run from its source then.
+    [[nodiscard]] static std::optional<ScriptCache> open( const char* script );
+
+    [[nodiscard]] bool empty() const noexcept;
+    /// @brief Whether the statement loaded last is the final one of the script.
+    [[nodiscard]] bool exhausted() const noexcept;
+
+    /// @brief Load the next statement into `tree`, which refers to the cache until it's reset.
+    /// @return The diagnostic of the statement if the parser rejected it, `tree` is empty then.
+    /// @brief Once the rest of the script is parsed from its source, the errors of the parser are
+    /// thrown instead.
+    [[nodiscard]] std::optional<type::StrView> load( SyntaxTree& tree ) noexcept( false );
+  };
+} // namespace tish
+
+#endif // TISH_SCRIPTCACHE
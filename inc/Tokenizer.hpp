@@ -1,17 +1,22 @@
 #ifndef TISH_TOKENIZER
 #define TISH_TOKENIZER
 
-#include <istream>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <optional>
 #include <util/Config.hpp>
+#include <util/InputSource.hpp>
 #include <utility>
 
 namespace tish {
   class LineBuffer {
-    std::istream* input_stream_;
+    std::unique_ptr<util::InputSource> source_;
 
     type::String line_input_;
     std::size_t line_pos_;
+    // The number of lines read from the source, so it's the line number of `line_input_`.
+    std::uint32_t line_no_;
     bool received_eof_;
 
     void swap_members( LineBuffer&& rhs ) noexcept;
@@ -20,11 +25,11 @@ namespace tish {
     LineBuffer( const LineBuffer& lhs )            = delete;
     LineBuffer& operator=( const LineBuffer& lhs ) = delete;
 
-    /// @brief Create a line buffer bound to the specified input stream.
-    LineBuffer( std::istream& input_stream ) noexcept
-      : input_stream_ { std::addressof( input_stream ) }, line_pos_ {}, received_eof_ { false }
+    /// @brief Create a line buffer reading from the specified source.
+    LineBuffer( std::unique_ptr<util::InputSource> source ) noexcept
+      : source_ { std::move( source ) }, line_pos_ {}, line_no_ {}, received_eof_ { false }
     {}
-    LineBuffer( LineBuffer&& rhs ) noexcept : LineBuffer( *rhs.input_stream_ )
+    LineBuffer( LineBuffer&& rhs ) noexcept : LineBuffer( std::move( rhs.source_ ) )
     {
       swap_members( std::move( rhs ) );
     }
@@ -33,11 +38,37 @@ namespace tish {
     LineBuffer& operator=( LineBuffer&& rhs ) noexcept;
 
     [[nodiscard]] bool eof() const noexcept { return received_eof_; }
+    /// @brief Whether nothing is left to be scanned, the source is never read to find it out.
+    [[nodiscard]] bool exhausted() const noexcept
+    {
+      return received_eof_
+          || ( line_pos_ >= line_input_.size() && ( source_ == nullptr || source_->exhausted() ) );
+    }
     [[nodiscard]] std::size_t line_pos() const noexcept { return line_pos_; }
+    /// @brief The line number of the current line, starting from 1, or 0 before any line is read.
+    [[nodiscard]] std::uint32_t line_no() const noexcept { return line_no_; }
 
     /// @brief Returns the current scanned string.
     [[nodiscard]] type::StrView context() const noexcept { return line_input_; }
 
+    /// @brief Whether the current character is the mark of the end of input, which is only valid
+    /// after `peek()`.
+    /// @brief The mark is told by its position, so the same byte elsewhere is an ordinary one.
+    [[nodiscard]] bool at_end() const noexcept
+    {
+      return received_eof_ && line_pos_ + 1 == line_input_.size();
+    }
+
+    /// @brief Returns the unscanned part of the current line without the mark of the end of input,
+    /// which is only valid after `peek()`.
+    [[nodiscard]] type::StrView remaining() const noexcept
+    {
+      const auto length = line_input_.size() - ( received_eof_ && !line_input_.empty() );
+      return type::StrView( line_input_ )
+        .substr( 0, length )
+        .substr( std::min( line_pos_, length ) );
+    }
+
     /// @brief Clear the line buffer.
     void clear() noexcept;
 
@@ -47,6 +78,9 @@ namespace tish {
     /// @brief Discard the current character from the buffer.
     void consume() noexcept;
 
+    /// @brief Discard `num_chars` characters from the buffer at once.
+    void consume( std::size_t num_chars ) noexcept;
+
     /// @brief Back `num_chars` characters, set to 0 if the line position is
     /// less than `num_chars`.
     void backtrack( std::size_t num_chars ) noexcept;
@@ -71,6 +105,7 @@ namespace tish {
       RPAREN,
       NEWLINE,
       SEMI,
+      AMP,
       ENDFILE,
       ERROR
     };
@@ -93,20 +128,24 @@ namespace tish {
       case TokenKind::RPAREN:      return "right paren";
       case TokenKind::NEWLINE:     return "newline";
       case TokenKind::SEMI:        return "semicolon";
+      case TokenKind::AMP:         return "background";
       case TokenKind::ENDFILE:     return "end of file";
       case TokenKind::ERROR:       [[fallthrough]];
       default:                     return "error";
       }
     }
 
+    /// @brief A token doesn't own its text, it only records where the text is in the current line
+    /// of `LineBuffer`.
     struct Token {
-      type::String value_;
       TokenKind type_;
+      std::size_t offset_, length_;
 
-      Token( TokenKind tk, type::String&& val )
-        : value_ { std::move( val ) }, type_ { std::move( tk ) }
+      Token( TokenKind tk, std::size_t offset, std::size_t length ) noexcept
+        : type_ { tk }, offset_ { offset }, length_ { length }
       {}
-      Token() : Token( TokenKind::ERROR, {} ) {}
+      Token() noexcept : Token( TokenKind::ERROR, 0, 0 ) {}
+      [[nodiscard]] bool empty() const noexcept { return length_ == 0; }
       [[nodiscard]] bool is( TokenKind tk ) const noexcept { return type_ == tk; }
       [[nodiscard]] bool is_not( TokenKind tk ) const noexcept { return !is( tk ); }
       [[nodiscard]] friend bool operator==( const Token& tkn, TokenKind tk ) noexcept
@@ -128,7 +167,13 @@ namespace tish {
     Tokenizer& operator=( Tokenizer&& rhs ) noexcept;
 
     [[nodiscard]] bool empty() const noexcept { return line_buf_.eof(); }
+    /// @brief Whether no token is left, without reading any further.
+    [[nodiscard]] bool exhausted() const noexcept
+    {
+      return !current_token_.has_value() && line_buf_.exhausted();
+    }
     [[nodiscard]] std::size_t line_pos() const noexcept { return line_buf_.line_pos(); }
+    [[nodiscard]] std::uint32_t line_no() const noexcept { return line_buf_.line_no(); }
 
     /// @brief Returns the current scanned string.
     [[nodiscard]] type::StrView context() const noexcept { return line_buf_.context(); }
@@ -142,8 +187,17 @@ namespace tish {
 
     Token& peek() noexcept( false );
 
-    /// @brief Discard the current token and return it.
-    type::String consume( TokenKind expect ) noexcept( false );
+    /// @brief Returns the text of the token.
+    /// @brief The text refers to the current line, it's invalidated once the tokenizer reads the
+    /// next line, i.e. after a `NEWLINE` token is consumed and another token is peeked.
+    [[nodiscard]] type::StrView text( const Token& token ) const noexcept
+    {
+      return line_buf_.context().substr( token.offset_, token.length_ );
+    }
+
+    /// @brief Discard the current token and return its text.
+    /// @brief The lifetime of the text is the same as the one returned by `text()`.
+    type::StrView consume( TokenKind expect ) noexcept( false );
 
     /// @brief Reset the current line buffer with the new one.
     void reset( LineBuffer&& line_buf ) noexcept;
@@ -1,13 +1,19 @@
 #ifndef TISH_TREENODE
 #define TISH_TREENODE
 
-#include <memory>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <ranges>
+#include <span>
 #include <util/Config.hpp>
-#include <util/Exception.hpp>
-#include <variant>
 #include <vector>
 
 namespace tish {
+  class SyntaxTree;
+
+  /// @brief A reference to a statement node stored in a `SyntaxTree`.
+  /// @brief It's only valid as long as the tree is not reset or modified by the parser.
   class StmtNode {
   public:
     enum class StmtKind : uint8_t {
@@ -22,119 +28,238 @@ namespace tish {
       merge_output,
       merge_appnd,
       merge_stream, // &>, &>>, >&
-      stdin_redrct
+      stdin_redrct,
+      background, // &
+      timed       // time
     };
-    using ChildNode    = std::unique_ptr<StmtNode>;
-    using SiblingNodes = std::vector<ChildNode>;
+    using Index = std::uint32_t;
+    static constexpr Index null_index = std::numeric_limits<Index>::max();
 
   protected:
-    StmtKind category_;
-    ChildNode l_child_, r_child_;
-    /* Any additional arguments are stored in siblings node.
-     * Currently the arguments can only be saved as an unique_ptr pointing to
-     * `ExprNode`. */
-    SiblingNodes siblings_;
-
-    static void destruct( ChildNode& root ) noexcept
-    { // Destruct the binary tree with constant space complexity.
-      for ( auto cur = root.get(); cur != nullptr; cur = cur->right() ) {
-        if ( cur->left() != nullptr ) {
-          auto rightmost = cur->left();
-          while ( rightmost->right() != nullptr )
-            rightmost = rightmost->right();
-          rightmost->r_child_.reset( cur->r_child_.release() );
-          cur->r_child_.reset( cur->l_child_.release() );
-        }
-      }
-      while ( root != nullptr )
-        root = std::move( *root ).right();
-    }
+    SyntaxTree* tree_;
+    Index index_;
 
   public:
-    StmtNode( StmtKind stmt_type,
-              ChildNode left_stmt   = nullptr,
-              ChildNode right_stmt  = nullptr,
-              SiblingNodes siblings = {} )
-      : category_ { stmt_type }
-      , l_child_ { std::move( left_stmt ) }
-      , r_child_ { std::move( right_stmt ) }
-      , siblings_ { std::move( siblings ) }
-    {}
-    StmtNode( StmtKind stmt_type, SiblingNodes siblings ) : StmtNode( stmt_type )
-    {
-      siblings_ = std::move( siblings );
-    }
-    StmtNode( StmtNode&& rhs )
-      : category_ { rhs.category_ }
-      , l_child_ { std::move( rhs.l_child_ ) }
-      , r_child_ { std::move( rhs.r_child_ ) }
-      , siblings_ { std::move( rhs.siblings_ ) }
+    StmtNode( SyntaxTree& tree, Index index ) noexcept
+      : tree_ { std::addressof( tree ) }, index_ { index }
     {}
-    virtual ~StmtNode() = default;
 
-    [[nodiscard]] StmtKind type() const noexcept { return category_; }
+    /// @brief Returns false if the node refers to nothing, like a missing child.
+    [[nodiscard]] explicit operator bool() const noexcept { return index_ != null_index; }
+
+    [[nodiscard]] Index index() const noexcept { return index_; }
+    [[nodiscard]] SyntaxTree& tree() const noexcept { return *tree_; }
 
-    void clear() noexcept
+    [[nodiscard]] StmtKind type() const noexcept;
+    /// @brief The source line where the statement starts, or 0 if it's unknown.
+    [[nodiscard]] Index line() const noexcept;
+    /// @brief Whether the node redirects the file descriptors of its left statement.
+    [[nodiscard]] bool is_redirection() const noexcept
     {
-      destruct( l_child_ );
-      destruct( r_child_ );
-      SiblingNodes().swap( siblings_ );
+      return type() >= StmtKind::ovrwrit_redrct && type() <= StmtKind::stdin_redrct;
     }
 
-    StmtNode* left() const& noexcept { return l_child_.get(); }
-    StmtNode* right() const& noexcept { return r_child_.get(); }
-    [[nodiscard]] ChildNode&& left() && noexcept { return std::move( l_child_ ); }
-    [[nodiscard]] ChildNode&& right() && noexcept { return std::move( r_child_ ); }
-    const SiblingNodes& siblings() const& noexcept { return siblings_; }
-    [[nodiscard]] SiblingNodes&& siblings() && noexcept { return std::move( siblings_ ); }
+    [[nodiscard]] StmtNode left() const noexcept;
+    [[nodiscard]] StmtNode right() const noexcept;
+    /// @return A random access range of `StmtNode`.
+    [[nodiscard]] auto siblings() const noexcept;
   };
 
   class ExprNode : public StmtNode {
   public:
     enum class ExprKind : uint8_t { command, string, value };
 
-  private:
-    ExprKind type_;
-    std::variant<type::Eval, type::String> expr_;
+    /// @brief A piece of a word, the expanded word is the concatenation of all its segments.
+    struct Segment {
+      enum class Kind : uint8_t { literal, variable, home_dir };
+      Kind kind_;
+      // The literal text or the name of the variable, it's empty for `Kind::home_dir`.
+      type::StrView text_;
+    };
 
-  public:
-    template<typename T>
-      requires std::disjunction_v<std::is_arithmetic<std::decay_t<T>>,
-                                  std::is_same<std::decay_t<T>, type::String>>
-    ExprNode( ExprKind expr_type, T&& data, SiblingNodes siblings = {} )
-      : StmtNode( StmtKind::atom, std::move( siblings ) )
-      , type_ { expr_type }
-      , expr_ { std::forward<T>( data ) }
+    explicit ExprNode( StmtNode node ) noexcept : StmtNode( node )
     {
-      if constexpr ( constexpr auto error_mes =
-                       "ExprNode: The parameter `data` does not match the type "
-                       "annotation `expr_type`";
-                     std::is_arithmetic_v<std::decay_t<T>> ) {
-        if ( expr_type != ExprKind::value ) [[unlikely]]
-          throw error::RuntimeError( error_mes );
-      } else {
-        if ( expr_type == ExprKind::value ) [[unlikely]]
-          throw error::RuntimeError( error_mes );
-      }
+      assert( node.type() == StmtKind::atom );
     }
-    ExprNode( ExprNode&& rhs )
-      : StmtNode( std::move( rhs ) ), type_ { rhs.type_ }, expr_ { std::move( rhs.expr_ ) }
-    {}
-    virtual ~ExprNode() = default;
 
-    [[nodiscard]] type::String&& token() && { return std::move( std::get<type::String>( expr_ ) ); }
-    const type::String& token() const& { return std::get<type::String>( expr_ ); }
+    [[nodiscard]] ExprKind kind() const noexcept;
+
+    /// @brief The returned string is always null-terminated.
+    /// @brief It's the word as written, without any expansion.
+    [[nodiscard]] type::StrView token() const noexcept;
+
+    /// @brief The template compiled by the parser.
+    /// @return A random access range of `Segment`, it's empty if the word is exactly `token()`.
+    [[nodiscard]] auto segments() const noexcept;
+
+    [[nodiscard]] type::Eval value() const noexcept;
+  };
+
+  /// @brief Storage of all nodes of one statement.
+  /// @brief Nodes are allocated contiguously and reference each other by index, the text of all
+  /// tokens shares a single string slab, so the whole tree is released by one `reset()`.
+  class SyntaxTree {
+    friend class StmtNode;
+    friend class ExprNode;
+    friend class ScriptCache;
+
+  public:
+    using Index = StmtNode::Index;
+
+  private:
+    struct TokenRef {
+      Index offset_, size_;
+    };
+    struct SegmentRef {
+      ExprNode::Segment::Kind kind_;
+      TokenRef text_;
+    };
+    struct WordRef {
+      TokenRef token_;
+      // The segments of the word are stored contiguously in `segments_`.
+      Index segments_, num_segments_;
+    };
+    struct Node {
+      StmtNode::StmtKind category_;
+      ExprNode::ExprKind expr_type_;
+      Index l_child_, r_child_;
+      /* Any additional arguments are stored contiguously in `siblings_`, this is the position of
+       * the first one and their number.
+       * For `StmtKind::pipeline` the siblings are the stages of the pipeline in order,
+       * otherwise the arguments can only be atom nodes. */
+      Index siblings_, num_siblings_;
+      // A statement starts at the line of its first operand, an atom at the line of its word.
+      Index line_;
+      union {
+        type::Eval value_;
+        WordRef word_;
+      };
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<Index> siblings_;
+    // The text of each segment refers to a part of the token of its word.
+    std::vector<SegmentRef> segments_;
+    // Each token is followed by a '\0', so that it can be passed to `exec` directly.
+    type::String tokens_;
+    Index root_;
+    // The source line of the atoms made from now on.
+    Index line_;
+
+    /// @brief The arrays which the nodes are read from, they're either owned by the tree or
+    /// mapped from a precompiled script.
+    struct View {
+      std::span<const Node> nodes_;
+      std::span<const Index> siblings_;
+      std::span<const SegmentRef> segments_;
+      type::StrView tokens_;
+    };
+    View view_;
+
+    /// @brief Point `view_` at the owned arrays, it's called after each modification.
+    void sync() noexcept { view_ = { nodes_, siblings_, segments_, tokens_ }; }
+
+    [[nodiscard]] Index push( StmtNode::StmtKind stmt_type,
+                              ExprNode::ExprKind expr_type,
+                              Index left_stmt,
+                              Index right_stmt,
+                              std::span<const Index> siblings );
+    [[nodiscard]] TokenRef intern( type::StrView token );
+
+  public:
+    // `view_` refers to the arrays of the tree itself.
+    SyntaxTree( const SyntaxTree& )            = delete;
+    SyntaxTree& operator=( const SyntaxTree& ) = delete;
+
+    SyntaxTree() noexcept : root_ { StmtNode::null_index }, line_ {}, view_ {} {}
+
+    [[nodiscard]] bool empty() const noexcept { return view_.nodes_.empty(); }
+    [[nodiscard]] std::size_t size() const noexcept { return view_.nodes_.size(); }
+
+    /// @brief Discard all nodes, the memory is kept for the next statement.
+    /// @brief A tree loaded from a precompiled script owns nodes again after that.
+    void reset() noexcept;
 
-    /// @brief Replace the current token with the new token.
-    void replace_with( type::String token )
+    [[nodiscard]] StmtNode root() noexcept { return { *this, root_ }; }
+    void set_root( Index root ) noexcept { root_ = root; }
+    /// @brief Set the source line of the words parsed next.
+    void set_line( Index line ) noexcept { line_ = line; }
+
+    [[nodiscard]] StmtNode operator[]( Index index ) noexcept { return { *this, index }; }
+
+    [[nodiscard]] Index make_stmt( StmtNode::StmtKind stmt_type,
+                                   Index left_stmt                 = StmtNode::null_index,
+                                   Index right_stmt                = StmtNode::null_index,
+                                   std::span<const Index> siblings = {} );
+    [[nodiscard]] Index make_stmt( StmtNode::StmtKind stmt_type, std::span<const Index> siblings )
     {
-      std::get<type::String>( expr_ ) = std::move( token );
+      return make_stmt( stmt_type, StmtNode::null_index, StmtNode::null_index, siblings );
     }
+    /// @brief The text of every segment must be a part of `token`.
+    [[nodiscard]] Index make_expr( ExprNode::ExprKind expr_type,
+                                   type::StrView token,
+                                   std::span<const ExprNode::Segment> segments,
+                                   std::span<const Index> siblings = {} );
+    [[nodiscard]] Index make_value( type::Eval value );
+  };
 
-    [[nodiscard]] type::Eval value() const { return std::get<type::Eval>( expr_ ); }
+  inline StmtNode::StmtKind StmtNode::type() const noexcept
+  {
+    return tree_->view_.nodes_[index_].category_;
+  }
 
-    [[nodiscard]] ExprKind kind() const noexcept { return type_; }
-  };
+  inline StmtNode::Index StmtNode::line() const noexcept
+  {
+    return tree_->view_.nodes_[index_].line_;
+  }
+
+  inline StmtNode StmtNode::left() const noexcept
+  {
+    return { *tree_, tree_->view_.nodes_[index_].l_child_ };
+  }
+
+  inline StmtNode StmtNode::right() const noexcept
+  {
+    return { *tree_, tree_->view_.nodes_[index_].r_child_ };
+  }
+
+  inline auto StmtNode::siblings() const noexcept
+  {
+    const auto& node = tree_->view_.nodes_[index_];
+    return tree_->view_.siblings_.subspan( node.siblings_, node.num_siblings_ )
+         | std::views::transform(
+             [tree = tree_]( Index index ) noexcept { return StmtNode( *tree, index ); } );
+  }
+
+  inline ExprNode::ExprKind ExprNode::kind() const noexcept
+  {
+    return tree_->view_.nodes_[index_].expr_type_;
+  }
+
+  inline type::StrView ExprNode::token() const noexcept
+  {
+    assert( kind() != ExprKind::value );
+    const auto [offset, size] = tree_->view_.nodes_[index_].word_.token_;
+    return { tree_->view_.tokens_.data() + offset, size };
+  }
+
+  inline auto ExprNode::segments() const noexcept
+  {
+    assert( kind() != ExprKind::value );
+    const auto& word = tree_->view_.nodes_[index_].word_;
+    return tree_->view_.segments_.subspan( word.segments_, word.num_segments_ )
+         | std::views::transform( [tree = tree_]( const SyntaxTree::SegmentRef& segment ) noexcept {
+             return Segment { .kind_ = segment.kind_,
+                              .text_ = { tree->view_.tokens_.data() + segment.text_.offset_,
+                                         segment.text_.size_ } };
+           } );
+  }
+
+  inline type::Eval ExprNode::value() const noexcept
+  {
+    assert( kind() == ExprKind::value );
+    return tree_->view_.nodes_[index_].value_;
+  }
 } // namespace tish
 
 #endif // TISH_TREENODE
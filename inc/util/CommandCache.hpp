@@ -0,0 +1,73 @@
+#ifndef TISH_COMMANDCACHE
+#define TISH_COMMANDCACHE
+
+#include <cstddef>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <util/Config.hpp>
+#include <vector>
+
+namespace tish {
+  namespace util {
+    /// @brief Maps command names to the absolute paths found in `PATH`.
+    /// @brief The whole cache is dropped when `PATH` changes, and the entries that a `PATH`
+    /// directory may shadow or remove are dropped when the modification time of the directory
+    /// changes.
+    class CommandCache {
+    public:
+      struct Entry {
+        type::String path_;
+        // The index of the `PATH` directory where the command was found, `seeded` if the path was
+        // specified by the user.
+        std::size_t dir_index_;
+        std::size_t hits_;
+      };
+      static constexpr std::size_t seeded = static_cast<std::size_t>( -1 );
+
+    private:
+      struct Directory {
+        type::String path_;
+        timespec mtime_;
+      };
+      struct StringHash {
+        using is_transparent = void;
+        std::size_t operator()( type::StrView str ) const noexcept
+        {
+          return std::hash<type::StrView> {}( str );
+        }
+      };
+
+      type::String envpath_;
+      std::vector<Directory> dirs_;
+      std::unordered_map<type::String, Entry, StringHash, std::equal_to<>> entries_;
+      // Holds the result which is found in a relative directory and not cached.
+      type::String uncached_;
+
+      /// @brief Reload the directories if `PATH` has changed.
+      void sync_envpath();
+      /// @brief Check the directories before `last_dir` (inclusive), drop the entries which may be
+      /// affected by a modified directory.
+      void sync_dirs( std::size_t last_dir ) noexcept;
+
+    public:
+      CommandCache() = default;
+
+      /// @brief Returns the absolute path of the command, or an empty string if it can't be found.
+      /// @brief The name must not contain any slash.
+      [[nodiscard]] type::StrView find( type::StrView name );
+
+      /// @brief Remember `path` as the location of `name`, it's never invalidated by `PATH`.
+      void seed( type::StrView name, type::String path );
+      /// @brief Drop the entry of `name`, e.g. the cached file was removed.
+      void forget( type::StrView name );
+      void clear() noexcept;
+
+      [[nodiscard]] bool empty() const noexcept { return entries_.empty(); }
+      [[nodiscard]] const auto& entries() const noexcept { return entries_; }
+    };
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_COMMANDCACHE
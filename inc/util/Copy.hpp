@@ -0,0 +1,24 @@
+#ifndef TISH_COPY
+#define TISH_COPY
+
+#include <span>
+#include <util/Config.hpp>
+
+namespace tish {
+  namespace util {
+    /// @brief Copy everything from `in_fd` to `out_fd` until the end of input.
+    /// @brief The data is moved by the kernel with `copy_file_range`, `sendfile` or `splice` if the
+    /// kinds of the files allow it, otherwise it's copied through a buffer.
+    /// @return false on failure, and `errno` is set.
+    [[nodiscard]] bool copy_fd( type::FileDesc in_fd, type::FileDesc out_fd ) noexcept;
+
+    /// @brief Copy everything from `in_fd` to each of `out_fds`.
+    /// @brief A pipe is duplicated into another pipe and a file by `tee` and `splice` without
+    /// copying, other cases are copied through a buffer.
+    /// @return false on failure, and `errno` is set.
+    [[nodiscard]] bool tee_fd( type::FileDesc in_fd,
+                               std::span<const type::FileDesc> out_fds ) noexcept;
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_COPY
@@ -0,0 +1,56 @@
+#ifndef TISH_FDGUARD
+#define TISH_FDGUARD
+
+#include <util/Config.hpp>
+#include <util/Spawn.hpp>
+#include <vector>
+
+namespace tish {
+  namespace util {
+    /// @brief Redirects the file descriptors of the shell process itself, all of them are restored
+    /// on destruction.
+    class FdGuard {
+      // Backups are moved above the descriptors that users usually redirect.
+      static constexpr type::FileDesc _min_backup_fd = 10;
+
+      struct Backup {
+        type::FileDesc fd_;
+        // -1 if `fd_` was not open before.
+        type::FileDesc backup_;
+      };
+      std::vector<Backup> backups_;
+      std::vector<type::FileDesc> opened_;
+
+      void backup( type::FileDesc fd ) noexcept( false );
+
+    public:
+      FdGuard( const FdGuard& )            = delete;
+      FdGuard& operator=( const FdGuard& ) = delete;
+
+      FdGuard() = default;
+      // The moved-from guard is left empty, so it restores nothing.
+      FdGuard( FdGuard&& ) noexcept = default;
+      ~FdGuard() noexcept;
+
+      /// @brief Open a close-on-exec file which is closed on destruction, it's created with mode
+      /// 0666 if `O_CREAT` is specified.
+      /// @param pending The actions applied before the file is used, it's kept off the descriptors
+      /// they overwrite.
+      /// @return -1 on failure, and `errno` is set.
+      [[nodiscard]] type::FileDesc open( const char* path,
+                                         int flags,
+                                         const SpawnActions& pending = {} ) noexcept;
+
+      /// @brief Make `dst_fd` refer to the same file as `src_fd`.
+      void rebind( type::FileDesc src_fd, type::FileDesc dst_fd ) noexcept( false );
+
+      /// @brief Apply the actions to the shell process in order.
+      void apply( const SpawnActions& actions ) noexcept( false );
+
+      /// @brief Restore all redirected file descriptors in the reverse order.
+      void restore() noexcept;
+    };
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_FDGUARD
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <optional>
+#include <sys/resource.h>
 #include <sys/types.h>
 
 namespace tish {
@@ -15,6 +16,7 @@ namespace tish {
     private:
       Pid process_id_;
       std::optional<ExitCode> subp_ret_;
+      rusage usage_;
 
       std::unique_ptr<sigset_t> old_set_;
       sigset_t new_set_;
@@ -40,6 +42,9 @@ namespace tish {
       /// @brief Check the exit code of subprocess.
       /// @return Return exit code.
       [[nodiscard]] std::optional<ExitCode> exit_code() const noexcept;
+      /// @brief The resources used by the subprocess and its waited descendants, it's only filled
+      /// once the subprocess is waited.
+      [[nodiscard]] const rusage& usage() const noexcept { return usage_; }
 
       /// @brief Wait for the subprocess to exit.
       void wait() noexcept( false );
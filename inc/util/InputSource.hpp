@@ -0,0 +1,96 @@
+#ifndef TISH_INPUTSOURCE
+#define TISH_INPUTSOURCE
+
+#include <cstddef>
+#include <memory>
+#include <util/Config.hpp>
+#include <vector>
+
+namespace tish {
+  namespace util {
+    /// @brief The source of the script text, which is consumed line by line.
+    class InputSource {
+    public:
+      struct Line {
+        // Without the line break.
+        type::StrView text_;
+        // False if the line is ended by the end of input rather than a line break.
+        bool complete_;
+      };
+
+      InputSource()                                = default;
+      InputSource( const InputSource& )            = delete;
+      InputSource& operator=( const InputSource& ) = delete;
+      virtual ~InputSource()                       = default;
+
+      /// @brief Returns the next line, the text is only valid until the next call.
+      /// @brief Once the input is exhausted, an empty incomplete line is returned.
+      [[nodiscard]] virtual Line getline() noexcept( false ) = 0;
+
+      /// @brief Whether all input has been returned, it's only known after the end is read.
+      [[nodiscard]] virtual bool exhausted() const noexcept = 0;
+
+      /// @brief Whether `getline` may wait for the input indefinitely, e.g. on a pipe or terminal.
+      [[nodiscard]] virtual bool may_block() const noexcept { return false; }
+    };
+
+    /// @brief Maps a whole regular file into memory, lines are returned without any copying.
+    class MappedSource : public InputSource {
+      const char* data_;
+      std::size_t size_;
+      std::size_t pos_;
+
+    public:
+      /// @brief The file descriptor can be closed after construction.
+      MappedSource( type::FileDesc fd, std::size_t file_size ) noexcept( false );
+      virtual ~MappedSource() noexcept;
+
+      [[nodiscard]] virtual Line getline() noexcept( false );
+      [[nodiscard]] virtual bool exhausted() const noexcept { return pos_ >= size_; }
+    };
+
+    /// @brief Reads the file descriptor in large blocks, which is used for pipes and terminals.
+    class BlockSource : public InputSource {
+      static constexpr std::size_t _block_size = 64 * 1024;
+
+      type::FileDesc fd_;
+      bool owns_fd_;
+      bool received_eof_;
+
+      std::vector<char> buffer_;
+      // The unread characters are [begin_, end_) of `buffer_`.
+      std::size_t begin_, end_;
+
+    public:
+      /// @param owns_fd Close the file descriptor on destruction.
+      BlockSource( type::FileDesc fd, bool owns_fd = false );
+      virtual ~BlockSource() noexcept;
+
+      [[nodiscard]] virtual Line getline() noexcept( false );
+      [[nodiscard]] virtual bool exhausted() const noexcept
+      {
+        return received_eof_ && begin_ == end_;
+      }
+      [[nodiscard]] virtual bool may_block() const noexcept { return true; }
+    };
+
+    /// @brief A script held in memory, such as the argument of `-c`.
+    class StringSource : public InputSource {
+      type::String text_;
+      std::size_t pos_;
+
+    public:
+      StringSource( type::String text ) noexcept : text_ { std::move( text ) }, pos_ {} {}
+      virtual ~StringSource() = default;
+
+      [[nodiscard]] virtual Line getline() noexcept;
+      [[nodiscard]] virtual bool exhausted() const noexcept { return pos_ >= text_.size(); }
+    };
+
+    /// @brief Opens the script file with the most suitable source.
+    [[nodiscard]] std::unique_ptr<InputSource>
+      open_source( const char* filename ) noexcept( false );
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_INPUTSOURCE
@@ -0,0 +1,131 @@
+#ifndef TISH_JOBTABLE
+#define TISH_JOBTABLE
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <poll.h>
+#include <span>
+#include <sys/types.h>
+#include <unordered_map>
+#include <util/Config.hpp>
+#include <utility>
+#include <vector>
+
+namespace tish {
+  namespace util {
+    /// @brief The background jobs of the shell.
+    /// @brief Every process of a job is watched by a pidfd, so the finished ones are found by a
+    /// single `poll` and reaped without blocking, and a blocking wait can be interrupted by a
+    /// signal.
+    /// @brief A process which can't be watched (before Linux 5.3) is checked by `waitpid` instead.
+    class JobTable {
+    public:
+      using ExitCode = int;
+      using Pid      = pid_t;
+
+      struct Process {
+        // -1 if the process could not be started.
+        Pid pid_;
+        // -1 if the process is not watched by a pidfd, or it's reaped already.
+        type::FileDesc pidfd_;
+        // The exit status once the process is reaped, a signal `n` which kills it gives `128 + n`.
+        std::optional<ExitCode> status_;
+        bool stopped_;
+      };
+      enum class State : uint8_t { running, stopped, done };
+
+      struct Job {
+        // The job number, `%n` refers to it.
+        std::size_t id_;
+        // All processes of the job are put in this group, 0 if none of them was started.
+        Pid pgid_;
+        type::String command_;
+        std::vector<Process> processes_;
+
+        [[nodiscard]] State state() const noexcept;
+        /// @brief Like a pipeline, it's the status of the first failed process.
+        /// @brief It's only meaningful once the job is done.
+        [[nodiscard]] ExitCode status() const noexcept;
+      };
+
+    private:
+      // Sorted by the job number, the last one is the current job.
+      std::vector<Job> jobs_;
+      // The status of each process of the removed jobs, so they can still be waited by pid.
+      std::unordered_map<Pid, ExitCode> finished_;
+      // The last pid and the status of each job which was done when it's removed by `remove_done`,
+      // oldest first, so `wait -n` still finds the jobs nobody waited for.
+      std::deque<std::pair<Pid, ExitCode>> unwaited_;
+      // Reused buffers of `poll`, and the process that each pidfd belongs to.
+      std::vector<pollfd> pollfds_;
+      std::vector<Process*> polled_;
+
+      /// @brief Collect the status change of the process by `waitpid` with `options`.
+      static void collect( Process& process, int options ) noexcept;
+
+      /// @brief Reap the finished processes of `job`, or of all jobs if `job` is null.
+      /// @param timeout The milliseconds to wait for a process to finish, -1 means forever.
+      /// @return false if the wait is interrupted by a signal.
+      [[nodiscard]] bool poll( Job* job, int timeout );
+
+    public:
+      JobTable() = default;
+      JobTable( const JobTable& )            = delete;
+      JobTable& operator=( const JobTable& ) = delete;
+      JobTable( JobTable&& rhs ) noexcept;
+      JobTable& operator=( JobTable&& rhs ) noexcept;
+      /// @brief Only the pidfds are closed, the jobs keep running.
+      ~JobTable() noexcept;
+
+      [[nodiscard]] bool empty() const noexcept { return jobs_.empty(); }
+      [[nodiscard]] std::span<Job> jobs() noexcept { return jobs_; }
+
+      /// @brief Add an empty job, its processes are appended by `watch`.
+      Job& add( Pid pgid, type::String command );
+      /// @brief Returns the process `pid` which is watched by a pidfd if possible.
+      [[nodiscard]] Process watch( Pid pid ) noexcept;
+
+      /// @brief Forget the job, the statuses of its processes are kept if it's done.
+      void remove( const Job& job );
+      /// @brief Forget every job which is done, their statuses are kept until they're waited.
+      void remove_done();
+      /// @brief Forget all jobs without waiting for them, it's used by a forked shell whose jobs
+      /// are not its children.
+      void clear() noexcept;
+
+      /// @brief Returns the job of the spec `%n`, `%+`, `%%`, `%-` or `%name`, or the job which has
+      /// the process of a pid, or null if there is no such job.
+      [[nodiscard]] Job* find( type::StrView spec ) noexcept;
+      /// @brief Returns the status of the removed job which had the process `pid`, it's forgotten
+      /// then.
+      [[nodiscard]] std::optional<ExitCode> take_finished( Pid pid ) noexcept;
+      /// @brief Returns the status of the oldest job forgotten by `remove_done` which is not
+      /// waited yet, it's forgotten then.
+      [[nodiscard]] std::optional<ExitCode> take_unwaited() noexcept;
+
+      /// @brief Reap the finished processes without blocking.
+      void reap();
+      /// @brief Like `reap`, but the stopped and continued processes are also found, it takes a
+      /// system call for each process.
+      void refresh();
+
+      /// @brief Block until every process of the job is finished.
+      /// @return false if it's interrupted by a signal.
+      [[nodiscard]] bool wait( Job& job );
+      /// @brief Block until any job is done, there must be a job which is not done.
+      /// @return The position of the done job in `jobs()`, or nullopt if it's interrupted by a
+      /// signal.
+      [[nodiscard]] std::optional<std::size_t> wait_any();
+
+      /// @brief Send `SIGCONT` to the job if it's stopped.
+      void resume( Job& job ) noexcept;
+      /// @brief Resume the job in the foreground and block until it's done or stopped.
+      /// @brief If the shell owns the terminal, it's handed to the job meanwhile.
+      void foreground( Job& job ) noexcept;
+    };
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_JOBTABLE
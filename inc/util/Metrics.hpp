@@ -0,0 +1,86 @@
+#ifndef TISH_METRICS
+#define TISH_METRICS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <util/Config.hpp>
+
+namespace tish {
+  namespace util {
+    /// @brief The counters of the events on the hot paths of the shell.
+    /// @brief Each counter is a relaxed atomic, so the parser thread counts without any lock, and
+    /// a count is only a single add on the path it's made.
+    class Metrics {
+    public:
+      enum class Counter : uint8_t {
+        statements,    // Statements parsed.
+        tokens,        // Tokens produced by the tokenizer.
+        nodes,         // Nodes allocated in syntax trees.
+        forks,         // Processes forked by the shell.
+        execs,         // Programs started, by spawning or replacing the shell.
+        exec_failures, // Programs which can't be started, including the ones not found.
+        output_bytes,  // Bytes written by the builtins through their output buffer.
+        path_hits,     // Commands found in the cache of `PATH`.
+        path_misses    // Commands searched in the directories of `PATH`.
+      };
+      static constexpr std::size_t num_counters = 9;
+
+      /// @brief The upper bounds of the buckets of the wait latency in microseconds, the last
+      /// bucket is unbounded.
+      static constexpr std::array<std::uint64_t, 6> wait_bounds { 100,     1'000,     10'000,
+                                                                  100'000, 1'000'000, 10'000'000 };
+
+    private:
+      std::array<std::atomic<std::uint64_t>, num_counters> counters_;
+      std::array<std::atomic<std::uint64_t>, wait_bounds.size() + 1> waits_;
+      std::atomic<std::uint64_t> wait_micros_;
+      // The file written on exit, and the process which writes it.
+      type::String path_;
+      pid_t owner_;
+
+      Metrics() noexcept : counters_ {}, waits_ {}, wait_micros_ {}, path_ {}, owner_ { -1 } {}
+
+    public:
+      Metrics( const Metrics& )            = delete;
+      Metrics& operator=( const Metrics& ) = delete;
+      ~Metrics() noexcept { dump(); }
+
+      static Metrics& inst() noexcept;
+
+      void add( Counter counter, std::uint64_t num = 1 ) noexcept
+      {
+        counters_[static_cast<std::size_t>( counter )].fetch_add( num, std::memory_order_relaxed );
+      }
+      /// @brief Take back a count made in advance, like the one of an `exec` which fails.
+      void cancel( Counter counter, std::uint64_t num = 1 ) noexcept
+      {
+        counters_[static_cast<std::size_t>( counter )].fetch_sub( num, std::memory_order_relaxed );
+      }
+      [[nodiscard]] std::uint64_t get( Counter counter ) const noexcept
+      {
+        return counters_[static_cast<std::size_t>( counter )].load( std::memory_order_relaxed );
+      }
+
+      /// @brief Count a wait for a child which blocked for `duration`.
+      void observe_wait( std::chrono::steady_clock::duration duration ) noexcept;
+
+      /// @brief Write the metrics to the file on exit, and before the shell is replaced by `exec`.
+      void export_to( type::String path ) noexcept;
+
+      /// @brief Returns the metrics as a table for people.
+      [[nodiscard]] type::String table() const;
+      /// @brief Returns the metrics in the text exposition format of Prometheus.
+      [[nodiscard]] type::String exposition() const;
+
+      /// @brief Replace the exported file with the current metrics at once, so a reader never sees
+      /// it half written. Only the process which requested the export writes it.
+      void dump() noexcept;
+    };
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_METRICS
@@ -0,0 +1,92 @@
+#ifndef TISH_PROFILER
+#define TISH_PROFILER
+
+#include <chrono>
+#include <cstdint>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <util/Config.hpp>
+#include <utility>
+#include <vector>
+
+namespace tish {
+  namespace util {
+    /// @brief Attributes the cost of running a script to the source lines of its commands, and
+    /// reports the lines sorted by wall time when the shell exits.
+    /// @brief A command is charged from its start until the shell has waited for it, so is a
+    /// pipeline as a whole. The processor time comes from `wait4`, so it includes everything the
+    /// children ran, while the work of a forked shell is charged to the stage which forked it.
+    class Profiler {
+    public:
+      using Clock = std::chrono::steady_clock;
+
+      /// @brief The cost of the commands on one line.
+      struct Line {
+        Clock::duration wall_;
+        // The processor time of the children, in microseconds.
+        std::int64_t user_, sys_;
+        std::uint64_t runs_, forks_, execs_;
+      };
+
+    private:
+      // It's only set before any other thread starts, and cleared in a forked child.
+      static inline bool enabled_ = false;
+      // Indexed by the line number, line 0 holds the commands whose line is not known.
+      std::vector<Line> lines_;
+      type::FileDesc fd_;
+      pid_t owner_;
+      Clock::time_point start_;
+      // Where the text of the lines in the report is read from, either a script file or the
+      // script itself.
+      type::String script_;
+      bool script_is_file_;
+
+      Profiler() noexcept : fd_ { -1 }, owner_ { -1 }, start_ {}, script_is_file_ { false } {}
+
+      [[nodiscard]] Line& at( std::uint32_t line );
+
+    public:
+      Profiler( const Profiler& )            = delete;
+      Profiler& operator=( const Profiler& ) = delete;
+      ~Profiler() noexcept { finish(); }
+
+      static Profiler& inst() noexcept;
+
+      [[nodiscard]] static bool enabled() noexcept { return enabled_; }
+
+      /// @brief Start profiling, the report is written to the file, which is truncated first, or to
+      /// the standard error if `path` is null.
+      /// @return false on failure, and `errno` is set.
+      [[nodiscard]] bool open( const char* path ) noexcept;
+
+      /// @brief Show the text of the lines from the script file in the report.
+      void script_file( type::String path ) noexcept
+      {
+        script_         = std::move( path );
+        script_is_file_ = true;
+      }
+      /// @brief Show the text of the lines from the script given in memory, like the one of `-c`.
+      void script_text( type::String text ) noexcept
+      {
+        script_         = std::move( text );
+        script_is_file_ = false;
+      }
+
+      /// @brief Charge a finished command or pipeline.
+      void run( std::uint32_t line, Clock::duration wall );
+      /// @brief Charge the processor time of a waited child.
+      void child( std::uint32_t line, const rusage& usage );
+      /// @brief Count a process started for the line, `exec` is set if it runs another program.
+      void start( std::uint32_t line, bool exec );
+
+      /// @brief Stop profiling in a forked child, whose cost is charged by the parent.
+      void forked() noexcept { enabled_ = false; }
+
+      /// @brief Write the report, it's only done once and only by the process which opened it.
+      /// @brief It must be called before the process image is replaced by `exec`.
+      void finish() noexcept;
+    };
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_PROFILER
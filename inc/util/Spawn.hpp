@@ -0,0 +1,104 @@
+#ifndef TISH_SPAWN
+#define TISH_SPAWN
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <util/Config.hpp>
+#include <vector>
+
+namespace tish {
+  namespace util {
+    /// @brief File descriptor operations which are applied in order in the child process, before
+    /// the program is executed, and the process group the child is put in.
+    class SpawnActions {
+    public:
+      struct Action {
+        enum class Kind : uint8_t { open, rebind, close } kind_;
+        type::FileDesc fd_;
+        // The source of `Kind::rebind`.
+        type::FileDesc src_fd_;
+        // The path of `Kind::open`, it must be alive until the process is spawned.
+        const char* path_;
+        int flags_;
+      };
+
+    private:
+      std::vector<Action> actions_;
+      std::optional<pid_t> pgroup_;
+
+    public:
+      /// @brief Open `path` as `fd`, files are created with mode 0666 if `O_CREAT` is specified.
+      SpawnActions& open( type::FileDesc fd, const char* path, int flags );
+      /// @brief Make `dst_fd` refer to the same file as `src_fd`.
+      SpawnActions& rebind( type::FileDesc src_fd, type::FileDesc dst_fd );
+      SpawnActions& close( type::FileDesc fd );
+      /// @brief Put the child in the process group `pgid`, or a new group led by it if `pgid` is 0.
+      SpawnActions& group( pid_t pgid ) noexcept;
+
+      /// @brief Whether any of the actions makes `fd` refer to another file.
+      [[nodiscard]] bool targets( type::FileDesc fd ) const noexcept;
+
+      [[nodiscard]] bool empty() const noexcept { return actions_.empty(); }
+      void clear() noexcept
+      {
+        actions_.clear();
+        pgroup_.reset();
+      }
+      [[nodiscard]] std::span<const Action> actions() const noexcept { return actions_; }
+      [[nodiscard]] std::optional<pid_t> process_group() const noexcept { return pgroup_; }
+    };
+
+    /// @brief Starts a program in a child process without duplicating the shell process.
+    /// @brief The signal mask of the child is cleared and `SIGINT`, `SIGTSTP` are reset to default.
+    class SpawnGuard {
+    public:
+      using ExitCode = int;
+      using Pid      = pid_t;
+
+    private:
+      Pid process_id_;
+      // The error number of the failed spawning, 0 means the program was executed.
+      int error_;
+      std::optional<ExitCode> subp_ret_;
+      rusage usage_;
+
+    public:
+      SpawnGuard( const SpawnGuard& )            = delete;
+      SpawnGuard& operator=( const SpawnGuard& ) = delete;
+      SpawnGuard& operator=( SpawnGuard&& )      = delete;
+
+      /// @brief Execute `file` with `argv`, `file` is searched in `PATH` if it contains no slash.
+      SpawnGuard( const char* file,
+                  char* const argv[],
+                  const SpawnActions& actions = {} ) noexcept( false );
+      SpawnGuard( SpawnGuard&& rhs ) noexcept;
+      ~SpawnGuard() noexcept = default;
+
+      [[nodiscard]] Pid pid() const noexcept { return process_id_; }
+      /// @brief Returns the error number if the program could not be executed, otherwise 0.
+      [[nodiscard]] int error() const noexcept { return error_; }
+      [[nodiscard]] bool launched() const noexcept { return error_ == 0; }
+
+      /// @brief Check the exit code of subprocess.
+      [[nodiscard]] std::optional<ExitCode> exit_code() const noexcept;
+      /// @brief The resources used by the subprocess and its waited descendants, it's only filled
+      /// once the subprocess is waited.
+      [[nodiscard]] const rusage& usage() const noexcept { return usage_; }
+
+      /// @brief Wait for the subprocess to exit, it does nothing if the spawning failed.
+      void wait() noexcept( false );
+    };
+
+    /// @brief Execute `file` in place of the shell process, the file descriptors and signals are
+    /// set up like `SpawnGuard` does for a child.
+    /// @return The error number if the program could not be executed, the shell is restored then.
+    [[nodiscard]] int replace_process( const char* file,
+                                       char* const argv[],
+                                       const SpawnActions& actions ) noexcept;
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_SPAWN
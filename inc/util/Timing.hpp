@@ -0,0 +1,52 @@
+#ifndef TISH_TIMING
+#define TISH_TIMING
+
+#include <chrono>
+#include <cstdint>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <util/Config.hpp>
+#include <vector>
+
+namespace tish {
+  namespace util {
+    /// @brief The measurement of a statement prefixed by `time`.
+    /// @brief The wall time comes from a monotonic clock, and the resources are the ones used by
+    /// the thread of the shell which evaluates the statement, where the builtins run, plus the ones
+    /// of each child waited meanwhile.
+    class Timing {
+    public:
+      enum class Format : uint8_t { human, json };
+
+      /// @brief A child waited during the measurement, such as a stage of a pipeline.
+      struct Stage {
+        pid_t pid_;
+        type::Eval status_;
+        type::String command_;
+        // Returned by `wait4`, it includes the descendants which the child waited.
+        rusage usage_;
+      };
+
+    private:
+      Format format_;
+      std::chrono::steady_clock::time_point start_;
+      rusage self_start_;
+      std::vector<Stage> stages_;
+
+    public:
+      /// @brief Start the measurement.
+      explicit Timing( Format format ) noexcept;
+
+      void record( pid_t pid, type::Eval status, type::String command, const rusage& usage );
+      /// @brief Take the children of a nested measurement which is finished, so they're counted
+      /// by this one too.
+      void merge( Timing&& inner );
+
+      /// @brief Returns the report of the measurement until now, it ends with a line break.
+      /// @brief The children are broken down one by one if there are more than one of them.
+      [[nodiscard]] type::String report() const;
+    };
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_TIMING
@@ -0,0 +1,107 @@
+#ifndef TISH_TRACER
+#define TISH_TRACER
+
+#include <chrono>
+#include <cstdint>
+#include <sys/types.h>
+#include <util/Config.hpp>
+
+namespace tish {
+  namespace util {
+    /// @brief Records the execution of the shell as timestamped spans in the Trace Event Format,
+    /// which is loaded by `chrome://tracing` and Perfetto.
+    /// @brief Each thread appends the events to a buffer of its own without any lock, the buffer
+    /// is written to the trace file when it's full and when the thread or the process ends. The
+    /// file is opened in append mode, so the forked processes write their events to it as well.
+    /// @brief The trailing `]` of the file is optional in the format, it's written when the process
+    /// which opened the file ends.
+    class Tracer {
+    public:
+      using Clock = std::chrono::steady_clock;
+
+    private:
+      // It's only set before any other thread starts, so reading it needs no synchronization.
+      static inline bool enabled_ = false;
+      type::FileDesc fd_;
+      pid_t owner_;
+
+      Tracer() noexcept : fd_ { -1 }, owner_ { -1 } {}
+
+    public:
+      Tracer( const Tracer& )            = delete;
+      Tracer& operator=( const Tracer& ) = delete;
+      ~Tracer() noexcept;
+
+      static Tracer& inst() noexcept;
+
+      /// @brief Whether the spans are recorded, it's always false if `TISH_NO_TRACE` is defined.
+      [[nodiscard]] static bool enabled() noexcept
+      {
+#ifdef TISH_NO_TRACE
+        return false;
+#else
+        return enabled_;
+#endif
+      }
+
+      /// @brief Start tracing into the file, which is truncated first.
+      /// @return false on failure, and `errno` is set.
+      [[nodiscard]] bool open( const char* path ) noexcept;
+
+      /// @brief Record a span of the current thread.
+      /// @param args The members of the JSON object of the arguments, without the braces.
+      void record( type::StrView name,
+                   type::StrView category,
+                   Clock::time_point begin,
+                   Clock::time_point end,
+                   type::StrView args );
+
+      /// @brief Write the buffered events of the current thread to the file.
+      /// @brief It must be called before the process image is replaced by `exec`.
+      void flush() noexcept;
+
+      /// @brief Drop the events copied from the parent, it's called in a forked child.
+      void forked() noexcept;
+    };
+
+    /// @brief A span which lasts until its destruction.
+    /// @brief If tracing is off, it's nothing but a single branch on construction and destruction.
+    class TraceSpan {
+      type::StrView name_, category_;
+      Tracer::Clock::time_point begin_;
+      // The arguments shown with the event, it's only filled if the span is recorded.
+      type::String args_;
+      bool active_;
+
+    public:
+      TraceSpan( const TraceSpan& )            = delete;
+      TraceSpan& operator=( const TraceSpan& ) = delete;
+
+      /// @brief The name and category must outlive the span.
+      TraceSpan( type::StrView name, type::StrView category ) noexcept
+        : name_ { name }, category_ { category }, begin_ {}, active_ { Tracer::enabled() }
+      {
+        if ( active_ ) [[unlikely]]
+          begin_ = Tracer::Clock::now();
+      }
+      ~TraceSpan() noexcept
+      {
+        if ( active_ ) [[unlikely]]
+          finish();
+      }
+
+      [[nodiscard]] bool active() const noexcept { return active_; }
+
+      /// @brief Attach an argument to the event, it does nothing if the span is not recorded.
+      void arg( type::StrView key, type::StrView value );
+      void arg( type::StrView key, std::int64_t value );
+
+      /// @brief Record the span now instead of on destruction.
+      void finish() noexcept;
+      /// @brief Drop the span without recording it.
+      void discard() noexcept { active_ = false; }
+    };
+  } // namespace util
+} // namespace tish
+
+#endif // TISH_TRACER
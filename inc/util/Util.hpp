@@ -1,9 +1,10 @@
 #ifndef TISH_UTIL
 #define TISH_UTIL
 
+#include <cstdint>
 #include <functional>
-#include <regex>
 #include <span>
+#include <sys/time.h>
 #include <type_traits>
 #include <util/Config.hpp>
 #include <utility>
@@ -14,22 +15,23 @@ namespace tish {
 
     [[nodiscard]] type::String format_char( type::Char character );
 
-    bool create_file( type::StrView filename );
-
     [[nodiscard]] type::StrView get_homedir() noexcept;
 
-    [[nodiscard]] std::vector<type::String> get_envpath();
-
     [[nodiscard]] type::String format_error( type::StrView __s );
 
-    [[nodiscard]] std::pair<bool, std::smatch> match_string( const type::String& str,
-                                                             type::StrView reg_str );
+    bool rebind_fd( type::FileDesc old_fd, type::FileDesc new_fd ) noexcept;
+
+    /// @brief Write the whole `data` to `fd`, partial writes and interrupts are retried.
+    /// @return false on failure, and `errno` is set.
+    [[nodiscard]] bool write_all( type::FileDesc fd, type::StrView data ) noexcept;
 
-    /// @brief Finds the path to the given file in the path set.
-    [[nodiscard]] type::String search_filepath( std::span<const type::String> path_set,
-                                                type::StrView filename );
+    /// @brief Append `text` to `out` as a quoted JSON string.
+    void append_json_string( type::String& out, type::StrView text );
 
-    bool rebind_fd( type::FileDesc old_fd, type::FileDesc new_fd ) noexcept;
+    [[nodiscard]] std::int64_t to_microseconds( const timeval& time ) noexcept;
+
+    /// @brief Like bash, a human readable time is rounded to milliseconds.
+    [[nodiscard]] type::String format_seconds( std::int64_t micros );
 
     template<typename V, typename... Vs>
     struct Overloader
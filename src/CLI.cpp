@@ -2,6 +2,7 @@
 #include <Parser.hpp>
 #include <algorithm>
 #include <array>
+#include <csignal>
 #include <filesystem>
 #include <format>
 #include <pwd.h>
@@ -16,8 +17,9 @@ using namespace std;
 namespace tish {
   namespace cli {
     std::atomic<bool> BaseCLI::_existed = false;
+    std::mutex PipelinedCLI::_parsing;
 
-    int BaseCLI::run()
+    void BaseCLI::prepare()
     {
       signal(
         SIGINT,
@@ -32,12 +34,16 @@ namespace tish {
           iout::prmptr << "\n" << std::flush;
         } );
       tish::iout::logger.set_prefix( "tish: " );
+    }
 
+    int BaseCLI::run()
+    {
+      prepare();
       while ( !prsr_.empty() ) {
         try {
-          auto parsed = prsr_.parse();
-          interp_.evaluate( parsed.get() );
-          parsed->clear();
+          prsr_.parse( tree_ );
+          interp_.evaluate( tree_, prsr_.exhausted() );
+          tree_.reset();
         } catch ( const error::SystemCallError& e ) {
           iout::logger.print( e );
         } catch ( const error::TerminationSignal& e ) {
@@ -49,6 +55,132 @@ namespace tish {
       return EXIT_SUCCESS;
     }
 
+    int CachedCLI::run()
+    {
+      prepare();
+      while ( !cache_.empty() ) {
+        try {
+          if ( const auto diagnostic = cache_.load( tree_ ); diagnostic.has_value() )
+            iout::logger << *diagnostic;
+          else
+            interp_.evaluate( tree_, cache_.exhausted() );
+          tree_.reset();
+        } catch ( const error::SystemCallError& e ) {
+          iout::logger.print( e );
+        } catch ( const error::TerminationSignal& e ) {
+          return e.value();
+        } catch ( const error::TraceBack& e ) {
+          iout::logger << e;
+        }
+      }
+      return EXIT_SUCCESS;
+    }
+
+    PipelinedCLI::~PipelinedCLI() noexcept
+    {
+      if ( !parser_.joinable() )
+        return;
+      if ( getpid() != owner_ ) {
+        // The parser doesn't exist in a forked stage, and its locks may be held by the parent.
+        parser_.detach();
+        static_cast<void>( channel_.release() );
+        return;
+      }
+      {
+        lock_guard<mutex> lock( channel_->mtx_ );
+        stopped_ = true;
+      }
+      channel_->vacant_.notify_one();
+      parser_.join();
+    }
+
+    void PipelinedCLI::parse_ahead()
+    {
+      while ( !prsr_.empty() ) {
+        Slot* slot = nullptr;
+        {
+          unique_lock<mutex> lock( channel_->mtx_ );
+          channel_->vacant_.wait( lock,
+                                  [this] { return tail_ - head_ < _queue_size || stopped_; } );
+          if ( stopped_ )
+            return;
+          slot = &slots_[tail_ % _queue_size];
+        }
+
+        // The slot is only touched by this thread until `tail_` passes it.
+        {
+          lock_guard<mutex> parsing( _parsing );
+          try {
+            prsr_.parse( slot->tree_ );
+          } catch ( ... ) {
+            slot->error_ = current_exception();
+          }
+          slot->last_ = prsr_.exhausted();
+        }
+        {
+          lock_guard<mutex> lock( channel_->mtx_ );
+          ++tail_;
+        }
+        channel_->ready_.notify_one();
+      }
+
+      {
+        lock_guard<mutex> lock( channel_->mtx_ );
+        parsed_all_ = true;
+      }
+      channel_->ready_.notify_one();
+    }
+
+    int PipelinedCLI::run()
+    {
+      prepare();
+
+      // The handlers can't be unregistered, so they're registered once per process.
+      static const bool fork_handlers_set = [] {
+        const auto release = []() noexcept { _parsing.unlock(); };
+        return pthread_atfork( []() noexcept { _parsing.lock(); }, release, release ) == 0;
+      }();
+      if ( !fork_handlers_set ) [[unlikely]]
+        throw error::RuntimeError( "PipelinedCLI: failed to register the fork handlers" );
+
+      // Signals are left to the evaluating thread, the parser inherits a fully blocked mask.
+      sigset_t all_signals, old_signals;
+      sigfillset( &all_signals );
+      pthread_sigmask( SIG_BLOCK, &all_signals, &old_signals );
+      owner_  = getpid();
+      parser_ = thread( &PipelinedCLI::parse_ahead, this );
+      pthread_sigmask( SIG_SETMASK, &old_signals, nullptr );
+
+      while ( true ) {
+        Slot* slot = nullptr;
+        {
+          unique_lock<mutex> lock( channel_->mtx_ );
+          channel_->ready_.wait( lock, [this] { return head_ != tail_ || parsed_all_; } );
+          if ( head_ == tail_ )
+            break;
+          slot = &slots_[head_ % _queue_size];
+        }
+
+        try {
+          if ( slot->error_ )
+            rethrow_exception( exchange( slot->error_, nullptr ) );
+          interp_.evaluate( slot->tree_, slot->last_ );
+        } catch ( const error::SystemCallError& e ) {
+          iout::logger.print( e );
+        } catch ( const error::TerminationSignal& e ) {
+          return e.value();
+        } catch ( const error::TraceBack& e ) {
+          iout::logger << e;
+        }
+        {
+          lock_guard<mutex> lock( channel_->mtx_ );
+          ++head_;
+        }
+        channel_->vacant_.notify_one();
+      }
+      return EXIT_SUCCESS;
+    }
+
     void CLI::update_prompt()
     {
       if ( current_dir_.size() >= home_dir_.size()
@@ -56,6 +188,12 @@ namespace tish {
         current_dir_.replace( 0, home_dir_.size(), "~" );
       auto error_info = [this]() {
         if ( last_result_.has_value() && !last_result_.value() ) {
+          if ( !last_result_->side_val.has_value() && !last_result_->pipe_status.empty() ) {
+            type::String stages;
+            for ( const auto status : last_result_->pipe_status )
+              stages.append( stages.empty() ? "" : "|" ).append( to_string( status ) );
+            return format( _unary_err_fmt, stages );
+          }
           return last_result_->side_val.has_value()
                  ? visit( util::Overloader(
                             []( const std::pair<type::Eval, type::Eval>& binary ) {
@@ -121,9 +259,9 @@ namespace tish {
         iout::prmptr << prompt() << std::flush;
 
         try {
-          auto parsed  = prsr_.parse();
-          last_result_ = interp_.evaluate( parsed.get() );
-          parsed->clear();
+          prsr_.parse( tree_ );
+          last_result_ = interp_.evaluate( tree_ );
+          tree_.reset();
           ranges::for_each( last_result_->message,
                             []( type::StrView info ) { iout::logger << info; } );
         } catch ( const error::SystemCallError& e ) {
@@ -1,30 +1,594 @@
 #include <HelpDocument.hpp>
 #include <Interpreter.hpp>
+#include <Parser.hpp>
+#include <Program.hpp>
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
 #include <fcntl.h>
 #include <filesystem>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
-#include <regex>
+#include <ranges>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <util/Config.hpp>
 #include <util/Constant.hpp>
+#include <util/Copy.hpp>
 #include <util/Exception.hpp>
+#include <util/FdGuard.hpp>
 #include <util/ForkGuard.hpp>
+#include <util/InputSource.hpp>
+#include <util/JobTable.hpp>
+#include <util/Metrics.hpp>
 #include <util/Pipe.hpp>
+#include <util/Profiler.hpp>
+#include <util/Spawn.hpp>
+#include <util/Timing.hpp>
+#include <util/Tracer.hpp>
 #include <util/Util.hpp>
 #include <utility>
 #include <variant>
 using namespace std;
 
 namespace tish {
-  const std::unordered_set<type::String> Interpreter::_built_in_cmds = { "cd",
-                                                                         "exit",
-                                                                         "help",
-                                                                         "type",
-                                                                         "exec" };
+  namespace details {
+    /// @brief Whether the spawned command is the last thing to run, i.e. nothing but its own
+    /// waiting and cleanup follows it before the process ends.
+    /// @param rest The instructions after the `spawn`.
+    [[nodiscard]] bool in_tail_position( span<const Program::Instruction> rest, bool last ) noexcept
+    {
+      for ( const auto& instr : rest ) {
+        switch ( instr.op_ ) {
+        case Program::OpCode::wait:    [[fallthrough]];
+        case Program::OpCode::restore: [[fallthrough]];
+        case Program::OpCode::pair:    continue;
+        // A stage of a pipeline ends its own process.
+        case Program::OpCode::exit: return true;
+        default:                    return false;
+        }
+      }
+      return last;
+    }
+
+    /// @brief How the backslash escapes of a builtin are interpreted.
+    enum class Escapes : uint8_t {
+      echo,    // `echo -e`, an octal escape is `\0nnn`.
+      format,  // The format of `printf`, an octal escape is `\nnn` and `\c` is not an escape.
+      argument // The argument of `printf %b`, an octal escape is `\0nnn` or `\nnn`.
+    };
+
+    /// @brief Append the character of the backslash escape at `text[pos]` to `out`.
+    /// @return The position after the escape, or `npos` if it's a `\c` which ends the output.
+    [[nodiscard]] size_t unescape( type::String& out,
+                                   type::StrView text,
+                                   size_t pos,
+                                   Escapes escapes )
+    {
+      assert( text[pos] == '\\' );
+      if ( pos + 1 == text.size() ) {
+        out.push_back( '\\' );
+        return text.size();
+      }
+
+      // Parse at most `max_digits` digits from `begin`, they make up a single byte.
+      const auto append_code = [&]( size_t begin, size_t max_digits, int base ) {
+        unsigned int code = 0;
+        const auto [end, _] = from_chars( text.data() + begin,
+                                          text.data() + min( begin + max_digits, text.size() ),
+                                          code,
+                                          base );
+        out.push_back( static_cast<char>( code ) );
+        return static_cast<size_t>( end - text.data() );
+      };
+
+      const auto escape = text[pos + 1];
+      switch ( escape ) {
+      case 'a':  out.push_back( '\a' ); break;
+      case 'b':  out.push_back( '\b' ); break;
+      case 'e':  [[fallthrough]];
+      case 'E':  out.push_back( '\x1B' ); break;
+      case 'f':  out.push_back( '\f' ); break;
+      case 'n':  out.push_back( '\n' ); break;
+      case 'r':  out.push_back( '\r' ); break;
+      case 't':  out.push_back( '\t' ); break;
+      case 'v':  out.push_back( '\v' ); break;
+      case '\\': out.push_back( '\\' ); break;
+      case 'c':  {
+        if ( escapes != Escapes::format )
+          return type::StrView::npos;
+        out.append( text.substr( pos, 2 ) );
+      } break;
+      case 'x': {
+        if ( pos + 2 < text.size() && isxdigit( static_cast<unsigned char>( text[pos + 2] ) ) )
+          return append_code( pos + 2, 2, 16 );
+        out.append( text.substr( pos, 2 ) );
+      } break;
+      default: {
+        if ( escape == '0' && escapes != Escapes::format )
+          return append_code( pos + 2, 3, 8 );
+        if ( escape >= '0' && escape <= '7' && escapes != Escapes::echo )
+          return append_code( pos + 1, 3, 8 );
+        if ( escapes == Escapes::format && ( escape == '"' || escape == '\'' || escape == '?' ) )
+          out.push_back( escape );
+        else
+          out.append( text.substr( pos, 2 ) );
+      } break;
+      }
+      return pos + 2;
+    }
+
+    /// @brief Append `text` to `out` with its backslash escapes interpreted.
+    /// @return false if the output is ended by a `\c`.
+    [[nodiscard]] bool append_unescaped( type::String& out, type::StrView text, Escapes escapes )
+    {
+      for ( size_t pos = 0; pos < text.size(); ) {
+        if ( text[pos] != '\\' )
+          out.push_back( text[pos++] );
+        else if ( pos = unescape( out, text, pos, escapes ); pos == type::StrView::npos )
+          return false;
+      }
+      return true;
+    }
+
+    /// @brief Append the value formatted by the conversion `spec` of `printf` to `out`.
+    template<typename T>
+    void append_printf( type::String& out, const type::String& spec, T value )
+    {
+      const auto size = snprintf( nullptr, 0, spec.c_str(), value );
+      if ( size <= 0 )
+        return;
+      const auto offset = out.size();
+      out.resize( offset + size );
+      snprintf( out.data() + offset, size + 1, spec.c_str(), value );
+    }
+
+    /// @brief Parse a numeric argument of `printf`, a leading quote makes it the code of the
+    /// character after the quote.
+    /// @return The value, and whether the whole argument is a number.
+    template<typename T>
+    [[nodiscard]] pair<T, bool> printf_number( const char* arg ) noexcept
+    {
+      if ( arg[0] == '\'' || arg[0] == '"' )
+        return { static_cast<T>( static_cast<unsigned char>( arg[1] ) ), true };
+      if ( arg[0] == '\0' )
+        return { 0, true };
+
+      char* end = nullptr;
+      errno     = 0;
+      T value;
+      if constexpr ( is_integral_v<T> )
+        value = strtoll( arg, &end, 0 );
+      else
+        value = strtold( arg, &end );
+      return { value, errno == 0 && end != arg && *end == '\0' };
+    }
+
+    /// @brief Parse an integer operand of `test`, blanks around it are allowed.
+    [[nodiscard]] optional<long long> test_integer( type::StrView operand ) noexcept
+    {
+      const auto begin = operand.find_first_not_of( " \t" );
+      if ( begin == type::StrView::npos )
+        return nullopt;
+      operand = operand.substr( begin, operand.find_last_not_of( " \t" ) + 1 - begin );
+      if ( operand.front() == '+' )
+        operand.remove_prefix( 1 );
+
+      long long value = 0;
+      const auto [end, ec] = from_chars( operand.data(), operand.data() + operand.size(), value );
+      if ( ec != errc {} || end != operand.data() + operand.size() )
+        return nullopt;
+      return value;
+    }
+
+    [[nodiscard]] bool is_unary_test( type::StrView op ) noexcept
+    {
+      return op.size() == 2 && op.front() == '-'
+          && "zntrwxhLefdspSbcugk"sv.find( op.back() ) != type::StrView::npos;
+    }
+
+    [[nodiscard]] bool is_binary_test( type::StrView op ) noexcept
+    {
+      static constexpr array<type::StrView, 14> binary_ops {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"
+      };
+      return ranges::find( binary_ops, op ) != binary_ops.cend();
+    }
+
+    /// @brief Evaluate the unary primary `-op operand` of `test`.
+    [[nodiscard]] bool unary_test( char op, const char* operand ) noexcept
+    {
+      switch ( op ) {
+      case 'z': return operand[0] == '\0';
+      case 'n': return operand[0] != '\0';
+      case 't': {
+        const auto fd = test_integer( operand );
+        return fd.has_value() && *fd >= 0 && *fd <= numeric_limits<type::FileDesc>::max()
+            && isatty( static_cast<type::FileDesc>( *fd ) );
+      }
+      case 'r': return faccessat( AT_FDCWD, operand, R_OK, AT_EACCESS ) == 0;
+      case 'w': return faccessat( AT_FDCWD, operand, W_OK, AT_EACCESS ) == 0;
+      case 'x': return faccessat( AT_FDCWD, operand, X_OK, AT_EACCESS ) == 0;
+      case 'h': [[fallthrough]];
+      case 'L': {
+        struct stat file_stat;
+        return lstat( operand, &file_stat ) == 0 && S_ISLNK( file_stat.st_mode );
+      }
+      default: break;
+      }
+
+      struct stat file_stat;
+      if ( stat( operand, &file_stat ) != 0 )
+        return false;
+      switch ( op ) {
+      case 'e': return true;
+      case 'f': return S_ISREG( file_stat.st_mode );
+      case 'd': return S_ISDIR( file_stat.st_mode );
+      case 's': return file_stat.st_size > 0;
+      case 'p': return S_ISFIFO( file_stat.st_mode );
+      case 'S': return S_ISSOCK( file_stat.st_mode );
+      case 'b': return S_ISBLK( file_stat.st_mode );
+      case 'c': return S_ISCHR( file_stat.st_mode );
+      case 'u': return ( file_stat.st_mode & S_ISUID ) != 0;
+      case 'g': return ( file_stat.st_mode & S_ISGID ) != 0;
+      case 'k': return ( file_stat.st_mode & S_ISVTX ) != 0;
+      default:  return false;
+      }
+    }
+
+    /// @brief Evaluate the binary primary `lhs op rhs` of `test`.
+    /// @return nullopt if an operand of an integer comparison is not an integer.
+    [[nodiscard]] optional<bool> binary_test( type::StrView lhs,
+                                              type::StrView op,
+                                              type::StrView rhs ) noexcept
+    {
+      if ( op == "=" || op == "==" )
+        return lhs == rhs;
+      else if ( op == "!=" )
+        return lhs != rhs;
+      else if ( op == "<" )
+        return lhs < rhs;
+      else if ( op == ">" )
+        return lhs > rhs;
+
+      if ( op == "-nt" || op == "-ot" || op == "-ef" ) {
+        struct stat lhs_stat, rhs_stat;
+        const bool lhs_exists = stat( lhs.data(), &lhs_stat ) == 0;
+        const bool rhs_exists = stat( rhs.data(), &rhs_stat ) == 0;
+        if ( op == "-ef" )
+          return lhs_exists && rhs_exists && lhs_stat.st_dev == rhs_stat.st_dev
+              && lhs_stat.st_ino == rhs_stat.st_ino;
+        // A file is newer than a missing one.
+        if ( !lhs_exists || !rhs_exists )
+          return op == "-nt" ? lhs_exists : rhs_exists;
+        const auto lhs_time = make_pair( lhs_stat.st_mtim.tv_sec, lhs_stat.st_mtim.tv_nsec );
+        const auto rhs_time = make_pair( rhs_stat.st_mtim.tv_sec, rhs_stat.st_mtim.tv_nsec );
+        return op == "-nt" ? lhs_time > rhs_time : lhs_time < rhs_time;
+      }
+
+      const auto lhs_value = test_integer( lhs );
+      const auto rhs_value = test_integer( rhs );
+      if ( !lhs_value || !rhs_value )
+        return nullopt;
+      if ( op == "-eq" )
+        return *lhs_value == *rhs_value;
+      else if ( op == "-ne" )
+        return *lhs_value != *rhs_value;
+      else if ( op == "-lt" )
+        return *lhs_value < *rhs_value;
+      else if ( op == "-le" )
+        return *lhs_value <= *rhs_value;
+      else if ( op == "-gt" )
+        return *lhs_value > *rhs_value;
+      return *lhs_value >= *rhs_value;
+    }
+
+    /// @brief Append the statement to `out` as it would be written, it describes a background job.
+    void describe( StmtNode stmt, type::String& out )
+    {
+      // The operator of a redirection, it follows the redirected statement.
+      struct Redirect {
+        StmtNode redr_;
+      };
+      const auto append_word = [&out]( ExprNode word ) {
+        if ( word.kind() == ExprNode::ExprKind::string )
+          out.append( "\"" ).append( word.token() ).push_back( '"' );
+        else
+          out.append( word.token() );
+      };
+      const auto append_fd = [&out]( ExprNode word ) {
+        if ( word.value() != constant::invalid_value )
+          out.append( to_string( word.value() ) );
+      };
+
+      // Pieces are popped from the back, so they're pushed in the reverse order of the text.
+      vector<variant<StmtNode, type::StrView, Redirect>> pieces { stmt };
+      const auto push_operand = [&pieces]( StmtNode operand ) {
+        // Connectors are right associative, so only the other operands need parentheses.
+        // A `time` measures the rest of the statement, so it's enclosed as an operand too.
+        if ( ( operand.type() >= StmtNode::StmtKind::sequential
+               && operand.type() <= StmtNode::StmtKind::pipeline
+               && operand.type() != StmtNode::StmtKind::logical_not )
+             || operand.type() == StmtNode::StmtKind::timed ) {
+          pieces.emplace_back( ")"sv );
+          pieces.emplace_back( operand );
+          pieces.emplace_back( "("sv );
+        } else
+          pieces.emplace_back( operand );
+      };
+
+      while ( !pieces.empty() ) {
+        const auto piece = pieces.back();
+        pieces.pop_back();
+        if ( const auto text = get_if<type::StrView>( &piece ); text != nullptr ) {
+          out.append( *text );
+          continue;
+        } else if ( const auto redirect = get_if<Redirect>( &piece ); redirect != nullptr ) {
+          const auto redr = redirect->redr_;
+          const auto args = redr.siblings();
+          if ( redr.left() )
+            out.push_back( ' ' );
+          switch ( redr.type() ) {
+          case StmtNode::StmtKind::ovrwrit_redrct: [[fallthrough]];
+          case StmtNode::StmtKind::appnd_redrct:   {
+            append_fd( ExprNode( args[0] ) );
+            out.append( redr.type() == StmtNode::StmtKind::appnd_redrct ? ">> " : "> " );
+            append_word( ExprNode( args[1] ) );
+          } break;
+          case StmtNode::StmtKind::merge_output: [[fallthrough]];
+          case StmtNode::StmtKind::merge_appnd:  {
+            out.append( redr.type() == StmtNode::StmtKind::merge_appnd ? "&>> " : "&> " );
+            append_word( ExprNode( args[0] ) );
+          } break;
+          case StmtNode::StmtKind::merge_stream: {
+            append_fd( ExprNode( args[0] ) );
+            out.append( ">&" );
+            append_fd( ExprNode( args[1] ) );
+          } break;
+          default: {
+            out.append( "< " );
+            append_word( ExprNode( args[0] ) );
+          } break;
+          }
+          continue;
+        }
+
+        const auto node = get<StmtNode>( piece );
+        switch ( node.type() ) {
+        case StmtNode::StmtKind::atom: {
+          const auto expr = ExprNode( node );
+          if ( expr.kind() == ExprNode::ExprKind::value )
+            break;
+          append_word( expr );
+          for ( const auto arg : expr.siblings() ) {
+            out.push_back( ' ' );
+            append_word( ExprNode( arg ) );
+          }
+        } break;
+
+        case StmtNode::StmtKind::sequential: {
+          if ( node.right() ) {
+            pieces.emplace_back( node.right() );
+            // A background job ends with a `&` already.
+            pieces.emplace_back( node.left().type() == StmtNode::StmtKind::background ? " "sv
+                                                                                      : "; "sv );
+          } else
+            pieces.emplace_back( ";"sv );
+          push_operand( node.left() );
+        } break;
+
+        case StmtNode::StmtKind::logical_and: [[fallthrough]];
+        case StmtNode::StmtKind::logical_or:  {
+          pieces.emplace_back( node.right() );
+          pieces.emplace_back( node.type() == StmtNode::StmtKind::logical_and ? " && "sv
+                                                                              : " || "sv );
+          push_operand( node.left() );
+        } break;
+
+        case StmtNode::StmtKind::logical_not: {
+          push_operand( node.left() );
+          pieces.emplace_back( "! "sv );
+        } break;
+
+        case StmtNode::StmtKind::pipeline: {
+          for ( const auto stage : node.siblings() | views::reverse ) {
+            push_operand( stage );
+            pieces.emplace_back( " | "sv );
+          }
+          pieces.pop_back();
+        } break;
+
+        case StmtNode::StmtKind::background: {
+          pieces.emplace_back( " &"sv );
+          push_operand( node.left() );
+        } break;
+
+        case StmtNode::StmtKind::timed: {
+          const auto format =
+            static_cast<util::Timing::Format>( ExprNode( node.siblings()[0] ).value() );
+          pieces.emplace_back( node.left() );
+          pieces.emplace_back( format == util::Timing::Format::json ? "time -j "sv : "time "sv );
+        } break;
+
+        default: {
+          auto target = node.left();
+          // `> file 2>&1` is parsed with the `>&` as the child, but it's written last.
+          if ( target && target.type() == StmtNode::StmtKind::merge_stream
+               && node.type() != StmtNode::StmtKind::merge_stream
+               && node.type() != StmtNode::StmtKind::stdin_redrct ) {
+            pieces.emplace_back( Redirect { .redr_ = target } );
+            target = target.left();
+          }
+          pieces.emplace_back( Redirect { .redr_ = node } );
+          if ( target )
+            push_operand( target );
+        } break;
+        }
+      }
+    }
+
+    /// @brief Returns the line of the job in the output of `jobs`.
+    /// @param mark `+` for the current job, `-` for the previous one, otherwise a space.
+    [[nodiscard]] type::String format_job( const util::JobTable::Job& job,
+                                           char mark,
+                                           bool with_pid )
+    {
+      type::String state;
+      switch ( job.state() ) {
+      case util::JobTable::State::running: {
+        state = "Running";
+      } break;
+      case util::JobTable::State::stopped: {
+        state = "Stopped";
+      } break;
+      case util::JobTable::State::done: {
+        state = job.status() == EXIT_SUCCESS ? "Done" : format( "Exit {}", job.status() );
+      } break;
+      }
+      return format( "[{}]{} {}{:<24}{}{}",
+                     job.id_,
+                     mark,
+                     with_pid ? format( "{} ", job.pgid_ ) : " ",
+                     state,
+                     job.command_,
+                     job.state() == util::JobTable::State::running ? " &" : "" );
+    }
+
+    /// @brief Returns the name of a statement of `kind` in a trace.
+    [[nodiscard]] type::StrView kind_name( StmtNode::StmtKind kind ) noexcept
+    {
+      switch ( kind ) {
+      case StmtNode::StmtKind::atom:           return "atom";
+      case StmtNode::StmtKind::sequential:     return "sequential";
+      case StmtNode::StmtKind::logical_and:    return "logical and";
+      case StmtNode::StmtKind::logical_or:     return "logical or";
+      case StmtNode::StmtKind::logical_not:    return "logical not";
+      case StmtNode::StmtKind::pipeline:       return "pipeline";
+      case StmtNode::StmtKind::ovrwrit_redrct: [[fallthrough]];
+      case StmtNode::StmtKind::appnd_redrct:   return "output redirection";
+      case StmtNode::StmtKind::merge_output:   [[fallthrough]];
+      case StmtNode::StmtKind::merge_appnd:    [[fallthrough]];
+      case StmtNode::StmtKind::merge_stream:   return "combined redirection";
+      case StmtNode::StmtKind::stdin_redrct:   return "input redirection";
+      case StmtNode::StmtKind::background:     return "background";
+      case StmtNode::StmtKind::timed:          return "time";
+      default:                                 return "statement";
+      }
+    }
+
+    /// @brief Returns the `i`th stage of the pipeline or background job `node`.
+    [[nodiscard]] StmtNode stage_of( StmtNode node, size_t i ) noexcept
+    {
+      if ( node.type() == StmtNode::StmtKind::background )
+        node = node.left();
+      return node.type() == StmtNode::StmtKind::pipeline ? node.siblings()[i] : node;
+    }
+
+    /// @brief Returns the mark of the job at `pos` in a table of `num_jobs` jobs.
+    [[nodiscard]] char job_mark( size_t pos, size_t num_jobs ) noexcept
+    {
+      if ( pos + 1 == num_jobs )
+        return '+';
+      return pos + 2 == num_jobs ? '-' : ' ';
+    }
+
+    /// @brief Keeps the standard output and error of a job of `parallel` in memory files, which
+    /// are written out at once when the job is done, so the outputs of the jobs never interleave.
+    /// @brief A stream is left as it is if its memory file can't be created.
+    class OutputCapture {
+      array<type::FileDesc, 2> fds_;
+
+    public:
+      // The job number of the captured job.
+      size_t id_;
+
+      explicit OutputCapture( size_t id ) noexcept : fds_ { -1, -1 }, id_ { id }
+      {
+        for ( auto& fd : fds_ )
+          fd = memfd_create( "tish-parallel", MFD_CLOEXEC );
+      }
+      OutputCapture( const OutputCapture& )            = delete;
+      OutputCapture& operator=( const OutputCapture& ) = delete;
+      OutputCapture( OutputCapture&& rhs ) noexcept
+        : fds_ { exchange( rhs.fds_, { -1, -1 } ) }, id_ { rhs.id_ }
+      {}
+      OutputCapture& operator=( OutputCapture&& rhs ) noexcept
+      {
+        swap( fds_, rhs.fds_ );
+        swap( id_, rhs.id_ );
+        return *this;
+      }
+      ~OutputCapture() noexcept
+      {
+        for ( const auto fd : fds_ ) {
+          if ( fd >= 0 )
+            close( fd );
+        }
+      }
+
+      /// @brief Redirect the streams of a spawned job.
+      void redirect( util::SpawnActions& actions ) const
+      {
+        for ( size_t i = 0; i < fds_.size(); ++i ) {
+          if ( fds_[i] >= 0 )
+            actions.rebind( fds_[i], STDOUT_FILENO + static_cast<type::FileDesc>( i ) );
+        }
+      }
+      /// @brief Redirect the streams of the current process, it's used by a forked job.
+      void redirect() const noexcept
+      {
+        for ( size_t i = 0; i < fds_.size(); ++i ) {
+          if ( fds_[i] >= 0 )
+            util::rebind_fd( fds_[i], STDOUT_FILENO + static_cast<type::FileDesc>( i ) );
+        }
+      }
+
+      /// @brief Write the captured output to the streams of the shell.
+      /// @return false on failure, and `errno` is set.
+      [[nodiscard]] bool flush() const noexcept
+      {
+        for ( size_t i = 0; i < fds_.size(); ++i ) {
+          if ( fds_[i] >= 0
+               && ( lseek( fds_[i], 0, SEEK_SET ) < 0
+                    || !util::copy_fd( fds_[i],
+                                       STDOUT_FILENO + static_cast<type::FileDesc>( i ) ) ) )
+            return false;
+        }
+        return true;
+      }
+    };
+  } // namespace details
+
+  const std::unordered_set<type::StrView> Interpreter::_built_in_cmds = { "cd",
+                                                                          "exit",
+                                                                          "help",
+                                                                          "type",
+                                                                          "exec",
+                                                                          "hash",
+                                                                          "echo",
+                                                                          "printf",
+                                                                          "true",
+                                                                          "false",
+                                                                          "pwd",
+                                                                          "test",
+                                                                          "[",
+                                                                          "cat",
+                                                                          "tee",
+                                                                          "cp",
+                                                                          "jobs",
+                                                                          "wait",
+                                                                          "fg",
+                                                                          "bg",
+                                                                          "parallel",
+                                                                          "stats" };
 
   Interpreter::Interpreter()
     : variables_ {
@@ -33,498 +597,1511 @@ namespace tish {
   }
   {}
 
-  void Interpreter::interpolate( ExprNodeT node ) const
+  void Interpreter::expand( ExprNodeT expr )
   {
-    assert( node->type() == ExprNode::StmtKind::atom );
-    if ( node->kind() == ExprNode::ExprKind::value )
-      return;
+    assert( expr.kind() != ExprNode::ExprKind::value );
+
+    words_.clear();
+    word_ends_.clear();
+    const auto render = [this]( ExprNodeT word ) {
+      assert( word.kind() != ExprNode::ExprKind::value );
+      if ( word.segments().empty() )
+        words_.append( word.token() );
+      for ( const auto& segment : word.segments() ) {
+        switch ( segment.kind_ ) {
+        case ExprNode::Segment::Kind::literal: {
+          words_.append( segment.text_ );
+        } break;
+        case ExprNode::Segment::Kind::variable: {
+          // An undefined variable is expanded to nothing.
+          if ( const auto item = variables_.find( segment.text_ ); item != variables_.cend() )
+            visit( util::Overloader(
+                     [this]( const type::String& string ) { words_.append( string ); },
+                     [this]( type::Eval value ) {
+                       array<char, numeric_limits<type::Eval>::digits10 + 2> digits;
+                       const auto [end, _] =
+                         to_chars( digits.data(), digits.data() + digits.size(), value );
+                       words_.append( digits.data(), end );
+                     } ),
+                   item->second );
+        } break;
+        case ExprNode::Segment::Kind::home_dir: {
+          words_.append( util::get_homedir() );
+        } break;
+        }
+      }
+      words_.push_back( '\0' );
+      word_ends_.push_back( words_.size() - 1 );
+    };
+
+    render( expr );
+    for ( const auto sblng : expr.siblings() ) {
+      assert( sblng.type() == StmtNode::StmtKind::atom );
+      render( ExprNode( sblng ) );
+    }
 
-    if ( node->token().front() == '$' ) {
-      if ( auto item =
-             variables_.find( type::StrView( node->token().cbegin() + 1, node->token().cend() ) );
-           item != variables_.cend() )
-        node->replace_with(
-          visit( util::Overloader( []( const type::String& string ) { return string; },
-                                   []( type::Eval value ) { return to_string( value ); } ),
-                 item->second ) );
-      else
-        node->replace_with( "" );
-    } else if ( node->kind() == ExprNode::ExprKind::command
-                && regex_search( node->token(), regex( "^~(/.*)?$" ) ) )
-      node->replace_with(
-        format( "{}{}",
-                util::get_homedir(),
-                type::StrView( node->token().begin() + 1, node->token().end() ) ) );
-    else if ( node->kind() == ExprNode::ExprKind::string )
-      node->replace_with( regex_replace( node->token(), regex( R"(\\\$)" ), "$" ) );
+    // `words_` may be reallocated while rendering, so the views are made at last.
+    argv_.clear();
+    exec_argv_.clear();
+    for ( size_t begin = 0; const auto end : word_ends_ ) {
+      argv_.emplace_back( words_.data() + begin, end - begin );
+      exec_argv_.push_back( words_.data() + begin );
+      begin = end + 1;
+    }
+    exec_argv_.push_back( nullptr );
   }
 
-  Interpreter::EvalResult Interpreter::sequential_stmt( StmtNodeT seq_stmt ) const
+  type::Eval Interpreter::report( type::String message, type::Eval status )
   {
-    assert( seq_stmt != nullptr );
-    assert( seq_stmt->left() != nullptr );
-    assert( seq_stmt->siblings().empty() == true );
-
-    auto left     = evaluate( seq_stmt->left() );
-    left.side_val = left.value;
-    if ( seq_stmt->right() != nullptr ) {
-      auto right    = evaluate( seq_stmt->right() );
-      left.side_val = make_pair( left.value, right.value );
-      left.value    = right.value;
-      ranges::move( right.message, back_inserter( left.message ) );
-    }
-    return left;
+    messages_.push_back( move( message ) );
+    return status;
   }
 
-  Interpreter::EvalResult Interpreter::logical_and( StmtNodeT and_stmt ) const
+  type::Eval Interpreter::diagnose( type::StrView message, type::Eval status )
   {
-    assert( and_stmt != nullptr );
-    assert( and_stmt->left() != nullptr && and_stmt->right() != nullptr );
-    assert( and_stmt->siblings().empty() == true );
-
-    auto left     = evaluate( and_stmt->left() );
-    left.side_val = left.value;
-    if ( left ) {
-      auto right    = evaluate( and_stmt->right() );
-      left.side_val = make_pair( left.value, right.value );
-      left.value    = left.value && right.value;
-      ranges::move( right.message, back_inserter( left.message ) );
-    }
-    return left;
+    static_cast<void>( util::write_all( STDERR_FILENO, format( "{}\n", message ) ) );
+    return status;
   }
 
-  Interpreter::EvalResult Interpreter::logical_or( StmtNodeT or_stmt ) const
+  bool Interpreter::redirection( StmtNodeT redr,
+                                 util::FdGuard& fd_guard,
+                                 util::SpawnActions& actions )
   {
-    assert( or_stmt != nullptr );
-    assert( or_stmt->left() != nullptr && or_stmt->right() != nullptr );
-    assert( or_stmt->siblings().empty() == true );
-
-    auto left     = evaluate( or_stmt->left() );
-    left.side_val = left.value;
-    if ( !left ) {
-      auto right    = evaluate( or_stmt->right() );
-      left.side_val = make_pair( left.value, right.value );
-      left.value    = left.value || right.value;
-      ranges::move( right.message, back_inserter( left.message ) );
-    }
-    return left;
+    // The outer redirections come first, as if each of them were applied to the one it wraps.
+    for ( auto node = redr; node && node.is_redirection(); node = node.left() ) {
+      bool made = false;
+      switch ( node.type() ) {
+      case StmtNode::StmtKind::appnd_redrct:   [[fallthrough]];
+      case StmtNode::StmtKind::ovrwrit_redrct: [[fallthrough]];
+      case StmtNode::StmtKind::merge_output:   [[fallthrough]];
+      case StmtNode::StmtKind::merge_appnd:    {
+        made = output_redirection( node, fd_guard, actions );
+      } break;
+      case StmtNode::StmtKind::merge_stream: {
+        made = merge_stream( node, actions );
+      } break;
+      case StmtNode::StmtKind::stdin_redrct: {
+        made = input_redirection( node, fd_guard, actions );
+      } break;
+      default: assert( false ); break;
+      }
+      if ( !made )
+        return false;
+    }
+    return true;
   }
 
-  Interpreter::EvalResult Interpreter::logical_not( StmtNodeT not_stmt ) const
+  bool Interpreter::output_redirection( StmtNodeT oup_redr,
+                                        util::FdGuard& fd_guard,
+                                        util::SpawnActions& actions )
   {
-    assert( not_stmt != nullptr );
+    assert( oup_redr );
 
-    assert( not_stmt->left() != nullptr && not_stmt->right() == nullptr );
-    assert( not_stmt->siblings().empty() == true );
+    assert( !oup_redr.right() );
+    assert( oup_redr.siblings().empty() == false );
+    assert( oup_redr.siblings().front().type() == StmtNode::StmtKind::atom );
 
-    auto ret     = evaluate( not_stmt->left() );
-    ret.side_val = ret.value;
-    ret.value    = !ret.value;
-    return ret;
-  }
-
-  Interpreter::EvalResult Interpreter::pipeline_stmt( StmtNodeT pipeline_stmt ) const
-  {
-    assert( pipeline_stmt != nullptr );
-    assert( pipeline_stmt->left() != nullptr && pipeline_stmt->right() != nullptr );
-    assert( pipeline_stmt->siblings().empty() == true );
-
-    util::Pipe pipe;
-    util::disable_blocking( pipe.reader().get() );
-
-    array<type::Eval, 2> side_value;
-    for ( size_t i = 0; i < 2; ++i ) {
-      util::ForkGuard pguard;
-      if ( pguard.is_child() ) {
-        // child process
-        if ( i == 0 ) {
-          pipe.reader().close();
-          util::rebind_fd( pipe.writer().get(), STDOUT_FILENO );
-          [[maybe_unused]] auto _ = evaluate( pipeline_stmt->left() );
-        } else {
-          pipe.writer().close();
-          util::rebind_fd( pipe.reader().get(), STDIN_FILENO );
-          [[maybe_unused]] auto _ = evaluate( pipeline_stmt->right() );
-        }
-        throw error::TerminationSignal( EXIT_FAILURE );
-      }
-      pguard.wait();
-      side_value[i] = pguard.exit_code().value();
-    }
+    // The file name follows the file descriptor, if there is one.
+    const auto filename_pos = oup_redr.type() == StmtNode::StmtKind::appnd_redrct
+                                  || oup_redr.type() == StmtNode::StmtKind::ovrwrit_redrct
+                                ? 1
+                                : 0;
+    assert( ExprNode( oup_redr.siblings()[filename_pos] ).kind() != ExprNode::ExprKind::value );
 
-    return { make_pair( side_value.front(), side_value.back() ),
-             {},
-             side_value.front() == EvalResult::success ? side_value.back() : side_value.front() };
-  }
-
-  Interpreter::EvalResult Interpreter::output_redirection( StmtNodeT oup_redr ) const
-  {
-    assert( oup_redr != nullptr );
-
-    assert( oup_redr->right() == nullptr );
-    assert( oup_redr->siblings().empty() == false );
-    assert( oup_redr->siblings().front()->type() == StmtNode::StmtKind::atom );
-
-    assert( static_cast<const ExprNode*>(
-              oup_redr
-                ->siblings()[oup_redr->type() == StmtNode::StmtKind::appnd_redrct
-                                 || oup_redr->type() == StmtNode::StmtKind::ovrwrit_redrct
-                               ? 1
-                               : 0]
-                .get() )
-              ->kind()
-            != ExprNode::ExprKind::value );
-
-    const auto& filename =
-      static_cast<const ExprNode*>(
-        oup_redr
-          ->siblings()[oup_redr->type() == StmtNode::StmtKind::appnd_redrct
-                           || oup_redr->type() == StmtNode::StmtKind::ovrwrit_redrct
-                         ? 1
-                         : 0]
-          .get() )
-        ->token();
-
-    // Check whether the file descriptor can be obtained.
-    if ( !filesystem::exists( filename ) && !util::create_file( filename ) )
-      return { .message = { util::format_error( filename ) }, .value = EvalResult::abort };
-    else if ( const auto perms = filesystem::status( filename ).permissions();
-              ( perms & filesystem::perms::owner_write )
-              == filesystem::perms::none ) // not writable
-      return { .message = { util::format_error( filename ) }, .value = EvalResult::abort };
+    const auto filename = ExprNode( oup_redr.siblings()[filename_pos] ).token();
 
     /* For `StmtNode::StmtKind::appnd_redrct` and `StmtNode::StmtKind::ovrwrit_redrct`
-     * node, the first element of `merg_redr->siblings()` is `ExprNode` of type
+     * node, the first element of `merg_redr.siblings()` is `ExprNode` of type
      * `ExprNode::ExprKind::value`, which specifies the destination file
      * descriptor. */
     type::FileDesc file_d = STDOUT_FILENO;
-    if ( oup_redr->type() == StmtNode::StmtKind::appnd_redrct
-         || oup_redr->type() == StmtNode::StmtKind::ovrwrit_redrct ) {
-      ExprNodeT arg_node = static_cast<ExprNode*>( oup_redr->siblings().front().get() );
-      assert( arg_node->kind() == ExprNode::ExprKind::value );
-      file_d = arg_node->value() == constant::invalid_value ? STDOUT_FILENO : arg_node->value();
-    }
-
-    util::ForkGuard pguard;
-    if ( pguard.is_child() ) {
-      auto target_fd = open( filename.c_str(),
-                             O_WRONLY
-                               | ( oup_redr->type() == StmtNode::StmtKind::appnd_redrct
-                                       || oup_redr->type() == StmtNode::StmtKind::merge_appnd
-                                     ? O_APPEND
-                                     : O_TRUNC ) );
-
-      util::rebind_fd( target_fd, file_d );
-      if ( oup_redr->type() == StmtNode::StmtKind::merge_output
-           || oup_redr->type() == StmtNode::StmtKind::merge_appnd ) {
-        if ( file_d != STDOUT_FILENO )
-          util::rebind_fd( target_fd, STDOUT_FILENO );
-        if ( file_d != STDERR_FILENO )
-          util::rebind_fd( target_fd, STDERR_FILENO );
-      }
-
-      if ( oup_redr->left() != nullptr ) {
-        evaluate( oup_redr->left() );
-        close( target_fd );
-        throw error::TerminationSignal( EXIT_FAILURE );
-      } else {
-        close( target_fd );
-        throw error::TerminationSignal( EXIT_SUCCESS );
-      }
+    if ( oup_redr.type() == StmtNode::StmtKind::appnd_redrct
+         || oup_redr.type() == StmtNode::StmtKind::ovrwrit_redrct ) {
+      ExprNodeT arg_node = ExprNode( oup_redr.siblings().front() );
+      assert( arg_node.kind() == ExprNode::ExprKind::value );
+      file_d = arg_node.value() == constant::invalid_value ? STDOUT_FILENO : arg_node.value();
     }
-    pguard.wait();
 
-    assert( pguard.exit_code().has_value() );
+    // The failure of `open` itself is reported, so the file isn't checked beforehand.
+    const auto target_fd = fd_guard.open(
+      filename.data(),
+      O_WRONLY | O_CREAT
+        | ( oup_redr.type() == StmtNode::StmtKind::appnd_redrct
+                || oup_redr.type() == StmtNode::StmtKind::merge_appnd
+              ? O_APPEND
+              : O_TRUNC ),
+      actions );
+    if ( target_fd < 0 ) {
+      report( util::format_error( filename ) );
+      return false;
+    }
 
-    if ( oup_redr->left() == nullptr || oup_redr->left()->type() != StmtNode::StmtKind::atom )
-      // Exists a subexpression
-      return { .side_val = pguard.exit_code().value(),
-               .message  = {},
-               .value    = pguard.exit_code().value() };
-    return { .value = pguard.exit_code().value() };
+    actions.rebind( target_fd, file_d );
+    if ( oup_redr.type() == StmtNode::StmtKind::merge_output
+         || oup_redr.type() == StmtNode::StmtKind::merge_appnd ) {
+      if ( file_d != STDOUT_FILENO )
+        actions.rebind( target_fd, STDOUT_FILENO );
+      if ( file_d != STDERR_FILENO )
+        actions.rebind( target_fd, STDERR_FILENO );
+    }
+    return true;
   }
 
-  Interpreter::EvalResult Interpreter::merge_stream( StmtNodeT merg_redr ) const
+  bool Interpreter::merge_stream( StmtNodeT merg_redr, util::SpawnActions& actions )
   {
-    assert( merg_redr != nullptr );
+    assert( merg_redr );
 
-    assert( merg_redr->left() != nullptr && merg_redr->right() == nullptr );
-    assert( merg_redr->siblings().size() == 2 );
-    assert( merg_redr->siblings()[0]->type() == StmtNode::StmtKind::atom
-            && merg_redr->siblings()[1]->type() == StmtNode::StmtKind::atom );
+    assert( !merg_redr.right() );
+    assert( merg_redr.siblings().size() == 2 );
+    assert( merg_redr.siblings()[0].type() == StmtNode::StmtKind::atom
+            && merg_redr.siblings()[1].type() == StmtNode::StmtKind::atom );
 
     /* For `StmtNode::StmtKind::merge_stream` node,
-     * the first and second elements of `merg_redr->siblings()` is `ExprNode` of
+     * the first and second elements of `merg_redr.siblings()` is `ExprNode` of
      * type `ExprNode::ExprKind::value`, which specifies the destination file descriptor. */
-    ExprNodeT arg_node1 = static_cast<ExprNode*>( merg_redr->siblings()[0].get() );
-    ExprNodeT arg_node2 = static_cast<ExprNode*>( merg_redr->siblings()[1].get() );
+    ExprNodeT arg_node1 = ExprNode( merg_redr.siblings()[0] );
+    ExprNodeT arg_node2 = ExprNode( merg_redr.siblings()[1] );
 
-    assert( arg_node1->kind() == ExprNode::ExprKind::value );
-    assert( arg_node2->kind() == ExprNode::ExprKind::value );
+    assert( arg_node1.kind() == ExprNode::ExprKind::value );
+    assert( arg_node2.kind() == ExprNode::ExprKind::value );
 
     const auto l_fd =
-      arg_node1->value() == constant::invalid_value ? STDERR_FILENO : arg_node1->value();
+      arg_node1.value() == constant::invalid_value ? STDERR_FILENO : arg_node1.value();
     const auto r_fd =
-      arg_node2->value() == constant::invalid_value ? STDOUT_FILENO : arg_node2->value();
+      arg_node2.value() == constant::invalid_value ? STDOUT_FILENO : arg_node2.value();
 
-    util::ForkGuard pguard;
-    if ( pguard.is_child() ) {
-      util::rebind_fd( r_fd, l_fd );
+    actions.rebind( r_fd, l_fd );
+    return true;
+  }
 
-      evaluate( merg_redr->left() );
-      throw error::TerminationSignal( EXIT_FAILURE );
+  bool Interpreter::input_redirection( StmtNodeT inp_redr,
+                                       util::FdGuard& fd_guard,
+                                       util::SpawnActions& actions )
+  {
+    assert( inp_redr );
+    assert( !inp_redr.right() );
+    assert( inp_redr.siblings().empty() == false );
+    assert( inp_redr.siblings().front().type() == StmtNode::StmtKind::atom );
+
+    if ( inp_redr.siblings().size() != 1 ) {
+      report(
+        error::ArgumentError( "input redirection"sv, "argument number error"sv ).message() );
+      return false;
     }
-    pguard.wait();
 
-    assert( pguard.exit_code().has_value() );
-
-    if ( merg_redr->left()->type() != StmtNode::StmtKind::atom )
-      return { .side_val = pguard.exit_code().value(),
-               .message  = {},
-               .value    = pguard.exit_code().value() };
-    return { .value = pguard.exit_code().value() };
-  }
+    const auto filename  = ExprNode( inp_redr.siblings().front() ).token();
+    const auto target_fd = fd_guard.open( filename.data(), O_RDONLY, actions );
+    if ( target_fd < 0 ) {
+      report( util::format_error( filename ) );
+      return false;
+    }
 
-  Interpreter::EvalResult Interpreter::input_redirection( StmtNodeT inp_redr ) const
-  {
-    assert( inp_redr != nullptr );
-    assert( inp_redr->left() != nullptr && inp_redr->right() == nullptr );
-    assert( inp_redr->siblings().empty() == false );
-    assert( inp_redr->siblings().front()->type() == StmtNode::StmtKind::atom );
-
-    if ( inp_redr->siblings().size() != 1 )
-      return { .message = { error::ArgumentError( "input redirection"sv, "argument number error"sv )
-                              .message() },
-               .value   = EvalResult::abort };
-
-    const auto& filename =
-      static_cast<const ExprNode*>( inp_redr->siblings().front().get() )->token();
-    if ( !filesystem::exists( filename ) ) {
-      return { .message = { util::format_error( filename ) }, .value = EvalResult::abort };
-    } else if ( const auto perms = filesystem::status( filename ).permissions();
-                ( perms & filesystem::perms::owner_read )
-                == filesystem::perms::none ) // not readable
-      return { .message = { util::format_error( filename ) }, .value = EvalResult::abort };
-
-    util::ForkGuard pguard;
-    if ( pguard.is_child() ) {
-      auto target_fd = open( filename.c_str(), O_RDONLY );
-      util::rebind_fd( target_fd, STDIN_FILENO );
-
-      evaluate( inp_redr->left() );
-
-      close( target_fd );
-      throw error::TerminationSignal( EXIT_FAILURE );
-    }
-    pguard.wait();
-    return { .value = pguard.exit_code().value() };
+    actions.rebind( target_fd, STDIN_FILENO );
+    return true;
   }
 
-  Interpreter::EvalResult Interpreter::atom( ExprNodeT expr ) const
+  type::Eval Interpreter::spawn( ExprNodeT expr, const util::SpawnActions& actions, bool replace )
   {
-    assert( expr != nullptr );
+    assert( expr );
 
-    assert( expr->left() == nullptr && expr->right() == nullptr );
-    assert( expr->type() == StmtNode::StmtKind::atom );
+    assert( !expr.left() && !expr.right() );
+    assert( expr.type() == StmtNode::StmtKind::atom );
 
-    interpolate( expr );
-    for ( auto& sblng : expr->siblings() ) {
-      assert( sblng->type() == StmtNode::StmtKind::atom );
-      interpolate( static_cast<ExprNode*>( sblng.get() ) );
-    }
+    if ( expr.kind() == ExprNode::ExprKind::value )
+      return expr.value();
 
-    if ( expr->kind() == ExprNode::ExprKind::value )
-      return { .value = expr->value() };
-    else if ( _built_in_cmds.contains( expr->token() ) )
-      return builtin_exec( expr );
-    else
-      return external_exec( expr );
+    expand( expr );
+    if ( _built_in_cmds.contains( argv_.front() ) ) {
+      util::FdGuard fd_guard;
+      fd_guard.apply( actions );
+      return builtin_exec( argv_ );
+    } else
+      return external_exec( argv_, actions, replace );
   }
 
-  Interpreter::EvalResult Interpreter::builtin_exec( ExprNodeT expr ) const
+  type::Eval Interpreter::builtin_exec( Argv argv )
   {
-    assert( expr != nullptr );
-    assert( expr->kind() != ExprNode::ExprKind::value );
+    assert( !argv.empty() );
+    util::TraceSpan span( "builtin", "evaluate" );
+    span.arg( "command", argv.front() );
+
+    const auto args = argv.subspan( 1 );
+    switch ( argv.front().front() ) {
+    case '[': { // [
+      return test_builtin( argv );
+    } break;
+
+    case 'b': { // bg
+      return bg_builtin( args );
+    } break;
 
-    EvalResult ret;
-    switch ( expr->token().front() ) {
-    case 'c': { // cd
-      if ( expr->siblings().size() > 1 )
-        return { .message = { error::ArgumentError( "cd"sv, "the number of arguments error"sv )
-                                .message() },
-                 .value   = EvalResult::abort };
+    case 'c': { // cd, cat or cp
+      if ( argv.front() == "cat" )
+        return cat_builtin( argv );
+      else if ( argv.front() == "cp" )
+        return cp_builtin( argv );
 
-      assert( static_cast<const ExprNode*>( expr->siblings().front().get() )->kind()
-              != ExprNode::ExprKind::value );
+      if ( args.size() > 1 )
+        return report(
+          error::ArgumentError( "cd"sv, "the number of arguments error"sv ).message() );
 
-      type::StrView target_dir =
-        expr->siblings().size() == 0
-          ? util::get_homedir()
-          : static_cast<const ExprNode*>( expr->siblings().front().get() )->token();
+      type::StrView target_dir = args.empty() ? util::get_homedir() : args.front();
 
       try {
         filesystem::current_path( target_dir );
       } catch ( const filesystem::filesystem_error& e ) {
-        return { .message = { util::format_error( format( "cd: {}", target_dir.data() ) ) },
-                 .value   = EvalResult::abort };
+        return report( util::format_error( format( "cd: {}", target_dir.data() ) ) );
       }
-      return { nullopt, {}, EvalResult::success };
+      return EvalResult::success;
     } break;
 
-    case 'e': { // exit or exec
-      if ( expr->token() == "exit" ) {
-        if ( !expr->siblings().empty() )
-          return { .message = { error::ArgumentError( "exit"sv, "the number of arguments error"sv )
-                                  .message() },
-                   .value   = EvalResult::abort };
+    case 'e': { // echo, exit or exec
+      if ( argv.front() == "echo" )
+        return echo_builtin( args );
+      else if ( argv.front() == "exit" ) {
+        if ( !args.empty() )
+          return report(
+            error::ArgumentError( "exit"sv, "the number of arguments error"sv ).message() );
         throw error::TerminationSignal( EXIT_SUCCESS );
-      } else if ( !expr->siblings().empty() ) {
+      } else if ( !args.empty() ) {
         /* Using `exec` with empty arguments does nothing in bash.
          * so there is not `else` branch to handle that case */
-        vector<char*> exec_argv;
-        exec_argv.reserve( expr->siblings().size() + 2 );
-        ranges::transform( expr->siblings(),
-                           back_inserter( exec_argv ),
-                           []( const auto& sblng ) -> char* {
-                             assert( sblng->type() == StmtNode::StmtKind::atom );
-                             ExprNodeT arg_node = static_cast<ExprNode*>( sblng.get() );
-                             assert( arg_node->kind() != ExprNode::ExprKind::value );
-
-                             return const_cast<char*>( arg_node->token().data() );
-                           } );
-        exec_argv.push_back( nullptr );
-
-        execvp( exec_argv.front(), exec_argv.data() );
-
-        const auto error_info = static_cast<ExprNode*>( expr->siblings().front().get() );
-        return { .message = { error::ArgumentError(
-                                "exec",
-                                format( "{}: command not found", error_info->token() ) )
-                                .message() },
-                 .value   = EvalResult::abort };
+        if ( const auto filepath = resolve( args.front() ); !filepath.empty() ) {
+          if ( util::Tracer::enabled() ) [[unlikely]]
+            util::Tracer::inst().flush();
+          // The profile ends here, even if the shell goes on because `exec` fails.
+          if ( util::Profiler::enabled() ) [[unlikely]]
+            util::Profiler::inst().finish();
+          // The metrics are written with the program counted, they're gone with the shell.
+          auto& metrics = util::Metrics::inst();
+          metrics.add( util::Metrics::Counter::execs );
+          metrics.dump();
+          execv( filepath.data(), exec_argv_.data() + 1 );
+          metrics.cancel( util::Metrics::Counter::execs );
+        }
+        util::Metrics::inst().add( util::Metrics::Counter::exec_failures );
+        return report(
+          error::ArgumentError( "exec", format( "{}: command not found", args.front() ) )
+            .message() );
       }
     } break;
 
-    case 'h': { // help
-      if ( !expr->siblings().empty() )
-        return { .message = { error::ArgumentError( "help"sv, "the number of arguments error"sv )
-                                .message() },
-                 .value   = EvalResult::abort };
-      return { .message = { type::String( util::help_doc() ) }, .value = EvalResult::success };
+    case 'h': { // help or hash
+      if ( argv.front() == "hash" )
+        return hash_builtin( args );
+
+      if ( !args.empty() )
+        return report(
+          error::ArgumentError( "help"sv, "the number of arguments error"sv ).message() );
+      return report( type::String( util::help_doc() ), EvalResult::success );
+    } break;
+
+    case 'f': { // false or fg
+      if ( argv.front() == "fg" )
+        return fg_builtin( args );
+      return !EvalResult::success;
+    } break;
+
+    case 'j': { // jobs
+      return jobs_builtin( args );
+    } break;
+
+    case 'p': { // printf, pwd or parallel
+      if ( argv.front() == "printf" )
+        return printf_builtin( args );
+      else if ( argv.front() == "parallel" )
+        return parallel_builtin( args );
+      return pwd_builtin();
     } break;
 
-    case 't': { // type
-      if ( expr->siblings().empty() )
-        return { .value = EvalResult::abort };
-
-      for ( const auto& sblng : expr->siblings() ) {
-        assert( sblng->type() == StmtNode::StmtKind::atom );
-
-        ExprNodeT arg_node = static_cast<ExprNode*>( sblng.get() );
-        assert( arg_node->kind() != ExprNode::ExprKind::value );
-
-        if ( _built_in_cmds.contains( arg_node->token() ) )
-          return { .message = { format( "{} is a builtin", arg_node->token() ) },
-                   .value   = EvalResult::success };
-        else if ( const auto filepath =
-                    util::search_filepath( util::get_envpath(), arg_node->token() );
-                  filepath.empty() )
-          return { .message = { error::ArgumentError(
-                                  "type"sv,
-                                  format( "could not find '{}'", arg_node->token() ) )
-                                  .message() },
-                   .value   = !EvalResult::success };
+    case 's': { // stats
+      return stats_builtin( args );
+    } break;
+
+    case 't': { // true, test, tee or type
+      if ( argv.front() == "true" )
+        return EvalResult::success;
+      else if ( argv.front() == "test" )
+        return test_builtin( argv );
+      else if ( argv.front() == "tee" )
+        return tee_builtin( argv );
+
+      if ( args.empty() )
+        return EvalResult::abort;
+
+      for ( const auto arg : args ) {
+        if ( _built_in_cmds.contains( arg ) )
+          return report( format( "{} is a builtin", arg ), EvalResult::success );
+        else if ( const auto filepath = resolve( arg ); filepath.empty() )
+          return report(
+            error::ArgumentError( "type"sv, format( "could not find '{}'", arg ) ).message(),
+            !EvalResult::success );
         else
-          return { .message = { format( "{} is {}", arg_node->token(), filepath ) },
-                   .value   = EvalResult::success };
+          return report( format( "{} is {}", arg, filepath ), EvalResult::success );
       }
     } break;
+
+    case 'w': { // wait
+      return wait_builtin( args );
+    } break;
     default: assert( false ); break;
     }
 
-    return { .value = EvalResult::success };
+    return EvalResult::success;
   }
 
-  Interpreter::EvalResult Interpreter::external_exec( ExprNodeT expr ) const
+  type::Eval Interpreter::external_exec( Argv argv,
+                                         const util::SpawnActions& actions,
+                                         bool replace )
   {
-    assert( expr != nullptr );
-
-    util::Pipe pipe;
-    util::disable_blocking( pipe.reader().get() );
-
-    util::ForkGuard pguard;
-    if ( pguard.is_child() ) {
-      // child process
-      vector<char*> exec_argv { const_cast<char*>( expr->token().data() ) };
-      exec_argv.reserve( expr->siblings().size() + 2 );
-      ranges::transform( expr->siblings(),
-                         back_inserter( exec_argv ),
-                         []( const auto& sblng ) -> char* {
-                           assert( sblng->type() == StmtNode::StmtKind::atom );
-                           ExprNodeT arg_node = static_cast<ExprNode*>( sblng.get() );
-                           assert( arg_node->kind() != ExprNode::ExprKind::value );
-
-                           return const_cast<char*>( arg_node->token().data() );
-                         } );
-      exec_argv.push_back( nullptr );
+    assert( !argv.empty() );
+    assert( exec_argv_.size() == argv.size() + 1 );
+    assert( !child_.has_value() );
+
+    util::TraceSpan span( "spawn", "exec" );
+    span.arg( "command", argv.front() );
+    const auto cmd      = argv.front();
+    const auto filepath = resolve( cmd );
+    if ( filepath.empty() ) {
+      util::Metrics::inst().add( util::Metrics::Counter::exec_failures );
+      return report( error::ArgumentError( cmd, "command not found" ).message() );
+    }
 
-      pguard.reset_signals();
-      execvp( exec_argv.front(), exec_argv.data() );
-
-      pipe.writer().push( true );
-      // Ensure that all scoped objects are destructed normally.
-      // In particular the object `util::Pipe` above.
-      throw error::TerminationSignal( EvalResult::abort );
-    } else {
-      pguard.wait();
-      if ( pipe.reader().pop<bool>() )
-        return {
-          .message = { error::ArgumentError( expr->token(), "command not found" ).message() },
-          .value   = pguard.exit_code().value()
+    /* Only returns on failure, the command is spawned then, so that the cached path is searched
+     * again and the error is reported as usual. */
+    if ( replace )
+      static_cast<void>( util::replace_process( filepath.data(), exec_argv_.data(), actions ) );
+
+    child_.emplace( filepath.data(), exec_argv_.data(), actions );
+    if ( !child_->launched() && child_->error() == ENOENT && filepath != cmd ) {
+      // The cached file has been removed, search it again.
+      cmd_cache_.forget( cmd );
+      if ( const auto new_path = resolve( cmd ); !new_path.empty() ) {
+        child_.reset();
+        child_.emplace( new_path.data(), exec_argv_.data(), actions );
+      }
+    }
+    if ( !child_->launched() ) {
+      const auto err_num = child_->error();
+      child_.reset();
+      if ( err_num == ENOENT )
+        return report( error::ArgumentError( cmd, "command not found" ).message() );
+      errno = err_num;
+      return report( util::format_error( cmd ) );
+    }
+    span.arg( "pid", child_->pid() );
+    return EvalResult::success;
+  }
+
+  type::Eval Interpreter::hash_builtin( Argv args )
+  {
+    if ( args.empty() ) {
+      if ( cmd_cache_.empty() ) {
+        output_.assign( "hash: hash table empty\n" );
+        return flush_output( "hash"sv, EvalResult::success );
+      }
+
+      vector<pair<type::StrView, const util::CommandCache::Entry*>> entries;
+      entries.reserve( cmd_cache_.entries().size() );
+      for ( const auto& [name, entry] : cmd_cache_.entries() )
+        entries.emplace_back( name, addressof( entry ) );
+      ranges::sort( entries );
+
+      output_.assign( "hits\tcommand\n" );
+      for ( const auto& [name, entry] : entries )
+        output_.append( format( "{:4}\t{}\n", entry->hits_, entry->path_ ) );
+      return flush_output( "hash"sv, EvalResult::success );
+    }
+
+    if ( args.front() == "-r" ) {
+      if ( args.size() != 1 )
+        return report(
+          error::ArgumentError( "hash"sv, "the number of arguments error"sv ).message() );
+      cmd_cache_.clear();
+      return EvalResult::success;
+    } else if ( args.front() == "-p" ) {
+      if ( args.size() != 3 )
+        return report( error::ArgumentError( "hash"sv, "usage: hash -p path name"sv ).message() );
+      cmd_cache_.seed( args[2], type::String( args[1] ) );
+      return EvalResult::success;
+    }
+
+    type::Eval status = EvalResult::success;
+    for ( const auto arg : args ) {
+      if ( _built_in_cmds.contains( arg ) || arg.find( '/' ) != type::StrView::npos )
+        continue;
+      if ( resolve( arg ).empty() )
+        status = report( error::ArgumentError( "hash"sv, format( "{}: not found", arg ) ).message(),
+                         !EvalResult::success );
+    }
+    return status;
+  }
+
+  type::Eval Interpreter::echo_builtin( Argv args )
+  {
+    bool newline = true;
+    bool escapes = false;
+    // Like bash, only a word made of `n`, `e` and `E` after a `-` is taken as options.
+    for ( ; !args.empty(); args = args.subspan( 1 ) ) {
+      const auto arg = args.front();
+      if ( arg.size() < 2 || arg.front() != '-'
+           || arg.find_first_not_of( "neE", 1 ) != type::StrView::npos )
+        break;
+      for ( const auto option : arg.substr( 1 ) ) {
+        if ( option == 'n' )
+          newline = false;
+        else
+          escapes = option == 'e';
+      }
+    }
+
+    output_.clear();
+    for ( size_t i = 0; i < args.size(); ++i ) {
+      if ( i > 0 )
+        output_.push_back( ' ' );
+      if ( !escapes )
+        output_.append( args[i] );
+      else if ( !details::append_unescaped( output_, args[i], details::Escapes::echo ) )
+        return flush_output( "echo"sv, EvalResult::success );
+    }
+    if ( newline )
+      output_.push_back( '\n' );
+    return flush_output( "echo"sv, EvalResult::success );
+  }
+
+  type::Eval Interpreter::printf_builtin( Argv args )
+  {
+    if ( args.empty() )
+      return diagnose( "printf: usage: printf format [arguments]", 2 );
+
+    const auto fmt = args.front();
+    args           = args.subspan( 1 );
+    output_.clear();
+
+    type::Eval status = EvalResult::success;
+    type::String spec;
+    type::String text;
+    size_t next = 0;
+    // A missing argument is taken as an empty string, or zero.
+    const auto next_arg = [&]() { return next < args.size() ? args[next++].data() : ""; };
+    // The type of the number is the one of `zero`.
+    const auto next_number = [&]( auto zero ) {
+      const auto arg             = next_arg();
+      const auto [value, number] = details::printf_number<decltype( zero )>( arg );
+      if ( !number )
+        status = diagnose( format( "printf: {}: invalid number", arg ), !EvalResult::success );
+      return value;
+    };
+
+    // The format is reused until all arguments are consumed.
+    size_t first_arg = 0;
+    do {
+      first_arg = next;
+      for ( size_t i = 0; i < fmt.size(); ++i ) {
+        if ( fmt[i] == '\\' ) {
+          i = details::unescape( output_, fmt, i, details::Escapes::format ) - 1;
+          continue;
+        } else if ( fmt[i] != '%' ) {
+          output_.push_back( fmt[i] );
+          continue;
+        } else if ( i + 1 < fmt.size() && fmt[i + 1] == '%' ) {
+          output_.push_back( fmt[++i] );
+          continue;
+        }
+
+        // Copy the flags, width and precision of the conversion, `*` takes them from arguments.
+        const auto spec_begin = i;
+        spec.assign( 1, '%' );
+        const auto copy_digits = [&]() {
+          if ( i + 1 < fmt.size() && fmt[i + 1] == '*' ) {
+            ++i;
+            spec.append( to_string( next_number( 0LL ) ) );
+          }
+          for ( ; i + 1 < fmt.size() && isdigit( static_cast<unsigned char>( fmt[i + 1] ) ); ++i )
+            spec.push_back( fmt[i + 1] );
         };
-      return { .value = pguard.exit_code().value() };
+        for ( ; i + 1 < fmt.size() && "-+ #0"sv.find( fmt[i + 1] ) != type::StrView::npos; ++i )
+          spec.push_back( fmt[i + 1] );
+        copy_digits();
+        if ( i + 1 < fmt.size() && fmt[i + 1] == '.' ) {
+          spec.push_back( fmt[++i] );
+          copy_digits();
+        }
+        // Length modifiers are ignored, the widest types are always used.
+        while ( i + 1 < fmt.size() && "hlLjzt"sv.find( fmt[i + 1] ) != type::StrView::npos )
+          ++i;
+        if ( ++i == fmt.size() ) {
+          diagnose( format( "printf: `{}': missing format character", fmt.substr( spec_begin ) ),
+                    !EvalResult::success );
+          return flush_output( "printf"sv, !EvalResult::success );
+        }
+
+        switch ( const auto conversion = fmt[i] ) {
+        case 'd': [[fallthrough]];
+        case 'i': {
+          const auto value = next_number( 0LL );
+          spec.append( "ll" ).push_back( conversion );
+          details::append_printf( output_, spec, value );
+        } break;
+        case 'o': [[fallthrough]];
+        case 'u': [[fallthrough]];
+        case 'x': [[fallthrough]];
+        case 'X': {
+          const auto value = next_number( 0LL );
+          spec.append( "ll" ).push_back( conversion );
+          details::append_printf( output_, spec, static_cast<unsigned long long>( value ) );
+        } break;
+        case 'e': [[fallthrough]];
+        case 'E': [[fallthrough]];
+        case 'f': [[fallthrough]];
+        case 'F': [[fallthrough]];
+        case 'g': [[fallthrough]];
+        case 'G': [[fallthrough]];
+        case 'a': [[fallthrough]];
+        case 'A': {
+          const auto value = next_number( 0.0L );
+          spec.append( "L" ).push_back( conversion );
+          details::append_printf( output_, spec, value );
+        } break;
+        case 'c': {
+          const type::StrView arg = next_arg();
+          text.assign( arg.substr( 0, 1 ) );
+          details::append_printf( output_, spec.append( "s" ), text.c_str() );
+        } break;
+        case 's': {
+          details::append_printf( output_, spec.append( "s" ), next_arg() );
+        } break;
+        case 'b': {
+          text.clear();
+          const bool ended =
+            !details::append_unescaped( text, next_arg(), details::Escapes::argument );
+          details::append_printf( output_, spec.append( "s" ), text.c_str() );
+          if ( ended )
+            return flush_output( "printf"sv, status );
+        } break;
+        default: {
+          diagnose( format( "printf: `{}': invalid format character", conversion ),
+                    !EvalResult::success );
+          return flush_output( "printf"sv, !EvalResult::success );
+        }
+        }
+      }
+    } while ( next < args.size() && next > first_arg );
+
+    return flush_output( "printf"sv, status );
+  }
+
+  type::Eval Interpreter::pwd_builtin()
+  {
+    error_code ec;
+    const auto path = filesystem::current_path( ec );
+    if ( ec ) {
+      errno = ec.value();
+      return report( util::format_error( "pwd" ), !EvalResult::success );
     }
+
+    output_.assign( path.native() ).push_back( '\n' );
+    return flush_output( "pwd"sv, EvalResult::success );
   }
 
-  Interpreter::EvalResult Interpreter::evaluate( StmtNodeT stmt_node ) const
+  type::Eval Interpreter::test_builtin( Argv argv )
   {
-    if ( stmt_node == nullptr )
-      throw error::ArgumentError( "interpreter", "syntax tree node is null" );
+    const auto name = argv.front();
+    auto args       = argv.subspan( 1 );
+    if ( name == "[" ) {
+      if ( args.empty() || args.back() != "]" )
+        return diagnose( "[: missing `]'", 2 );
+      args = args.first( args.size() - 1 );
+    }
+    // Unlike a false expression, a malformed one fails with 2.
+    const auto syntax_error = [this, name]( type::StrView message ) {
+      return diagnose( format( "{}: {}", name, message ), 2 );
+    };
+    if ( args.empty() )
+      return !EvalResult::success;
+
+    /* The expression is an `-o` list of `-a` lists of primaries, each of them may be negated by
+     * `!` or be a parenthesized expression. `any` is the result of the finished `-a` lists of the
+     * innermost parentheses, and `all` is the result of the current one. */
+    struct Group {
+      bool any_, all_, negated_;
+    };
+    vector<Group> groups;
+    bool any     = false;
+    bool all     = true;
+    bool negated = false;
+    for ( size_t i = 0;; ) {
+      if ( i == args.size() )
+        return syntax_error( "argument expected" );
+
+      // A binary primary is preferred, so `[ ! = x ]` compares `!` with `x`.
+      bool result = false;
+      if ( i + 2 < args.size() && details::is_binary_test( args[i + 1] ) ) {
+        const auto compared = details::binary_test( args[i], args[i + 1], args[i + 2] );
+        if ( !compared ) {
+          const auto operand = details::test_integer( args[i] ) ? args[i + 2] : args[i];
+          return syntax_error( format( "{}: integer expression expected", operand ) );
+        }
+        result = *compared;
+        i += 3;
+      } else if ( i + 1 < args.size() && args[i] == "!" ) {
+        negated = !negated;
+        ++i;
+        continue;
+      } else if ( i + 1 < args.size() && args[i] == "(" ) {
+        groups.push_back( { .any_ = any, .all_ = all, .negated_ = negated } );
+        any     = false;
+        all     = true;
+        negated = false;
+        ++i;
+        continue;
+      } else if ( i + 1 < args.size() && details::is_unary_test( args[i] ) ) {
+        result = details::unary_test( args[i].back(), args[i + 1].data() );
+        i += 2;
+      } else
+        result = !args[i++].empty();
+      all     = all && result != negated;
+      negated = false;
+
+      // The primary is followed by a connector, a `)`, or the end of the expression.
+      for ( ;; ++i ) {
+        if ( i == args.size() ) {
+          if ( !groups.empty() )
+            return syntax_error( "`)' expected" );
+          return any || all ? EvalResult::success : !EvalResult::success;
+        } else if ( args[i] == ")" && !groups.empty() ) {
+          const auto group = groups.back();
+          groups.pop_back();
+          const bool value = ( any || all ) != group.negated_;
+          any              = group.any_;
+          all              = group.all_ && value;
+          continue;
+        } else if ( args[i] == "-o" ) {
+          any = any || all;
+          all = true;
+        } else if ( args[i] != "-a" )
+          return syntax_error( format( "{}: unexpected argument", args[i] ) );
+        ++i;
+        break;
+      }
+    }
+  }
 
-    switch ( stmt_node->type() ) {
-    case StmtNode::StmtKind::sequential: {
-      return sequential_stmt( stmt_node );
+  type::Eval Interpreter::cat_builtin( Argv argv )
+  {
+    // `-u` is the only option of POSIX `cat`, and the output is never buffered anyway.
+    auto files = argv.subspan( 1 );
+    while ( !files.empty() && files.front() == "-u" )
+      files = files.subspan( 1 );
+    const bool has_options = ranges::any_of( files, []( type::StrView file ) {
+      return file.size() > 1 && file.front() == '-';
+    } );
+    const bool reads_stdin = files.empty() || ranges::find( files, "-" ) != files.end();
+    if ( has_options || ( reads_stdin && isatty( STDIN_FILENO ) ) )
+      return external_exec( argv, util::SpawnActions(), false );
+
+    struct stat out_stat;
+    const bool out_regular = fstat( STDOUT_FILENO, &out_stat ) == 0 && S_ISREG( out_stat.st_mode );
+
+    type::Eval status  = EvalResult::success;
+    const auto copy_to = [&]( type::FileDesc in_fd, type::StrView name ) {
+      // Appending a file to itself would never reach its end.
+      if ( struct stat in_stat; out_regular && fstat( in_fd, &in_stat ) == 0
+                                && in_stat.st_dev == out_stat.st_dev
+                                && in_stat.st_ino == out_stat.st_ino ) {
+        status = diagnose( format( "cat: {}: input file is output file", name ),
+                           !EvalResult::success );
+        return;
+      }
+      if ( !util::copy_fd( in_fd, STDOUT_FILENO ) )
+        status = diagnose( util::format_error( format( "cat: {}", name ) ), !EvalResult::success );
+    };
+
+    if ( files.empty() )
+      copy_to( STDIN_FILENO, "-" );
+    for ( const auto file : files ) {
+      if ( file == "-" ) {
+        copy_to( STDIN_FILENO, file );
+        continue;
+      }
+      util::FdGuard fd_guard;
+      if ( const auto in_fd = fd_guard.open( file.data(), O_RDONLY ); in_fd >= 0 )
+        copy_to( in_fd, file );
+      else
+        status = diagnose( util::format_error( format( "cat: {}", file ) ), !EvalResult::success );
     }
-    case StmtNode::StmtKind::logical_and: {
-      return logical_and( stmt_node );
+    return status;
+  }
+
+  type::Eval Interpreter::tee_builtin( Argv argv )
+  {
+    auto files             = argv.subspan( 1 );
+    const bool apnd        = !files.empty() && files.front() == "-a";
+    files                  = files.subspan( apnd ? 1 : 0 );
+    const bool has_options = ranges::any_of( files, []( type::StrView file ) {
+      return file.size() > 1 && file.front() == '-';
+    } );
+    if ( has_options || isatty( STDIN_FILENO ) )
+      return external_exec( argv, util::SpawnActions(), false );
+
+    type::Eval status = EvalResult::success;
+    util::FdGuard fd_guard;
+    vector<type::FileDesc> out_fds { STDOUT_FILENO };
+    for ( const auto file : files ) {
+      if ( const auto out_fd =
+             fd_guard.open( file.data(), O_WRONLY | O_CREAT | ( apnd ? O_APPEND : O_TRUNC ) );
+           out_fd >= 0 )
+        out_fds.push_back( out_fd );
+      else
+        status = diagnose( util::format_error( format( "tee: {}", file ) ), !EvalResult::success );
     }
-    case StmtNode::StmtKind::logical_or: {
-      return logical_or( stmt_node );
+
+    if ( !util::tee_fd( STDIN_FILENO, out_fds ) )
+      status = diagnose( util::format_error( "tee" ), !EvalResult::success );
+    return status;
+  }
+
+  type::Eval Interpreter::cp_builtin( Argv argv )
+  {
+    const auto args = argv.subspan( 1 );
+    if ( ranges::any_of( args, []( type::StrView arg ) { return arg.starts_with( '-' ); } ) )
+      return external_exec( argv, util::SpawnActions(), false );
+    if ( args.size() < 2 )
+      return diagnose( "cp: missing file operand", !EvalResult::success );
+
+    const auto sources = args.first( args.size() - 1 );
+    const auto target  = args.back();
+    struct stat target_stat;
+    const bool into_dir =
+      stat( target.data(), &target_stat ) == 0 && S_ISDIR( target_stat.st_mode );
+    if ( sources.size() > 1 && !into_dir )
+      return diagnose( format( "cp: target '{}' is not a directory", target ),
+                       !EvalResult::success );
+
+    type::Eval status = EvalResult::success;
+    type::String path;
+    for ( const auto source : sources ) {
+      util::FdGuard fd_guard;
+      struct stat source_stat;
+      const auto in_fd = fd_guard.open( source.data(), O_RDONLY );
+      if ( in_fd < 0 || fstat( in_fd, &source_stat ) < 0 ) {
+        status = diagnose( util::format_error( format( "cp: {}", source ) ), !EvalResult::success );
+        continue;
+      } else if ( S_ISDIR( source_stat.st_mode ) ) {
+        status = diagnose( format( "cp: -r not specified; omitting directory '{}'", source ),
+                           !EvalResult::success );
+        continue;
+      }
+
+      path.assign( target );
+      if ( into_dir ) {
+        const auto name = source.substr( 0, source.find_last_not_of( '/' ) + 1 );
+        path.append( "/" ).append( name.substr( name.find_last_of( '/' ) + 1 ) );
+      }
+      if ( struct stat dest_stat; stat( path.c_str(), &dest_stat ) == 0
+                                  && dest_stat.st_dev == source_stat.st_dev
+                                  && dest_stat.st_ino == source_stat.st_ino ) {
+        status = diagnose( format( "cp: '{}' and '{}' are the same file", source, path ),
+                           !EvalResult::success );
+        continue;
+      }
+
+      // Like `cp` without `-p`, a new file takes the permissions of the source.
+      const auto out_fd =
+        open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, source_stat.st_mode & 0777 );
+      const bool copied  = out_fd >= 0 && util::copy_fd( in_fd, out_fd );
+      const auto err_num = errno;
+      if ( out_fd >= 0 )
+        close( out_fd );
+      if ( !copied ) {
+        errno  = err_num;
+        status = diagnose( util::format_error( format( "cp: {}", path ) ), !EvalResult::success );
+      }
     }
-    case StmtNode::StmtKind::logical_not: {
-      return logical_not( stmt_node );
+    return status;
+  }
+
+  type::Eval Interpreter::jobs_builtin( Argv args )
+  {
+    bool with_pid = false, only_pid = false;
+    for ( const auto arg : args ) {
+      if ( arg == "-l" )
+        with_pid = true;
+      else if ( arg == "-p" )
+        only_pid = true;
+      else
+        return diagnose( "jobs: usage: jobs [-l | -p]", 2 );
     }
-    case StmtNode::StmtKind::pipeline: {
-      return pipeline_stmt( stmt_node );
+
+    jobs_.refresh();
+    output_.clear();
+    const auto jobs = jobs_.jobs();
+    for ( size_t i = 0; i < jobs.size(); ++i ) {
+      if ( only_pid )
+        output_.append( format( "{}\n", jobs[i].pgid_ ) );
+      else
+        output_
+          .append(
+            details::format_job( jobs[i], details::job_mark( i, jobs.size() ), with_pid ) )
+          .push_back( '\n' );
     }
-    case StmtNode::StmtKind::appnd_redrct:   [[fallthrough]];
-    case StmtNode::StmtKind::ovrwrit_redrct: [[fallthrough]];
-    case StmtNode::StmtKind::merge_output:   [[fallthrough]];
-    case StmtNode::StmtKind::merge_appnd:    {
-      return output_redirection( stmt_node );
+    // Like a notification, a job which is listed as done is forgotten.
+    jobs_.remove_done();
+    return flush_output( "jobs"sv, EvalResult::success );
+  }
+
+  type::Eval Interpreter::wait_builtin( Argv args )
+  {
+    constexpr type::Eval interrupted = 128 + SIGINT;
+
+    if ( !args.empty() && args.front() == "-n" ) {
+      if ( args.size() > 1 )
+        return diagnose( "wait: usage: wait [-n] [id ...]", 2 );
+      // A job which finished before this statement is already forgotten, but not waited yet.
+      if ( const auto status = jobs_.take_unwaited(); status.has_value() )
+        return *status;
+      if ( jobs_.empty() )
+        return EvalResult::abort;
+      const auto done = jobs_.wait_any();
+      if ( !done.has_value() )
+        return interrupted;
+      const auto& job   = jobs_.jobs()[*done];
+      const auto status = job.status();
+      jobs_.remove( job );
+      return status;
     }
-    case StmtNode::StmtKind::merge_stream: {
-      return merge_stream( stmt_node );
+
+    if ( args.empty() ) {
+      for ( auto& job : jobs_.jobs() ) {
+        if ( !jobs_.wait( job ) )
+          return interrupted;
+      }
+      jobs_.remove_done();
+      return EvalResult::success;
     }
-    case StmtNode::StmtKind::stdin_redrct: {
-      return input_redirection( stmt_node );
+
+    type::Eval status = EvalResult::success;
+    for ( const auto arg : args ) {
+      util::JobTable::Pid pid = -1;
+      if ( !arg.starts_with( '%' ) ) {
+        if ( const auto [ptr, ec] = from_chars( arg.data(), arg.data() + arg.size(), pid );
+             ec != errc {} || ptr != arg.data() + arg.size() || pid <= 0 ) {
+          status = diagnose( format( "wait: `{}': not a pid or valid job spec", arg ), 2 );
+          continue;
+        }
+      }
+
+      auto* const job = jobs_.find( arg );
+      if ( job == nullptr ) {
+        // A job which is done may be forgotten already, but the status of its processes is kept.
+        if ( const auto finished = pid > 0 ? jobs_.take_finished( pid ) : nullopt;
+             finished.has_value() )
+          status = *finished;
+        else if ( pid > 0 )
+          status = diagnose( format( "wait: pid {} is not a child of this shell", pid ),
+                             EvalResult::abort );
+        else
+          status = diagnose( format( "wait: {}: no such job", arg ), EvalResult::abort );
+        continue;
+      }
+
+      if ( !jobs_.wait( *job ) )
+        return interrupted;
+      status = job->status();
+      if ( const auto process =
+             ranges::find( job->processes_, pid, &util::JobTable::Process::pid_ );
+           process != job->processes_.cend() )
+        status = process->status_.value();
+      jobs_.remove( *job );
     }
-    case StmtNode::StmtKind::atom: {
-      return atom( static_cast<ExprNode*>( stmt_node ) );
+    return status;
+  }
+
+  type::Eval Interpreter::fg_builtin( Argv args )
+  {
+    if ( args.size() > 1 )
+      return diagnose( error::ArgumentError( "fg"sv, "the number of arguments error"sv ).message(),
+                       EvalResult::abort );
+
+    jobs_.refresh();
+    auto* const job = jobs_.find( args.empty() ? "%+"sv : args.front() );
+    if ( job == nullptr )
+      return diagnose( format( "fg: {}: no such job", args.empty() ? "current"sv : args.front() ),
+                       !EvalResult::success );
+    if ( job->state() == util::JobTable::State::done )
+      return diagnose( format( "fg: job {} has terminated", job->id_ ), !EvalResult::success );
+
+    // Like bash, the command of the job is printed before it takes the terminal.
+    output_.assign( job->command_ ).push_back( '\n' );
+    static_cast<void>( flush_output( "fg"sv, EvalResult::success ) );
+
+    jobs_.foreground( *job );
+    if ( job->state() == util::JobTable::State::stopped )
+      return report( details::format_job( *job, '+', false ), 128 + SIGTSTP );
+    const auto status = job->status();
+    jobs_.remove( *job );
+    return status;
+  }
+
+  type::Eval Interpreter::bg_builtin( Argv args )
+  {
+    if ( args.size() > 1 )
+      return diagnose( error::ArgumentError( "bg"sv, "the number of arguments error"sv ).message(),
+                       EvalResult::abort );
+
+    jobs_.refresh();
+    auto* const job = jobs_.find( args.empty() ? "%+"sv : args.front() );
+    if ( job == nullptr )
+      return diagnose( format( "bg: {}: no such job", args.empty() ? "current"sv : args.front() ),
+                       !EvalResult::success );
+    if ( job->state() == util::JobTable::State::done )
+      return diagnose( format( "bg: job {} has terminated", job->id_ ), !EvalResult::success );
+    else if ( job->state() == util::JobTable::State::running )
+      return diagnose( format( "bg: job {} already in background", job->id_ ),
+                       EvalResult::success );
+
+    jobs_.resume( *job );
+    output_ = format( "[{}] {} &\n", job->id_, job->command_ );
+    return flush_output( "bg"sv, EvalResult::success );
+  }
+
+  type::Eval Interpreter::parallel_builtin( Argv args )
+  {
+    constexpr auto usage = "parallel: usage: parallel [-j jobs] [-f] [command ...]"sv;
+
+    size_t max_jobs = 0;
+    bool fail_fast  = false;
+    while ( !args.empty() && args.front().size() > 1 && args.front().front() == '-' ) {
+      const auto option = args.front();
+      args              = args.subspan( 1 );
+      if ( option == "--" )
+        break;
+      else if ( option == "-f" )
+        fail_fast = true;
+      else if ( option.starts_with( "-j" ) ) {
+        auto value = option.substr( 2 );
+        if ( value.empty() && !args.empty() ) {
+          value = args.front();
+          args  = args.subspan( 1 );
+        }
+        if ( const auto [ptr, ec] =
+               from_chars( value.data(), value.data() + value.size(), max_jobs );
+             value.empty() || ec != errc {} || ptr != value.data() + value.size()
+             || max_jobs == 0 )
+          return diagnose( usage, 2 );
+      } else
+        return diagnose( usage, 2 );
     }
-    default: assert( false ); break;
+    if ( max_jobs == 0 )
+      max_jobs = static_cast<size_t>( max( sysconf( _SC_NPROCESSORS_ONLN ), 1L ) );
+
+    // The arguments are overwritten once a job is expanded, so the commands are copied first.
+    vector<type::String> scripts;
+    if ( !args.empty() )
+      scripts.assign( args.begin(), args.end() );
+    else {
+      // Like `xargs`, each line of the input is a command.
+      util::BlockSource input( STDIN_FILENO );
+      for ( auto line = input.getline(); !line.text_.empty() || line.complete_;
+            line      = input.getline() ) {
+        if ( !line.text_.empty() )
+          scripts.emplace_back( line.text_ );
+      }
+    }
+
+    /* All jobs are watched by a single table, so the next finished one is found by one `poll` no
+     * matter how many are running, instead of blocking on each of them in turn. */
+    util::JobTable running;
+    vector<details::OutputCapture> captures;
+    optional<type::Eval> failure;
+    bool stopped = false;
+
+    const auto terminate_all = [&]() {
+      stopped = true;
+      for ( const auto& job : running.jobs() ) {
+        for ( const auto& process : job.processes_ ) {
+          if ( !process.status_.has_value() )
+            kill( process.pid_, SIGTERM );
+        }
+      }
+    };
+    // Like a pipeline, the status is the one of the first job which failed.
+    const auto finish = [&]( type::Eval job_status ) {
+      if ( job_status == EvalResult::success || failure.has_value() )
+        return;
+      failure = job_status;
+      if ( fail_fast )
+        terminate_all();
+    };
+
+    const auto launch = [&]( type::String script ) {
+      // Like a script of `-c`, the command ends with a newline, which the diagnostics rely on.
+      script.push_back( '\n' );
+      Parser parser( LineBuffer( make_unique<util::StringSource>( move( script ) ) ) );
+      SyntaxTree tree;
+      try {
+        parser.parse( tree );
+      } catch ( const error::TraceBack& e ) {
+        return finish( diagnose( format( "parallel: {}", e.message() ), 2 ) );
+      }
+      if ( !tree.root() && ( parser.exhausted() || parser.empty() ) )
+        return;
+
+      auto& job = running.add( 0, {} );
+      details::OutputCapture capture( job.id_ );
+      // A single external command is spawned directly, which is much cheaper than forking.
+      if ( tree.root() && parser.exhausted()
+           && tree.root().type() == StmtNode::StmtKind::atom
+           && ExprNode( tree.root() ).kind() != ExprNode::ExprKind::value ) {
+        expand( ExprNode( tree.root() ) );
+        if ( !_built_in_cmds.contains( argv_.front() ) ) {
+          util::SpawnActions actions;
+          capture.redirect( actions );
+          const auto status = external_exec( argv_, actions, false );
+          if ( !child_.has_value() ) {
+            running.remove( job );
+            return finish( status );
+          }
+          job.pgid_ = child_->pid();
+          job.processes_.push_back( running.watch( child_->pid() ) );
+          child_.reset();
+          captures.push_back( move( capture ) );
+          return;
+        }
+      }
+
+      util::ForkGuard pguard( false );
+      if ( pguard.is_parent() ) {
+        job.pgid_ = pguard.pid();
+        job.processes_.push_back( running.watch( pguard.pid() ) );
+        captures.push_back( move( capture ) );
+        return;
+      }
+
+      // child process, it runs the whole command as a script and never returns
+      pguard.reset_signals();
+      jobs_.clear();
+      running.clear();
+      capture.redirect();
+      type::Eval status = EvalResult::success;
+      try {
+        while ( true ) {
+          if ( tree.root() ) {
+            const auto result = evaluate( tree, parser.exhausted() );
+            // The messages are part of the output of the job.
+            for ( const auto& message : result.message )
+              static_cast<void>(
+                util::write_all( STDERR_FILENO, format( "tish: {}\n", message ) ) );
+            status = result.value;
+          }
+          if ( parser.exhausted() || parser.empty() )
+            break;
+          parser.parse( tree );
+        }
+      } catch ( const error::TerminationSignal& ) {
+        throw;
+      } catch ( const error::TraceBack& e ) {
+        static_cast<void>( util::write_all( STDERR_FILENO, format( "tish: {}\n", e.message() ) ) );
+        status = 2;
+      }
+      throw error::TerminationSignal( status );
+    };
+
+    for ( size_t next = 0; next < scripts.size() || !running.empty(); ) {
+      while ( !stopped && next < scripts.size() && running.jobs().size() < max_jobs )
+        launch( move( scripts[next++] ) );
+      if ( running.empty() ) {
+        if ( stopped )
+          break;
+        continue;
+      }
+
+      const auto done = running.wait_any();
+      if ( !done.has_value() ) {
+        // Interrupted, the running jobs are stopped and still waited, so none is left behind.
+        failure = 128 + SIGINT;
+        terminate_all();
+        continue;
+      }
+      const auto& job    = running.jobs()[*done];
+      const auto capture = ranges::find( captures, job.id_, &details::OutputCapture::id_ );
+      assert( capture != captures.end() );
+      if ( !capture->flush() )
+        finish( diagnose( util::format_error( "parallel: write error" ), !EvalResult::success ) );
+      captures.erase( capture );
+      finish( job.status() );
+      running.remove( job );
+    }
+    return failure.value_or( EvalResult::success );
+  }
+
+  type::Eval Interpreter::stats_builtin( Argv args )
+  {
+    if ( args.size() > 1 || ( args.size() == 1 && args.front() != "-p" ) )
+      return report( "stats: usage: stats [-p]", 2 );
+
+    const auto& metrics = util::Metrics::inst();
+    output_             = args.empty() ? metrics.table() : metrics.exposition();
+    return flush_output( "stats"sv, EvalResult::success );
+  }
+
+  void Interpreter::notify_jobs()
+  {
+    if ( jobs_.empty() )
+      return;
+    jobs_.reap();
+    const auto jobs = jobs_.jobs();
+    for ( size_t i = 0; i < jobs.size(); ++i ) {
+      if ( jobs[i].state() == util::JobTable::State::done )
+        report( details::format_job( jobs[i], details::job_mark( i, jobs.size() ), false ),
+                EvalResult::success );
+    }
+    jobs_.remove_done();
+  }
+
+  type::Eval Interpreter::flush_output( type::StrView name, type::Eval status )
+  {
+    if ( util::write_all( STDOUT_FILENO, output_ ) ) {
+      util::Metrics::inst().add( util::Metrics::Counter::output_bytes, output_.size() );
+      return status;
+    }
+    return report( util::format_error( format( "{}: write error", name ) ), !EvalResult::success );
+  }
+
+  type::StrView Interpreter::resolve( type::StrView name )
+  {
+    util::TraceSpan span( "resolve", "exec" );
+    span.arg( "command", name );
+    // Like `execvp`, names with a slash are not searched in `PATH`.
+    if ( name.find( '/' ) != type::StrView::npos )
+      return name;
+    return cmd_cache_.find( name );
+  }
+
+  Interpreter::EvalResult Interpreter::execute( bool last )
+  {
+    struct Redirection {
+      util::FdGuard fd_guard_;
+      util::SpawnActions actions_;
+      // The actions are handed to the next spawned command instead of the shell.
+      bool bound_ = false;
+    };
+    struct Pipeline {
+      vector<util::Pipe> pipes_;
+      // A stage is a forked shell, a spawned command, or the status of a command failed to start.
+      vector<variant<util::ForkGuard, util::SpawnGuard, type::Eval>> stages_;
+      // Only the first forked stage blocks the signals, its destructor restores them for the whole
+      // group.
+      bool forked_ = false;
+      // The stages of a background job are put in a process group of their own, it's led by the
+      // first started stage.
+      bool background_          = false;
+      util::JobTable::Pid pgid_ = 0;
+      // When the pipeline is created, only if it's traced or profiled.
+      util::Tracer::Clock::time_point created_ {};
+    };
+    // If an exception is thrown, the shell is restored while they're released.
+    vector<Redirection> redirections;
+    vector<Pipeline> pipelines;
+    // The statements being measured by `time`, the innermost one is the last.
+    vector<util::Timing> timings;
+    const util::SpawnActions no_actions;
+    // When the command started by the last `spawn` was started, only if it's profiled.
+    util::Profiler::Clock::time_point spawned {};
+    // Record the waited child of `node` in the innermost measurement.
+    const auto record = [&timings]( StmtNode node, const auto& guard, type::Eval child_status ) {
+      type::String command;
+      details::describe( node, command );
+      timings.back().record( guard.pid(), child_status, move( command ), guard.usage() );
+    };
+
+    messages_.clear();
+    child_.reset();
+    notify_jobs();
+
+    EvalResult ret { .value = EvalResult::success };
+    type::Eval status      = EvalResult::success;
+    type::Eval left_status = EvalResult::success;
+
+    auto& tree       = program_.tree();
+    const auto code  = program_.code();
+    for ( Program::Index pc = 0; pc < code.size(); ) {
+      const auto& instr = code[pc++];
+      switch ( instr.op_ ) {
+      case Program::OpCode::spawn: {
+        const auto expr = ExprNode( tree[instr.node_] );
+        // An empty statement is not a command to charge.
+        const bool profiled =
+          util::Profiler::enabled() && expr.kind() != ExprNode::ExprKind::value;
+        if ( profiled ) [[unlikely]]
+          spawned = util::Profiler::Clock::now();
+        status = spawn( expr,
+                        !redirections.empty() && redirections.back().bound_
+                          ? redirections.back().actions_
+                          : no_actions,
+                        // A traced or profiled shell outlives the command to record its wait.
+                        !util::Tracer::enabled() && !util::Profiler::enabled()
+                          && details::in_tail_position( code.subspan( pc ), last ) );
+        if ( profiled ) [[unlikely]] {
+          // An external command is charged once it's waited.
+          if ( child_.has_value() )
+            util::Profiler::inst().start( expr.line(), true );
+          else
+            util::Profiler::inst().run( expr.line(), util::Profiler::Clock::now() - spawned );
+        }
+      } break;
+
+      case Program::OpCode::wait: {
+        if ( child_.has_value() ) {
+          util::TraceSpan span( "wait", "wait" );
+          span.arg( "pid", child_->pid() );
+          child_->wait();
+          status = child_->exit_code().value();
+          if ( !timings.empty() )
+            record( tree[instr.node_], *child_, status );
+          if ( util::Profiler::enabled() ) [[unlikely]] {
+            auto& profiler = util::Profiler::inst();
+            profiler.run( tree[instr.node_].line(), util::Profiler::Clock::now() - spawned );
+            profiler.child( tree[instr.node_].line(), child_->usage() );
+          }
+          child_.reset();
+        }
+      } break;
+
+      case Program::OpCode::wire: [[fallthrough]];
+      case Program::OpCode::bind: {
+        util::TraceSpan span( "redirect", "evaluate" );
+        auto& redr = redirections.emplace_back();
+        if ( !redirection( tree[instr.node_], redr.fd_guard_, redr.actions_ ) ) {
+          redirections.pop_back();
+          status = EvalResult::abort;
+          pc     = instr.operand_;
+          break;
+        }
+        if ( instr.op_ == Program::OpCode::wire )
+          redr.fd_guard_.apply( redr.actions_ );
+        else
+          redr.bound_ = true;
+        status = EvalResult::success;
+      } break;
+
+      case Program::OpCode::restore: {
+        assert( !redirections.empty() );
+        redirections.pop_back();
+      } break;
+
+      case Program::OpCode::jump_if_fail: {
+        if ( status != EvalResult::success )
+          pc = instr.operand_;
+      } break;
+
+      case Program::OpCode::jump_if_ok: {
+        if ( status == EvalResult::success )
+          pc = instr.operand_;
+      } break;
+
+      case Program::OpCode::negate: {
+        status = !status;
+      } break;
+
+      case Program::OpCode::pipeline: {
+        const auto node       = tree[instr.node_];
+        const bool background = node.type() == StmtNode::StmtKind::background;
+        const auto stages     = background ? node.left() : node;
+        const auto num_stages =
+          stages.type() == StmtNode::StmtKind::pipeline ? stages.siblings().size() : 1;
+        // All pipes are created up front, so every stage can be started before any of them is
+        // waited.
+        auto& pipeline       = pipelines.emplace_back();
+        pipeline.background_ = background;
+        pipeline.pipes_      = vector<util::Pipe>( num_stages - 1 );
+        pipeline.stages_.reserve( num_stages );
+        if ( util::Tracer::enabled() || util::Profiler::enabled() ) [[unlikely]]
+          pipeline.created_ = util::Tracer::Clock::now();
+      } break;
+
+      case Program::OpCode::launch: {
+        assert( !pipelines.empty() );
+        const auto expr = ExprNode( tree[instr.node_] );
+        if ( expr.kind() == ExprNode::ExprKind::value )
+          break;
+        expand( expr );
+        // A builtin runs in a forked stage, which is the next instruction.
+        if ( _built_in_cmds.contains( argv_.front() ) )
+          break;
+
+        auto& pipeline = pipelines.back();
+        const auto i   = pipeline.stages_.size();
+        util::SpawnActions actions;
+        if ( i > 0 )
+          actions.rebind( pipeline.pipes_[i - 1].reader().get(), STDIN_FILENO );
+        if ( i < pipeline.pipes_.size() )
+          actions.rebind( pipeline.pipes_[i].writer().get(), STDOUT_FILENO );
+        if ( pipeline.background_ )
+          actions.group( pipeline.pgid_ );
+
+        // The external command is the whole stage, so it's spawned without forking the shell.
+        if ( const auto stage_status = external_exec( argv_, actions, false );
+             child_.has_value() ) {
+          if ( pipeline.pgid_ == 0 )
+            pipeline.pgid_ = child_->pid();
+          if ( util::Profiler::enabled() ) [[unlikely]]
+            util::Profiler::inst().start( expr.line(), true );
+          pipeline.stages_.emplace_back( in_place_type<util::SpawnGuard>, move( *child_ ) );
+          child_.reset();
+        } else
+          pipeline.stages_.emplace_back( in_place_type<type::Eval>, stage_status );
+        pc = instr.operand_;
+      } break;
+
+      case Program::OpCode::stage: {
+        assert( !pipelines.empty() );
+        auto& pipeline = pipelines.back();
+        const auto i   = pipeline.stages_.size();
+        auto& pguard   = get<util::ForkGuard>( pipeline.stages_.emplace_back(
+          in_place_type<util::ForkGuard>, !pipeline.forked_ && !pipeline.background_ ) );
+        pipeline.forked_ = true;
+        if ( pipeline.background_ ) {
+          // Both processes set the group, so it's made before either of them goes on.
+          setpgid( pguard.is_parent() ? pguard.pid() : 0, pipeline.pgid_ );
+          if ( pguard.is_parent() && pipeline.pgid_ == 0 )
+            pipeline.pgid_ = pguard.pid();
+        }
+        if ( pguard.is_parent() ) {
+          if ( util::Profiler::enabled() ) [[unlikely]]
+            util::Profiler::inst().start( details::stage_of( tree[instr.node_], i ).line(), false );
+          pc = instr.operand_;
+          break;
+        }
+
+        // child process, it runs the code of the stage until `exit`
+        // The jobs of the shell are not children of the stage.
+        jobs_.clear();
+        if ( i > 0 )
+          util::rebind_fd( pipeline.pipes_[i - 1].reader().get(), STDIN_FILENO );
+        if ( i < pipeline.pipes_.size() )
+          util::rebind_fd( pipeline.pipes_[i].writer().get(), STDOUT_FILENO );
+        // Every stage must drop all pipe ends it holds, otherwise the readers never see EOF.
+        pipeline.pipes_.clear();
+      } break;
+
+      case Program::OpCode::exit: {
+        throw error::TerminationSignal( status );
+      } break;
+
+      case Program::OpCode::join: {
+        assert( !pipelines.empty() );
+        auto& pipeline = pipelines.back();
+        pipeline.pipes_.clear();
+
+        ret.pipe_status.clear();
+        const auto nodes = tree[instr.node_].siblings();
+        for ( size_t i = 0; i < pipeline.stages_.size(); ++i ) {
+          ret.pipe_status.push_back( visit(
+            util::Overloader {
+              []( type::Eval stage_status ) { return stage_status; },
+              [&]( auto& guard ) -> type::Eval {
+                util::TraceSpan span( "wait", "wait" );
+                span.arg( "pid", guard.pid() );
+                guard.wait();
+                const type::Eval stage_status = guard.exit_code().value();
+                if ( !timings.empty() )
+                  record( nodes[i], guard, stage_status );
+                if ( util::Profiler::enabled() ) [[unlikely]]
+                  util::Profiler::inst().child( nodes[i].line(), guard.usage() );
+                return stage_status;
+              } },
+            pipeline.stages_[i] ) );
+        }
+        // The status of the pipeline is the first failed stage, or success if there is none.
+        const auto failed = ranges::find_if_not(
+          ret.pipe_status,
+          []( type::Eval stage_status ) { return stage_status == EvalResult::success; } );
+        status = failed == ret.pipe_status.cend() ? EvalResult::success : *failed;
+        if ( util::Tracer::enabled() ) [[unlikely]]
+          util::Tracer::inst().record( "pipeline",
+                                       "evaluate",
+                                       pipeline.created_,
+                                       util::Tracer::Clock::now(),
+                                       format( "\"stages\":{}", pipeline.stages_.size() ) );
+        if ( util::Profiler::enabled() ) [[unlikely]]
+          util::Profiler::inst().run( tree[instr.node_].line(),
+                                      util::Profiler::Clock::now() - pipeline.created_ );
+        pipelines.pop_back();
+      } break;
+
+      case Program::OpCode::detach: {
+        assert( !pipelines.empty() );
+        auto& pipeline = pipelines.back();
+        pipeline.pipes_.clear();
+
+        type::String command;
+        details::describe( tree[instr.node_].left(), command );
+        auto& job = jobs_.add( pipeline.pgid_, move( command ) );
+        for ( const auto& stage : pipeline.stages_ ) {
+          job.processes_.push_back( visit(
+            util::Overloader {
+              []( type::Eval stage_status ) {
+                return util::JobTable::Process {
+                  .pid_ = -1, .pidfd_ = -1, .status_ = stage_status, .stopped_ = false };
+              },
+              [this]( const auto& guard ) { return jobs_.watch( guard.pid() ); } },
+            stage ) );
+        }
+        // `$!` is the last process of the job, like bash.
+        if ( const auto started = ranges::find_if( job.processes_ | views::reverse,
+                                                   []( const util::JobTable::Process& process ) {
+                                                     return process.pid_ > 0;
+                                                   } );
+             started != ranges::rend( job.processes_ ) )
+          variables_.insert_or_assign( "!"sv, started->pid_ );
+        report( format( "[{}] {}", job.id_, pipeline.pgid_ ), EvalResult::success );
+        status = EvalResult::success;
+        pipelines.pop_back();
+      } break;
+
+      case Program::OpCode::clock: {
+        timings.emplace_back( static_cast<util::Timing::Format>(
+          ExprNode( tree[instr.node_].siblings()[0] ).value() ) );
+      } break;
+
+      case Program::OpCode::measure: {
+        assert( !timings.empty() );
+        auto timing = move( timings.back() );
+        timings.pop_back();
+        // Like bash, the report goes to the standard error of the shell, which the redirections
+        // of the measured statement are undone from.
+        static_cast<void>( util::write_all( STDERR_FILENO, timing.report() ) );
+        if ( !timings.empty() )
+          timings.back().merge( move( timing ) );
+      } break;
+
+      case Program::OpCode::mark: {
+        left_status  = status;
+        ret.side_val = status;
+      } break;
+
+      case Program::OpCode::pair: {
+        ret.side_val = make_pair( left_status, status );
+      } break;
+      }
     }
 
-    return { .value = constant::invalid_value };
+    ret.value   = status;
+    ret.message = move( messages_ );
+    return ret;
+  }
+
+  Interpreter::EvalResult Interpreter::evaluate( StmtNodeT stmt_node, bool last )
+  {
+    if ( !stmt_node )
+      throw error::ArgumentError( "interpreter", "syntax tree node is null" );
+
+    util::TraceSpan span( details::kind_name( stmt_node.type() ), "evaluate" );
+    {
+      util::TraceSpan compiling( "compile", "evaluate" );
+      program_.compile( stmt_node );
+    }
+    return execute( last );
   }
 } // namespace tish
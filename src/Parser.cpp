@@ -1,230 +1,282 @@
 #include <Parser.hpp>
 #include <Tokenizer.hpp>
 #include <TreeNode.hpp>
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cctype>
+#include <charconv>
 #include <cstdlib>
-#include <iostream>
+#include <iterator>
+#include <memory>
+#include <unistd.h>
 #include <util/Constant.hpp>
 #include <util/Exception.hpp>
+#include <util/InputSource.hpp>
+#include <util/Metrics.hpp>
+#include <util/Timing.hpp>
+#include <util/Tracer.hpp>
 #include <util/Util.hpp>
 using namespace std;
 
 namespace tish {
-  Parser::Parser() : tknizr_ { cin } {}
+  Parser::Parser()
+    : tknizr_ { LineBuffer( make_unique<util::BlockSource>( STDIN_FILENO ) ) }
+    , tree_ { nullptr }
+    , open_groups_ {}
+  {}
 
-  Parser::StmtNodePtr Parser::parse()
+  void Parser::parse( SyntaxTree& tree )
   {
+    util::TraceSpan span( "parse", "parse" );
+    util::Metrics::inst().add( util::Metrics::Counter::statements );
     tknizr_.clear();
-    return statement();
+    tree.reset();
+    tree_ = addressof( tree );
+    tree.set_root( statement() );
   }
 
-  Parser::StmtNodePtr Parser::statement()
+  Parser::NodeIndex Parser::statement()
   {
-    switch ( const auto tkn_tp = tknizr_.peek().type_; tkn_tp ) {
+    const auto first_tkn_tp = tknizr_.peek().type_;
+    tree_->set_line( tknizr_.line_no() );
+    switch ( first_tkn_tp ) {
     case Tokenizer::TokenKind::ENDFILE: // empty statement
       [[fallthrough]];
     case Tokenizer::TokenKind::NEWLINE: {
-      tknizr_.consume( tkn_tp );
-      return make_unique<ExprNode>( ExprNode::ExprKind::value, EXIT_SUCCESS );
+      tknizr_.consume( first_tkn_tp );
+      return tree_->make_value( EXIT_SUCCESS );
     }
 
-    default: {
-      return nonempty_statement();
+    default: break;
     }
+
+    frames_.clear();
+    open_groups_ = 0;
+    while ( true ) {
+      NodeIndex node = operand();
+      if ( node == StmtNode::null_index )
+        continue; // the operand follows a `(`, `!` or `time`
+      node = negate( node );
+
+      // The extension of the statement, it ends at a connector which requires another operand.
+      bool extended = true;
+      while ( extended ) {
+        switch ( const auto tkn_tp = tknizr_.peek().type_; tkn_tp ) {
+        case Tokenizer::TokenKind::AND:  [[fallthrough]];
+        case Tokenizer::TokenKind::OR:   [[fallthrough]];
+        case Tokenizer::TokenKind::PIPE: {
+          tknizr_.consume( tkn_tp );
+          frames_.push_back( { .kind_      = Frame::Kind::connector,
+                               .connector_ = tkn_tp == Tokenizer::TokenKind::AND
+                                             ? StmtNode::StmtKind::logical_and
+                                             : ( tkn_tp == Tokenizer::TokenKind::OR
+                                                   ? StmtNode::StmtKind::logical_or
+                                                   : StmtNode::StmtKind::pipeline ),
+                               .left_      = node } );
+          extended = false;
+        } break;
+
+        case Tokenizer::TokenKind::SEMI: {
+          tknizr_.consume( Tokenizer::TokenKind::SEMI );
+          // Only a parenthesized statement can end with a `;`.
+          if ( open_groups_ > 0 && tknizr_.peek().is( Tokenizer::TokenKind::RPAREN ) ) {
+            tknizr_.consume( Tokenizer::TokenKind::RPAREN );
+            node = close_group( tree_->make_stmt( StmtNode::StmtKind::sequential, node ) );
+          } else {
+            frames_.push_back( { .kind_      = Frame::Kind::connector,
+                                 .connector_ = StmtNode::StmtKind::sequential,
+                                 .left_      = node } );
+            extended = false;
+          }
+        } break;
+
+        case Tokenizer::TokenKind::AMP: {
+          tknizr_.consume( Tokenizer::TokenKind::AMP );
+          // `a; b && c & d` runs `b && c` in the background, the pending `;` is left alone.
+          node = tree_->make_stmt( StmtNode::StmtKind::background, reduce( node, false ) );
+          // Like `;`, a `&` can end the statement.
+          if ( const auto next = tknizr_.peek().type_; next != Tokenizer::TokenKind::NEWLINE
+                                                       && next != Tokenizer::TokenKind::ENDFILE
+                                                       && next != Tokenizer::TokenKind::RPAREN ) {
+            frames_.push_back( { .kind_      = Frame::Kind::connector,
+                                 .connector_ = StmtNode::StmtKind::sequential,
+                                 .left_      = node } );
+            extended = false;
+          }
+        } break;
+
+        case Tokenizer::TokenKind::OVR_REDIR: // redirection
+          [[fallthrough]];
+        case Tokenizer::TokenKind::APND_REDIR:  [[fallthrough]];
+        case Tokenizer::TokenKind::MERG_OUTPUT: [[fallthrough]];
+        case Tokenizer::TokenKind::MERG_APPND:  [[fallthrough]];
+        case Tokenizer::TokenKind::MERG_STREAM: [[fallthrough]];
+        case Tokenizer::TokenKind::STDIN_REDIR: {
+          node = redirection( node );
+        } break;
+
+        case Tokenizer::TokenKind::RPAREN: {
+          if ( open_groups_ == 0 )
+            throw error::SyntaxError( tknizr_.line_pos(),
+                                      tknizr_.context(),
+                                      Tokenizer::TokenKind::NEWLINE,
+                                      tkn_tp );
+          tknizr_.consume( Tokenizer::TokenKind::RPAREN );
+          node = close_group( node );
+        } break;
+
+        case Tokenizer::TokenKind::ENDFILE: [[fallthrough]];
+        case Tokenizer::TokenKind::NEWLINE: {
+          if ( open_groups_ == 0 ) {
+            tknizr_.consume( tkn_tp );
+            return reduce( node );
+          }
+        } [[fallthrough]];
+
+        default:
+          throw error::SyntaxError( tknizr_.line_pos(),
+                                    tknizr_.context(),
+                                    open_groups_ == 0 ? Tokenizer::TokenKind::NEWLINE
+                                                      : Tokenizer::TokenKind::RPAREN,
+                                    tkn_tp );
+        }
+      }
     }
   }
 
-  Parser::StmtNodePtr Parser::nonempty_statement()
+  Parser::NodeIndex Parser::operand()
   {
-    Parser::StmtNodePtr node;
-    switch ( const auto tkn_tp = tknizr_.peek().type_; tkn_tp ) {
-    case Tokenizer::TokenKind::CMD: [[fallthrough]];
+    const bool negated = !frames_.empty() && frames_.back().kind_ == Frame::Kind::negation;
+    switch ( tknizr_.peek().type_ ) {
+    case Tokenizer::TokenKind::CMD: {
+      // Only an unquoted `time` is the keyword.
+      if ( tknizr_.text( tknizr_.peek() ) != "time" )
+        return expression();
+      tknizr_.consume( Tokenizer::TokenKind::CMD );
+      auto format = util::Timing::Format::human;
+      if ( tknizr_.peek().is( Tokenizer::TokenKind::CMD )
+           && tknizr_.text( tknizr_.peek() ) == "-j" ) {
+        tknizr_.consume( Tokenizer::TokenKind::CMD );
+        format = util::Timing::Format::json;
+      }
+      frames_.push_back( { .kind_      = Frame::Kind::timing,
+                           .connector_ = StmtNode::StmtKind::timed,
+                           .left_      = tree_->make_value( static_cast<type::Eval>( format ) ) } );
+      return StmtNode::null_index;
+    }
     case Tokenizer::TokenKind::STR: {
-      node = expression();
-    } break;
+      return expression();
+    }
 
     case Tokenizer::TokenKind::OVR_REDIR:   [[fallthrough]];
     case Tokenizer::TokenKind::APND_REDIR:  [[fallthrough]];
     case Tokenizer::TokenKind::MERG_OUTPUT: [[fallthrough]];
     case Tokenizer::TokenKind::MERG_APPND:  {
-      node = redirection( nullptr );
+      if ( !negated )
+        return redirection( StmtNode::null_index );
+    } break;
+
+    case Tokenizer::TokenKind::MERG_STREAM: {
+      // A leading `>&` is only accepted inside parentheses.
+      if ( !negated && open_groups_ > 0 )
+        return redirection( StmtNode::null_index );
     } break;
 
     case Tokenizer::TokenKind::LPAREN: {
       tknizr_.consume( Tokenizer::TokenKind::LPAREN );
-      node = inner_statement();
-    } break;
+      frames_.push_back( { .kind_      = Frame::Kind::group,
+                           .connector_ = StmtNode::StmtKind::atom,
+                           .left_      = StmtNode::null_index } );
+      ++open_groups_;
+      return StmtNode::null_index;
+    }
 
     case Tokenizer::TokenKind::NOT: {
-      node = logical_not();
-    } break;
-
-    default: {
-      throw error::SyntaxError( tknizr_.line_pos(),
-                                tknizr_.context(),
-                                Tokenizer::TokenKind::CMD,
-                                tknizr_.peek().type_ );
+      tknizr_.consume( Tokenizer::TokenKind::NOT );
+      frames_.push_back( { .kind_      = Frame::Kind::negation,
+                           .connector_ = StmtNode::StmtKind::logical_not,
+                           .left_      = StmtNode::null_index } );
+      return StmtNode::null_index;
     }
+
+    default: break;
     }
 
-    return statement_extension( move( node ) );
+    throw error::SyntaxError( tknizr_.line_pos(),
+                              tknizr_.context(),
+                              Tokenizer::TokenKind::CMD,
+                              tknizr_.peek().type_ );
   }
 
-  Parser::StmtNodePtr Parser::statement_extension( Parser::StmtNodePtr left_stmt )
+  Parser::NodeIndex Parser::negate( NodeIndex operand )
   {
-    switch ( const auto tkn_tp = tknizr_.peek().type_; tkn_tp ) {
-    case Tokenizer::TokenKind::AND: { // connector
-      tknizr_.consume( Tokenizer::TokenKind::AND );
-      return make_unique<StmtNode>( StmtNode::StmtKind::logical_and,
-                                    move( left_stmt ),
-                                    nonempty_statement() );
-    }
-
-    case Tokenizer::TokenKind::OR: {
-      tknizr_.consume( Tokenizer::TokenKind::OR );
-      return make_unique<StmtNode>( StmtNode::StmtKind::logical_or,
-                                    move( left_stmt ),
-                                    nonempty_statement() );
-    }
-
-    case Tokenizer::TokenKind::PIPE: {
-      tknizr_.consume( Tokenizer::TokenKind::PIPE );
-      return make_unique<StmtNode>( StmtNode::StmtKind::pipeline,
-                                    move( left_stmt ),
-                                    nonempty_statement() );
-    }
-
-    case Tokenizer::TokenKind::SEMI: {
-      tknizr_.consume( Tokenizer::TokenKind::SEMI );
-      return make_unique<StmtNode>( StmtNode::StmtKind::sequential,
-                                    move( left_stmt ),
-                                    nonempty_statement() );
-    }
-
-    case Tokenizer::TokenKind::OVR_REDIR: // redirection
-      [[fallthrough]];
-    case Tokenizer::TokenKind::APND_REDIR:  [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_OUTPUT: [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_APPND:  [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_STREAM: [[fallthrough]];
-    case Tokenizer::TokenKind::STDIN_REDIR: {
-      return statement_extension( redirection( move( left_stmt ) ) );
-    }
-
-    case Tokenizer::TokenKind::ENDFILE: [[fallthrough]];
-    case Tokenizer::TokenKind::NEWLINE: {
-      tknizr_.consume( tkn_tp );
-      return left_stmt;
-    }
-
-    default:
-      throw error::SyntaxError( tknizr_.line_pos(),
-                                tknizr_.context(),
-                                Tokenizer::TokenKind::NEWLINE,
-                                tknizr_.peek().type_ );
-    }
+    for ( ; !frames_.empty() && frames_.back().kind_ == Frame::Kind::negation; frames_.pop_back() )
+      operand = tree_->make_stmt( StmtNode::StmtKind::logical_not, operand );
+    return operand;
   }
 
-  Parser::StmtNodePtr Parser::inner_statement()
+  Parser::NodeIndex Parser::reduce( NodeIndex right_stmt, bool sequential )
   {
-    Parser::StmtNodePtr node;
-    switch ( tknizr_.peek().type_ ) {
-    case Tokenizer::TokenKind::CMD: [[fallthrough]];
-    case Tokenizer::TokenKind::STR: {
-      node = expression();
-    } break;
-
-    case Tokenizer::TokenKind::OVR_REDIR:   [[fallthrough]];
-    case Tokenizer::TokenKind::APND_REDIR:  [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_OUTPUT: [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_APPND:  [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_STREAM: {
-      node = redirection( nullptr );
-    } break;
-
-    case Tokenizer::TokenKind::NOT: {
-      node = logical_not();
-    } break;
-
-    case Tokenizer::TokenKind::LPAREN: {
-      tknizr_.consume( Tokenizer::TokenKind::LPAREN );
-      node = inner_statement();
-    } break;
-
-    default: {
-      throw error::SyntaxError( tknizr_.line_pos(),
-                                tknizr_.context(),
-                                Tokenizer::TokenKind::CMD,
-                                tknizr_.peek().type_ );
+    // Connectors are right associative, so the innermost one is joined first.
+    while ( !frames_.empty()
+            && ( frames_.back().kind_ == Frame::Kind::connector
+                 || frames_.back().kind_ == Frame::Kind::timing ) ) {
+      const auto& frame = frames_.back();
+      if ( !sequential && frame.connector_ == StmtNode::StmtKind::sequential )
+        break;
+      if ( frame.kind_ == Frame::Kind::timing ) {
+        const auto format = frame.left_;
+        frames_.pop_back();
+        // The `!` before the `time` applies to the measured statement.
+        right_stmt = negate( tree_->make_stmt( StmtNode::StmtKind::timed,
+                                               right_stmt,
+                                               StmtNode::null_index,
+                                               span( addressof( format ), 1 ) ) );
+        continue;
+      }
+      if ( frame.connector_ != StmtNode::StmtKind::pipeline ) {
+        right_stmt = tree_->make_stmt( frame.connector_, frame.left_, right_stmt );
+        frames_.pop_back();
+        continue;
+      }
+
+      /* `a | b | c` is joined into a single pipeline at once, instead of flattening a nested
+       * pipeline for every `|`, which takes quadratic time. */
+      auto first = frames_.size() - 1;
+      while ( first > 0 && frames_[first - 1].kind_ == Frame::Kind::connector
+              && frames_[first - 1].connector_ == StmtNode::StmtKind::pipeline )
+        --first;
+      arguments_.clear();
+      for ( auto i = first; i < frames_.size(); ++i )
+        append_stage( frames_[i].left_ );
+      append_stage( right_stmt );
+      right_stmt = tree_->make_stmt( StmtNode::StmtKind::pipeline, arguments_ );
+      frames_.resize( first );
     }
-    }
-
-    return inner_statement_extension( move( node ) );
+    return right_stmt;
   }
 
-  Parser::StmtNodePtr Parser::inner_statement_extension( Parser::StmtNodePtr left_stmt )
+  Parser::NodeIndex Parser::close_group( NodeIndex stmt )
   {
-    switch ( tknizr_.peek().type_ ) {
-    case Tokenizer::TokenKind::AND: { // connector
-      tknizr_.consume( Tokenizer::TokenKind::AND );
-      return make_unique<StmtNode>( StmtNode::StmtKind::logical_and,
-                                    move( left_stmt ),
-                                    inner_statement() );
-    }
-
-    case Tokenizer::TokenKind::OR: {
-      tknizr_.consume( Tokenizer::TokenKind::OR );
-      return make_unique<StmtNode>( StmtNode::StmtKind::logical_or,
-                                    move( left_stmt ),
-                                    inner_statement() );
-    }
-
-    case Tokenizer::TokenKind::PIPE: {
-      tknizr_.consume( Tokenizer::TokenKind::PIPE );
-      return make_unique<StmtNode>( StmtNode::StmtKind::pipeline,
-                                    move( left_stmt ),
-                                    inner_statement() );
-    }
-
-    case Tokenizer::TokenKind::SEMI: {
-      tknizr_.consume( Tokenizer::TokenKind::SEMI );
-
-      StmtNodePtr right_stmt;
-      if ( tknizr_.peek().is( Tokenizer::TokenKind::RPAREN ) )
-        tknizr_.consume( Tokenizer::TokenKind::RPAREN );
-      else
-        right_stmt = inner_statement();
-
-      return make_unique<StmtNode>( StmtNode::StmtKind::sequential,
-                                    move( left_stmt ),
-                                    move( right_stmt ) );
-    }
-
-    case Tokenizer::TokenKind::OVR_REDIR: // redirection
-      [[fallthrough]];
-    case Tokenizer::TokenKind::APND_REDIR:  [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_OUTPUT: [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_APPND:  [[fallthrough]];
-    case Tokenizer::TokenKind::MERG_STREAM: [[fallthrough]];
-    case Tokenizer::TokenKind::STDIN_REDIR: {
-      return inner_statement_extension( redirection( move( left_stmt ) ) );
-    }
-
-    case Tokenizer::TokenKind::RPAREN: {
-      tknizr_.consume( Tokenizer::TokenKind::RPAREN );
-      return left_stmt;
-    }
+    stmt = reduce( stmt );
+    assert( open_groups_ > 0 );
+    assert( !frames_.empty() && frames_.back().kind_ == Frame::Kind::group );
+    frames_.pop_back();
+    --open_groups_;
+    return negate( stmt );
+  }
 
-    default: {
-      throw error::SyntaxError( tknizr_.line_pos(),
-                                tknizr_.context(),
-                                Tokenizer::TokenKind::RPAREN,
-                                tknizr_.peek().type_ );
-    }
-    }
+  void Parser::append_stage( NodeIndex stmt )
+  {
+    // A parenthesized pipeline is flattened, so that `(a | b) | c` has three stages.
+    if ( const auto node = ( *tree_ )[stmt]; node.type() == StmtNode::StmtKind::pipeline )
+      ranges::transform( node.siblings(), back_inserter( arguments_ ), &StmtNode::index );
+    else
+      arguments_.push_back( stmt );
   }
 
-  Parser::StmtNodePtr Parser::redirection( Parser::StmtNodePtr left_stmt )
+  Parser::NodeIndex Parser::redirection( NodeIndex left_stmt )
   {
     StmtNode::StmtKind stmt_kind = StmtNode::StmtKind::atom;
     switch ( tknizr_.peek().type_ ) {
@@ -233,7 +285,7 @@ namespace tish {
     case Tokenizer::TokenKind::MERG_OUTPUT: [[fallthrough]];
     case Tokenizer::TokenKind::MERG_APPND:  [[fallthrough]];
     case Tokenizer::TokenKind::MERG_STREAM: {
-      return output_redirection( move( left_stmt ) );
+      return output_redirection( left_stmt );
     }
     case Tokenizer::TokenKind::STDIN_REDIR: {
       stmt_kind = StmtNode::StmtKind::stdin_redrct;
@@ -255,51 +307,26 @@ namespace tish {
 
     // The structure of syntax tree node
     // requires that redirected file name argument be stored in sibling nodes.
-    StmtNode::SiblingNodes arguments;
-    arguments.emplace_back( expression() );
+    const array arguments { expression() };
 
-    return make_unique<StmtNode>( stmt_kind, move( left_stmt ), nullptr, move( arguments ) );
+    return tree_->make_stmt( stmt_kind, left_stmt, StmtNode::null_index, arguments );
   }
 
-  Parser::StmtNodePtr Parser::output_redirection( Parser::StmtNodePtr left_stmt )
+  Parser::NodeIndex Parser::output_redirection( NodeIndex left_stmt )
   {
     StmtNode::StmtKind stmt_kind = StmtNode::StmtKind::atom;
-    StmtNode::SiblingNodes arguments;
-
-    auto extract_params =
-      [this]( StmtNode::SiblingNodes& args, type::StrView re_str, Tokenizer::TokenKind expecting ) {
-        auto [match_result, matches] = util::match_string( tknizr_.consume( expecting ), re_str );
-
-        assert( match_result == true );
-        if ( expecting == Tokenizer::TokenKind::MERG_STREAM ) {
-          for ( size_t i = 1; i <= 2; ++i ) {
-            if ( auto match_str = matches[i].str(); match_str.empty() )
-              args.emplace_back(
-                make_unique<ExprNode>( ExprNode::ExprKind::value, constant::invalid_value ) );
-            else
-              args.emplace_back(
-                make_unique<ExprNode>( ExprNode::ExprKind::value, stoi( match_str ) ) );
-          }
-        } else {
-          if ( auto match_str = matches[1].str(); match_str.empty() )
-            args.emplace_back(
-              make_unique<ExprNode>( ExprNode::ExprKind::value, constant::invalid_value ) );
-          else
-            args.emplace_back(
-              make_unique<ExprNode>( ExprNode::ExprKind::value, stoi( match_str ) ) );
-        }
-      };
+    // At most a file descriptor and a file name.
+    array<NodeIndex, 2> arguments;
+    size_t num_args = 0;
 
     switch ( tknizr_.peek().type_ ) {
     case Tokenizer::TokenKind::OVR_REDIR: { // >
       stmt_kind = StmtNode::StmtKind::ovrwrit_redrct;
-      extract_params( arguments, _pattern_redirection, Tokenizer::TokenKind::OVR_REDIR );
-      assert( arguments.size() == 1 );
+      extract_fds( span( arguments ).first( ++num_args ), Tokenizer::TokenKind::OVR_REDIR );
     } break;
     case Tokenizer::TokenKind::APND_REDIR: { // >>
       stmt_kind = StmtNode::StmtKind::appnd_redrct;
-      extract_params( arguments, _pattern_redirection, Tokenizer::TokenKind::APND_REDIR );
-      assert( arguments.size() == 1 );
+      extract_fds( span( arguments ).first( ++num_args ), Tokenizer::TokenKind::APND_REDIR );
     } break;
     case Tokenizer::TokenKind::MERG_OUTPUT: { // &>
       stmt_kind = StmtNode::StmtKind::merge_output;
@@ -310,7 +337,7 @@ namespace tish {
       tknizr_.consume( Tokenizer::TokenKind::MERG_APPND );
     } break;
     case Tokenizer::TokenKind::MERG_STREAM: { // >&
-      return combined_redirection_extension( move( left_stmt ) );
+      return combined_redirection_extension( left_stmt );
     }
     default:
       throw error::SyntaxError( tknizr_.line_pos(),
@@ -319,137 +346,121 @@ namespace tish {
                                 tknizr_.peek().type_ );
     }
 
-    arguments.emplace_back( expression() );
+    arguments[num_args++] = expression();
 
     // The left operator takes precedence, which means `MERG_STREAM` will be the
     // child node.
     if ( tknizr_.peek().is( Tokenizer::TokenKind::MERG_STREAM ) ) { // output_redirecti
-      StmtNode::SiblingNodes subargs;
-      extract_params( subargs, _pattern_combined_redir, Tokenizer::TokenKind::MERG_STREAM );
-      assert( subargs.size() == 2 );
-
-      return make_unique<StmtNode>( stmt_kind,
-                                    make_unique<StmtNode>( StmtNode::StmtKind::merge_stream,
-                                                           move( left_stmt ),
-                                                           nullptr,
-                                                           move( subargs ) ),
-                                    nullptr,
-                                    move( arguments ) );
+      array<NodeIndex, 2> subargs;
+      extract_fds( subargs, Tokenizer::TokenKind::MERG_STREAM );
+
+      return tree_->make_stmt( stmt_kind,
+                               tree_->make_stmt( StmtNode::StmtKind::merge_stream,
+                                                 left_stmt,
+                                                 StmtNode::null_index,
+                                                 subargs ),
+                               StmtNode::null_index,
+                               span( arguments ).first( num_args ) );
     }
-    return make_unique<StmtNode>( stmt_kind, move( left_stmt ), nullptr, move( arguments ) );
+    return tree_->make_stmt( stmt_kind,
+                             left_stmt,
+                             StmtNode::null_index,
+                             span( arguments ).first( num_args ) );
   }
 
-  Parser::StmtNodePtr Parser::combined_redirection_extension( Parser::StmtNodePtr left_stmt )
+  Parser::NodeIndex Parser::combined_redirection_extension( NodeIndex left_stmt )
   {
     assert( tknizr_.peek().is( Tokenizer::TokenKind::MERG_STREAM ) );
 
-    StmtNode::SiblingNodes arguments;
-    auto extract_params =
-      [this]( StmtNode::SiblingNodes& args, type::StrView re_str, Tokenizer::TokenKind expecting ) {
-        auto [match_result, matches] = util::match_string( tknizr_.consume( expecting ), re_str );
-
-        assert( match_result == true );
-        if ( expecting == Tokenizer::TokenKind::MERG_STREAM ) {
-          for ( size_t i = 1; i <= 2; ++i ) {
-            if ( auto match_str = matches[i].str(); match_str.empty() )
-              args.emplace_back(
-                make_unique<ExprNode>( ExprNode::ExprKind::value, constant::invalid_value ) );
-            else
-              args.emplace_back(
-                make_unique<ExprNode>( ExprNode::ExprKind::value, stoi( match_str ) ) );
-          }
-        } else {
-          if ( auto match_str = matches[1].str(); match_str.empty() )
-            args.emplace_back(
-              make_unique<ExprNode>( ExprNode::ExprKind::value, constant::invalid_value ) );
-          else
-            args.emplace_back(
-              make_unique<ExprNode>( ExprNode::ExprKind::value, stoi( match_str ) ) );
-        }
-      };
-
-    extract_params( arguments, _pattern_combined_redir, Tokenizer::TokenKind::MERG_STREAM );
-    assert( arguments.size() == 2 );
+    array<NodeIndex, 2> arguments;
+    extract_fds( arguments, Tokenizer::TokenKind::MERG_STREAM );
 
-    StmtNodePtr node = nullptr;
+    NodeIndex node = StmtNode::null_index;
     switch ( tknizr_.peek().type_ ) {
     case Tokenizer::TokenKind::OVR_REDIR: { // >
-      StmtNode::SiblingNodes subargs;
-      extract_params( subargs, _pattern_redirection, Tokenizer::TokenKind::OVR_REDIR );
-      assert( subargs.size() == 1 );
-      subargs.emplace_back( expression() );
+      array<NodeIndex, 2> subargs;
+      extract_fds( span( subargs ).first( 1 ), Tokenizer::TokenKind::OVR_REDIR );
+      subargs[1] = expression();
 
       // The left operator takes precedence, which means `MERG_STREAM` will be
       // the parent node.
-      node = make_unique<StmtNode>( StmtNode::StmtKind::ovrwrit_redrct,
-                                    move( left_stmt ),
-                                    nullptr,
-                                    move( subargs ) );
+      node = tree_->make_stmt( StmtNode::StmtKind::ovrwrit_redrct,
+                               left_stmt,
+                               StmtNode::null_index,
+                               subargs );
     } break;
 
     case Tokenizer::TokenKind::APND_REDIR: { // >>
-      StmtNode::SiblingNodes subargs;
-      extract_params( subargs, _pattern_redirection, Tokenizer::TokenKind::APND_REDIR );
-      assert( subargs.size() == 1 );
-      subargs.emplace_back( expression() );
-
-      node = make_unique<StmtNode>( StmtNode::StmtKind::appnd_redrct,
-                                    move( left_stmt ),
-                                    nullptr,
-                                    move( subargs ) );
+      array<NodeIndex, 2> subargs;
+      extract_fds( span( subargs ).first( 1 ), Tokenizer::TokenKind::APND_REDIR );
+      subargs[1] = expression();
+
+      node = tree_->make_stmt( StmtNode::StmtKind::appnd_redrct,
+                               left_stmt,
+                               StmtNode::null_index,
+                               subargs );
     } break;
 
     case Tokenizer::TokenKind::MERG_OUTPUT: { // &>
       tknizr_.consume( Tokenizer::TokenKind::MERG_OUTPUT );
-      StmtNode::SiblingNodes subargs;
-      subargs.emplace_back( expression() );
+      const array subargs { expression() };
 
-      node = make_unique<StmtNode>( StmtNode::StmtKind::merge_output,
-                                    move( left_stmt ),
-                                    nullptr,
-                                    move( subargs ) );
+      node = tree_->make_stmt( StmtNode::StmtKind::merge_output,
+                               left_stmt,
+                               StmtNode::null_index,
+                               subargs );
     } break;
 
     case Tokenizer::TokenKind::MERG_APPND: { // &>>
       tknizr_.consume( Tokenizer::TokenKind::MERG_APPND );
-      StmtNode::SiblingNodes subargs;
-      subargs.emplace_back( expression() );
+      const array subargs { expression() };
 
-      node = make_unique<StmtNode>( StmtNode::StmtKind::merge_appnd,
-                                    move( left_stmt ),
-                                    nullptr,
-                                    move( subargs ) );
+      node = tree_->make_stmt( StmtNode::StmtKind::merge_appnd,
+                               left_stmt,
+                               StmtNode::null_index,
+                               subargs );
     } break;
 
     default: break;
     }
-    return make_unique<StmtNode>( StmtNode::StmtKind::merge_stream,
-                                  move( node == nullptr ? left_stmt : node ),
-                                  nullptr,
-                                  move( arguments ) );
+    return tree_->make_stmt( StmtNode::StmtKind::merge_stream,
+                             node == StmtNode::null_index ? left_stmt : node,
+                             StmtNode::null_index,
+                             arguments );
   }
 
-  Parser::StmtNodePtr Parser::logical_not()
+  void Parser::extract_fds( span<NodeIndex> fds, Tokenizer::TokenKind expecting )
   {
-    tknizr_.consume( Tokenizer::TokenKind::NOT );
-
-    if ( tknizr_.peek().is( Tokenizer::TokenKind::CMD )
-         || tknizr_.peek().is( Tokenizer::TokenKind::STR ) ) {
-      return make_unique<StmtNode>( StmtNode::StmtKind::logical_not, expression() );
-    } else if ( tknizr_.peek().is( Tokenizer::TokenKind::LPAREN ) ) {
-      tknizr_.consume( Tokenizer::TokenKind::LPAREN );
-      return make_unique<StmtNode>( StmtNode::StmtKind::logical_not, inner_statement() );
-    } else if ( tknizr_.peek().is( Tokenizer::TokenKind::NOT ) ) {
-      return make_unique<StmtNode>( StmtNode::StmtKind::logical_not, logical_not() );
-    }
+    assert( fds.size() == 1 || fds.size() == 2 );
+    const auto token = tknizr_.consume( expecting );
+
+    /* The tokenizer only produces `(\d*)>{1,2}` and `(\d*)>&(\d*)`, so the first file descriptor
+     * is made of the leading digits, and the second one is made of the trailing digits. */
+    constexpr type::StrView digits = "0123456789";
+    const auto leading             = token.substr( 0, token.find_first_not_of( digits ) );
+    const auto trailing            = token.substr( token.find_last_not_of( digits ) + 1 );
+    assert( leading.size() + trailing.size() < token.size() );
+
+    fds[0] = fd_value( leading );
+    if ( fds.size() == 2 )
+      fds[1] = fd_value( trailing );
+    else
+      assert( trailing.empty() );
+  }
 
-    throw error::SyntaxError( tknizr_.line_pos(),
-                              tknizr_.context(),
-                              Tokenizer::TokenKind::CMD,
-                              tknizr_.peek().type_ );
+  Parser::NodeIndex Parser::fd_value( type::StrView digits )
+  {
+    if ( digits.empty() )
+      return tree_->make_value( constant::invalid_value );
+
+    type::FileDesc file_d {};
+    if ( const auto [_, ec] = from_chars( digits.data(), digits.data() + digits.size(), file_d );
+         ec != errc() )
+      throw error::ArgumentError( "parser"sv, "the file descriptor is out of range"sv );
+    return tree_->make_value( file_d );
   }
 
-  Parser::ExprNodePtr Parser::expression()
+  Parser::NodeIndex Parser::expression()
   {
     if ( !tknizr_.peek().is( Tokenizer::TokenKind::CMD )
          && !tknizr_.peek().is( Tokenizer::TokenKind::STR ) )
@@ -458,9 +469,9 @@ namespace tish {
                                 Tokenizer::TokenKind::CMD,
                                 tknizr_.peek().type_ );
 
-    StmtNode::SiblingNodes arguments;
-
     const auto token_type = tknizr_.peek().type_;
+    tree_->set_line( tknizr_.line_no() );
+    // The arguments are on the same line, thus reading them won't invalidate `token_str`.
     const auto token_str =
       tknizr_.consume( token_type == Tokenizer::TokenKind::CMD ? Tokenizer::TokenKind::CMD
                                                                : Tokenizer::TokenKind::STR );
@@ -471,21 +482,111 @@ namespace tish {
      * This is because, according to the syntax tree node structure,
      * all subsequent tokens of the command string are parameters of the first
      token. */
+    arguments_.clear();
     while ( tknizr_.peek().is( Tokenizer::TokenKind::CMD )
             || tknizr_.peek().is( Tokenizer::TokenKind::STR ) ) {
-      assert( tknizr_.peek().value_.empty() == false );
+      assert( !tknizr_.peek().empty() );
 
       const auto tkn_tp = tknizr_.peek().type_;
-      arguments.emplace_back( make_unique<ExprNode>( tkn_tp == Tokenizer::TokenKind::CMD
-                                                       ? ExprNode::ExprKind::command
-                                                       : ExprNode::ExprKind::string,
-                                                     tknizr_.consume( tknizr_.peek().type_ ) ) );
+      const auto arg    = tknizr_.consume( tkn_tp );
+      compile_word( arg, tkn_tp );
+      arguments_.push_back( tree_->make_expr( tkn_tp == Tokenizer::TokenKind::CMD
+                                                ? ExprNode::ExprKind::command
+                                                : ExprNode::ExprKind::string,
+                                              arg,
+                                              segments_ ) );
+    }
+
+    compile_word( token_str, token_type );
+    return tree_->make_expr( arguments_.empty() && token_type == Tokenizer::TokenKind::STR
+                               ? ExprNode::ExprKind::string
+                               : ExprNode::ExprKind::command,
+                             token_str,
+                             segments_,
+                             arguments_ );
+  }
+
+  void Parser::compile_word( type::StrView word, Tokenizer::TokenKind word_type )
+  {
+    using Segment = ExprNode::Segment;
+
+    segments_.clear();
+    if ( word.find_first_of( "$\\~" ) == type::StrView::npos )
+      return;
+
+    const auto append_literal = [this]( type::StrView text ) {
+      if ( text.empty() )
+        return;
+      // Adjacent literals are merged, e.g. the text around an escaped `$`.
+      if ( !segments_.empty() && segments_.back().kind_ == Segment::Kind::literal
+           && segments_.back().text_.data() + segments_.back().text_.size() == text.data() )
+        segments_.back().text_ = { segments_.back().text_.data(),
+                                   segments_.back().text_.size() + text.size() };
+      else
+        segments_.push_back( { .kind_ = Segment::Kind::literal, .text_ = text } );
+    };
+
+    bool expanded = false;
+    auto rest     = word;
+    if ( word_type == Tokenizer::TokenKind::CMD && ( word == "~" || word.starts_with( "~/" ) ) ) {
+      segments_.push_back( { .kind_ = Segment::Kind::home_dir, .text_ = {} } );
+      rest.remove_prefix( 1 );
+      expanded = true;
+    }
+
+    while ( !rest.empty() ) {
+      const auto pos = rest.find_first_of( "$\\" );
+      if ( pos == type::StrView::npos ) {
+        append_literal( rest );
+        break;
+      }
+      append_literal( rest.substr( 0, pos ) );
+
+      if ( rest[pos] == '\\' ) {
+        // Only `\$` is an escape sequence, other backslashes are kept as is.
+        if ( pos + 1 < rest.size() && rest[pos + 1] == '$' ) {
+          append_literal( rest.substr( pos + 1, 1 ) );
+          rest.remove_prefix( pos + 2 );
+          expanded = true;
+        } else {
+          append_literal( rest.substr( pos, 1 ) );
+          rest.remove_prefix( pos + 1 );
+        }
+        continue;
+      }
+
+      const auto dollar = rest.substr( pos, 1 );
+      rest.remove_prefix( pos + 1 );
+      size_t name_len = 0;
+      if ( rest.starts_with( '{' ) ) {
+        if ( const auto closing = rest.find( '}' ); closing != type::StrView::npos ) {
+          segments_.push_back(
+            { .kind_ = Segment::Kind::variable, .text_ = rest.substr( 1, closing - 1 ) } );
+          rest.remove_prefix( closing + 1 );
+          expanded = true;
+          continue;
+        }
+      } else if ( rest.starts_with( '$' ) || rest.starts_with( '!' ) )
+        name_len = 1;
+      else
+        name_len = static_cast<size_t>(
+          ranges::find_if_not( rest, []( char ch ) {
+            return isalnum( static_cast<unsigned char>( ch ) ) || ch == '_';
+          } )
+          - rest.begin() );
+
+      if ( name_len == 0 ) {
+        // A `$` which is not followed by a name is a literal.
+        append_literal( dollar );
+        continue;
+      }
+      segments_.push_back(
+        { .kind_ = Segment::Kind::variable, .text_ = rest.substr( 0, name_len ) } );
+      rest.remove_prefix( name_len );
+      expanded = true;
     }
 
-    return make_unique<ExprNode>( arguments.empty() && token_type == Tokenizer::TokenKind::STR
-                                    ? ExprNode::ExprKind::string
-                                    : ExprNode::ExprKind::command,
-                                  move( token_str ),
-                                  move( arguments ) );
+    if ( !expanded )
+      segments_.clear();
   }
 } // namespace tish
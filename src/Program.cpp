@@ -0,0 +1,163 @@
+#include <Program.hpp>
+#include <ranges>
+#include <util/Exception.hpp>
+using namespace std;
+
+namespace tish {
+  void Program::emit( OpCode op, Index node, Index operand )
+  {
+    if ( code_.size() >= StmtNode::null_index ) [[unlikely]]
+      throw error::RuntimeError( "Program: too many instructions in a single statement" );
+    code_.push_back( { .op_ = op, .node_ = node, .operand_ = operand } );
+  }
+
+  void Program::visit( StmtNode node, bool root )
+  {
+    // Tasks are popped from the back, so they're pushed in the reverse order of execution.
+    const auto later = [this]( Task::Kind kind, OpCode op, Index index, bool is_root = false ) {
+      tasks_.push_back( { .kind_ = kind, .root_ = is_root, .op_ = op, .node_ = index } );
+    };
+    const auto visit_later = [&later]( StmtNode stmt, bool is_root ) {
+      later( Task::Kind::visit, OpCode::spawn, stmt.index(), is_root );
+    };
+
+    switch ( node.type() ) {
+    case StmtNode::StmtKind::atom: {
+      emit( OpCode::spawn, node.index() );
+      emit( OpCode::wait, node.index() );
+    } break;
+
+    case StmtNode::StmtKind::sequential: {
+      assert( node.left() );
+      if ( node.right() ) {
+        if ( root )
+          later( Task::Kind::emit, OpCode::pair, node.index() );
+        visit_later( node.right(), false );
+      }
+      if ( root )
+        later( Task::Kind::emit, OpCode::mark, node.index() );
+      visit_later( node.left(), false );
+    } break;
+
+    case StmtNode::StmtKind::logical_and: [[fallthrough]];
+    case StmtNode::StmtKind::logical_or:  {
+      assert( node.left() && node.right() );
+      // The right operand is skipped by a jump, which is patched once the operand is emitted.
+      later( Task::Kind::patch, OpCode::jump_if_fail, node.index() );
+      if ( root )
+        later( Task::Kind::emit, OpCode::pair, node.index() );
+      visit_later( node.right(), false );
+      later( Task::Kind::emit_jump,
+             node.type() == StmtNode::StmtKind::logical_and ? OpCode::jump_if_fail
+                                                            : OpCode::jump_if_ok,
+             node.index() );
+      if ( root )
+        later( Task::Kind::emit, OpCode::mark, node.index() );
+      visit_later( node.left(), false );
+    } break;
+
+    case StmtNode::StmtKind::logical_not: {
+      assert( node.left() );
+      if ( root )
+        later( Task::Kind::emit, OpCode::mark, node.index() );
+      later( Task::Kind::emit, OpCode::negate, node.index() );
+      visit_later( node.left(), false );
+    } break;
+
+    case StmtNode::StmtKind::pipeline:   [[fallthrough]];
+    case StmtNode::StmtKind::background: {
+      // A background job is lowered like a pipeline, but it's detached instead of joined.
+      const bool background = node.type() == StmtNode::StmtKind::background;
+      assert( background ? static_cast<bool>( node.left() ) : node.siblings().size() >= 2 );
+      emit( OpCode::pipeline, node.index() );
+      later( Task::Kind::emit, background ? OpCode::detach : OpCode::join, node.index() );
+      // The parent skips the code of each stage, which is only run by the forked process.
+      const auto later_stages = [&]( auto stages ) {
+        for ( const auto stage : stages | views::reverse ) {
+          // A single command is spawned without forking, unless it turns out to be a builtin.
+          const bool simple = stage.type() == StmtNode::StmtKind::atom;
+          if ( simple )
+            later( Task::Kind::patch, OpCode::launch, node.index() );
+          later( Task::Kind::patch, OpCode::stage, node.index() );
+          later( Task::Kind::emit, OpCode::exit, stage.index() );
+          visit_later( stage, false );
+          later( Task::Kind::emit_jump, OpCode::stage, node.index() );
+          if ( simple )
+            later( Task::Kind::emit_jump, OpCode::launch, stage.index() );
+        }
+      };
+      if ( !background )
+        later_stages( node.siblings() );
+      else if ( node.left().type() == StmtNode::StmtKind::pipeline )
+        later_stages( node.left().siblings() );
+      else
+        later_stages( views::single( node.left() ) );
+    } break;
+
+    case StmtNode::StmtKind::timed: {
+      assert( node.left() );
+      emit( OpCode::clock, node.index() );
+      later( Task::Kind::emit, OpCode::measure, node.index() );
+      visit_later( node.left(), root );
+    } break;
+
+    case StmtNode::StmtKind::ovrwrit_redrct: [[fallthrough]];
+    case StmtNode::StmtKind::appnd_redrct:   [[fallthrough]];
+    case StmtNode::StmtKind::merge_output:   [[fallthrough]];
+    case StmtNode::StmtKind::merge_appnd:    [[fallthrough]];
+    case StmtNode::StmtKind::merge_stream:   [[fallthrough]];
+    case StmtNode::StmtKind::stdin_redrct:   {
+      // The nested redirections are fused into this one, so all of them are made in a single step.
+      auto target = node.left();
+      while ( target && target.is_redirection() )
+        target = target.left();
+
+      // A failed redirection jumps over the statement and the `restore`.
+      later( Task::Kind::patch, OpCode::restore, node.index() );
+      later( Task::Kind::emit, OpCode::restore, node.index() );
+      if ( target )
+        visit_later( target, root );
+      // A single command receives the redirection when it's spawned.
+      later( Task::Kind::emit_jump,
+             !target || target.type() == StmtNode::StmtKind::atom ? OpCode::bind : OpCode::wire,
+             node.index() );
+    } break;
+
+    default: assert( false ); break;
+    }
+  }
+
+  void Program::compile( StmtNode root )
+  {
+    tree_ = addressof( root.tree() );
+    code_.clear();
+    tasks_.clear();
+    jumps_.clear();
+
+    tasks_.push_back(
+      { .kind_ = Task::Kind::visit, .root_ = true, .op_ = OpCode::spawn, .node_ = root.index() } );
+    while ( !tasks_.empty() ) {
+      const auto task = tasks_.back();
+      tasks_.pop_back();
+
+      switch ( task.kind_ ) {
+      case Task::Kind::visit: {
+        visit( ( *tree_ )[task.node_], task.root_ );
+      } break;
+      case Task::Kind::emit: {
+        emit( task.op_, task.node_ );
+      } break;
+      case Task::Kind::emit_jump: {
+        jumps_.push_back( static_cast<Index>( code_.size() ) );
+        emit( task.op_, task.node_ );
+      } break;
+      case Task::Kind::patch: {
+        assert( !jumps_.empty() );
+        code_[jumps_.back()].operand_ = static_cast<Index>( code_.size() );
+        jumps_.pop_back();
+      } break;
+      }
+    }
+    assert( jumps_.empty() );
+  }
+} // namespace tish
@@ -0,0 +1,730 @@
+#include <Parser.hpp>
+#include <ScriptCache.hpp>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <span>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <util/Exception.hpp>
+#include <util/InputSource.hpp>
+#include <util/Timing.hpp>
+#include <util/Util.hpp>
+#include <vector>
+using namespace std;
+
+namespace tish {
+  struct ScriptCache::Header {
+    array<char, 8> magic_;
+    // A cache file written by a host of another byte order reads this field differently.
+    uint32_t byte_order_;
+    uint32_t layout_;
+    // The identity of the script when the cache was built.
+    uint64_t script_size_;
+    int64_t mtime_sec_, mtime_nsec_;
+    uint64_t device_, inode_;
+    array<char, 32> version_;
+    // The real path of the script follows the header.
+    uint64_t path_size_;
+    // The offset and the size of the packed statements, and the number of them.
+    uint64_t statements_, statements_size_, num_statements_;
+    // The offset and the size of the string table.
+    uint64_t strings_, strings_size_;
+  };
+
+  /// @brief Writes the cache file through a buffer.
+  class ScriptCache::Writer {
+    static constexpr size_t _buffer_size = 64 * 1024;
+
+    type::FileDesc fd_;
+    vector<char> buffer_;
+    uint64_t flushed_;
+
+  public:
+    Writer( type::FileDesc fd ) : fd_ { fd }, flushed_ {} { buffer_.reserve( _buffer_size ); }
+
+    [[nodiscard]] uint64_t offset() const noexcept { return flushed_ + buffer_.size(); }
+
+    void write( const void* data, size_t size )
+    {
+      if ( buffer_.size() + size > _buffer_size )
+        flush();
+      if ( size >= _buffer_size )
+        write_through( data, size );
+      else {
+        const auto bytes = static_cast<const char*>( data );
+        buffer_.insert( buffer_.end(), bytes, bytes + size );
+      }
+    }
+
+    void write_byte( uint8_t value ) { write( &value, sizeof( value ) ); }
+
+    /// @brief Write the value in LEB128, 7 bits per byte whose highest bit tells if more follow.
+    void write_varint( uint64_t value )
+    {
+      array<uint8_t, 10> bytes {};
+      size_t size = 0;
+      do {
+        bytes[size++] = static_cast<uint8_t>( ( value & 0x7f ) | ( value > 0x7f ? 0x80 : 0 ) );
+        value >>= 7;
+      } while ( value != 0 );
+      write( bytes.data(), size );
+    }
+
+    void flush()
+    {
+      write_through( buffer_.data(), buffer_.size() );
+      buffer_.clear();
+    }
+
+  private:
+    void write_through( const void* data, size_t size )
+    {
+      for ( auto bytes = static_cast<const char*>( data ); size > 0; ) {
+        const auto num_written = ::write( fd_, bytes, size );
+        if ( num_written < 0 && errno == EINTR )
+          continue;
+        if ( num_written < 0 )
+          throw error::SystemCallError( "write" );
+        bytes += num_written;
+        size -= static_cast<size_t>( num_written );
+        flushed_ += static_cast<uint64_t>( num_written );
+      }
+    }
+  };
+
+  /// @brief The text of all tokens and diagnostics of a script, each distinct text is stored once.
+  class ScriptCache::StringTable {
+    type::String text_;
+    unordered_map<type::String, Index> offsets_;
+
+  public:
+    [[nodiscard]] type::StrView text() const noexcept { return text_; }
+
+    /// @brief Returns the offset of `str` in the table, it's followed by a '\0' there.
+    [[nodiscard]] Index intern( type::StrView str )
+    {
+      const auto [item, inserted] =
+        offsets_.try_emplace( type::String( str ), static_cast<Index>( text_.size() ) );
+      if ( inserted ) {
+        // A token is referred to by an `Index`.
+        if ( text_.size() + str.size() >= StmtNode::null_index ) [[unlikely]]
+          throw error::RuntimeError( "ScriptCache: the script has too much text" );
+        text_.append( str ).push_back( '\0' );
+      }
+      return item->second;
+    }
+  };
+
+  namespace details {
+    constexpr array<char, 8> cache_magic { 't', 'i', 's', 'h', 'c', '\0', '\0', '\0' };
+    constexpr uint32_t byte_order     = 0x01020304;
+    // Bumped whenever the layout of the cache file changes but the sizes don't.
+    constexpr uint32_t format_version = 6;
+
+    // The flags which a packed statement starts with.
+    constexpr uint8_t last_statement = 0x01;
+    constexpr uint8_t diagnostic     = 0x02;
+    // The kinds of a packed node take the low 6 bits of its first byte, these are the rest.
+    constexpr uint8_t has_left  = 0x40;
+    constexpr uint8_t has_right = 0x80;
+
+    [[nodiscard]] constexpr uint64_t zigzag( int64_t value ) noexcept
+    {
+      return ( static_cast<uint64_t>( value ) << 1 ) ^ static_cast<uint64_t>( value >> 63 );
+    }
+
+    [[nodiscard]] constexpr int64_t unzigzag( uint64_t value ) noexcept
+    {
+      return static_cast<int64_t>( value >> 1 ) ^ -static_cast<int64_t>( value & 1 );
+    }
+
+    /// @brief Reads the packed statements, a read past their end fails every later read.
+    class PackedReader {
+      const byte* pos_;
+      const byte* end_;
+      bool failed_;
+
+    public:
+      PackedReader( const byte* begin, const byte* end ) noexcept
+        : pos_ { begin }, end_ { end }, failed_ { false }
+      {}
+
+      [[nodiscard]] bool failed() const noexcept { return failed_; }
+      [[nodiscard]] const byte* position() const noexcept { return pos_; }
+
+      [[nodiscard]] uint8_t read_byte() noexcept
+      {
+        if ( failed_ || pos_ == end_ ) {
+          failed_ = true;
+          return 0;
+        }
+        return static_cast<uint8_t>( *pos_++ );
+      }
+
+      [[nodiscard]] uint64_t read_varint() noexcept
+      {
+        uint64_t value = 0;
+        for ( unsigned shift = 0; shift < 64; shift += 7 ) {
+          const auto bits = read_byte();
+          value |= static_cast<uint64_t>( bits & 0x7f ) << shift;
+          if ( ( bits & 0x80 ) == 0 )
+            return value;
+        }
+        failed_ = true;
+        return 0;
+      }
+
+      /// @brief Read a number of items, each of them takes at least one more byte.
+      [[nodiscard]] StmtNode::Index read_count() noexcept
+      {
+        const auto count = read_varint();
+        if ( count > static_cast<uint64_t>( end_ - pos_ ) ) {
+          failed_ = true;
+          return 0;
+        }
+        return static_cast<StmtNode::Index>( count );
+      }
+
+      /// @brief Read a varint which must be an index below `bound`.
+      [[nodiscard]] StmtNode::Index read_index( uint64_t bound = StmtNode::null_index ) noexcept
+      {
+        const auto index = read_varint();
+        if ( index >= bound ) {
+          failed_ = true;
+          return 0;
+        }
+        return static_cast<StmtNode::Index>( index );
+      }
+
+      /// @brief Read the distance from the node `node` back to one of its children.
+      [[nodiscard]] StmtNode::Index read_child( StmtNode::Index node ) noexcept
+      {
+        const auto distance = read_varint();
+        if ( distance == 0 || distance > node ) {
+          failed_ = true;
+          return 0;
+        }
+        return static_cast<StmtNode::Index>( node - distance );
+      }
+    };
+
+    [[nodiscard]] uint64_t fnv1a( type::StrView str, uint64_t hash = 0xcbf29ce484222325 ) noexcept
+    {
+      for ( const auto ch : str )
+        hash = ( hash ^ static_cast<unsigned char>( ch ) ) * 0x100000001b3;
+      return hash;
+    }
+
+    [[nodiscard]] array<char, 32> version_field()
+    {
+      array<char, 32> field {};
+      const auto version = util::format_version();
+      ranges::copy_n( version.data(), min( version.size(), field.size() - 1 ), field.begin() );
+      return field;
+    }
+
+    /// @brief Returns `$XDG_CACHE_HOME/tish` or `$HOME/.cache/tish`, they're created if missing.
+    [[nodiscard]] optional<type::String> cache_directory()
+    {
+      type::String dir;
+      if ( const char* xdg_cache = getenv( "XDG_CACHE_HOME" ); xdg_cache != nullptr
+                                                                 && xdg_cache[0] == '/' )
+        dir = xdg_cache;
+      else if ( const char* home = getenv( "HOME" ); home != nullptr && home[0] == '/' )
+        dir = type::String( home ).append( "/.cache" );
+      else
+        return nullopt;
+
+      if ( mkdir( dir.c_str(), 0700 ) < 0 && errno != EEXIST )
+        return nullopt;
+      dir.append( "/tish" );
+      if ( mkdir( dir.c_str(), 0700 ) < 0 && errno != EEXIST )
+        return nullopt;
+      return dir;
+    }
+
+    /// @brief Check that `size` bytes at `offset` are inside the image.
+    [[nodiscard]] bool in_bounds( uint64_t offset, uint64_t size, size_t image_size ) noexcept
+    {
+      return offset <= image_size && size <= image_size - offset;
+    }
+  } // namespace details
+
+  ScriptCache::ScriptCache( const byte* image,
+                            size_t image_size,
+                            type::String script_path,
+                            type::String cache_path ) noexcept
+    : image_ { image }
+    , image_size_ { image_size }
+    , strings_ {}
+    , cursor_ { nullptr }
+    , end_ { nullptr }
+    , num_statements_ {}
+    , next_ {}
+    , last_ { false }
+    , script_path_ { move( script_path ) }
+    , cache_path_ { move( cache_path ) }
+    , fallback_ { nullptr }
+  {
+    const auto& header = *reinterpret_cast<const Header*>( image_ );
+    strings_        = { reinterpret_cast<const char*>( image_ + header.strings_ ),
+                        static_cast<size_t>( header.strings_size_ ) };
+    cursor_         = image_ + header.statements_;
+    end_            = cursor_ + header.statements_size_;
+    num_statements_ = static_cast<size_t>( header.num_statements_ );
+  }
+
+  ScriptCache::ScriptCache( ScriptCache&& rhs ) noexcept
+    : image_ { exchange( rhs.image_, nullptr ) }
+    , image_size_ { exchange( rhs.image_size_, 0 ) }
+    , strings_ { exchange( rhs.strings_, {} ) }
+    , cursor_ { exchange( rhs.cursor_, nullptr ) }
+    , end_ { exchange( rhs.end_, nullptr ) }
+    , num_statements_ { exchange( rhs.num_statements_, 0 ) }
+    , next_ { exchange( rhs.next_, 0 ) }
+    , last_ { exchange( rhs.last_, false ) }
+    , script_path_ { move( rhs.script_path_ ) }
+    , cache_path_ { move( rhs.cache_path_ ) }
+    , fallback_ { move( rhs.fallback_ ) }
+  {}
+
+  ScriptCache::~ScriptCache() noexcept
+  {
+    if ( image_ != nullptr )
+      munmap( const_cast<byte*>( image_ ), image_size_ );
+  }
+
+  uint32_t ScriptCache::layout() noexcept
+  {
+    return static_cast<uint32_t>( sizeof( Header ) ) | details::format_version << 24;
+  }
+
+  optional<ScriptCache> ScriptCache::map( const type::String& cache_path,
+                                          type::StrView script_path,
+                                          const struct stat& script_stat )
+  {
+    const auto fd = ::open( cache_path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+      return nullopt;
+    struct stat cache_stat;
+    if ( fstat( fd, &cache_stat ) < 0 || !S_ISREG( cache_stat.st_mode )
+         || static_cast<uint64_t>( cache_stat.st_size ) < sizeof( Header ) ) {
+      close( fd );
+      return nullopt;
+    }
+    const auto image_size = static_cast<size_t>( cache_stat.st_size );
+    void* addr            = mmap( nullptr, image_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( addr == MAP_FAILED )
+      return nullopt;
+
+    const auto image      = static_cast<const byte*>( addr );
+    const auto& header    = *static_cast<const Header*>( addr );
+    const auto path_begin = sizeof( Header );
+    if ( header.magic_ != details::cache_magic || header.byte_order_ != details::byte_order
+         || header.layout_ != layout() || header.version_ != details::version_field()
+         || header.script_size_ != static_cast<uint64_t>( script_stat.st_size )
+         || header.mtime_sec_ != script_stat.st_mtim.tv_sec
+         || header.mtime_nsec_ != script_stat.st_mtim.tv_nsec
+         || header.device_ != script_stat.st_dev || header.inode_ != script_stat.st_ino
+         || header.path_size_ != script_path.size()
+         || !details::in_bounds( path_begin, header.path_size_, image_size )
+         || type::StrView( reinterpret_cast<const char*>( image + path_begin ), header.path_size_ )
+              != script_path
+         || header.statements_ < path_begin + header.path_size_
+         || !details::in_bounds( header.statements_, header.statements_size_, image_size )
+         || header.strings_ < header.statements_ + header.statements_size_
+         || !details::in_bounds( header.strings_, header.strings_size_, image_size )
+         || header.strings_size_ >= StmtNode::null_index ) {
+      munmap( addr, image_size );
+      return nullopt;
+    }
+    // Each statement is checked when it's loaded.
+    return ScriptCache( image, image_size, type::String( script_path ), cache_path );
+  }
+
+  void ScriptCache::store( Writer& writer,
+                           StringTable& strings,
+                           const SyntaxTree* tree,
+                           type::StrView diagnostic,
+                           bool last )
+  {
+    const uint8_t flags = ( last ? details::last_statement : 0 )
+                        | ( tree == nullptr ? details::diagnostic : 0 );
+    writer.write_byte( flags );
+    if ( tree == nullptr ) {
+      writer.write_varint( strings.intern( diagnostic ) );
+      writer.write_varint( diagnostic.size() );
+      return;
+    }
+
+    /* Each node is packed into varints: the children as their distances back from the node, which
+     * are short since children are made right before their parents, and the line as the change
+     * from the previous node. The arguments and segments of the nodes are consecutive in the
+     * tree, so only their numbers are kept. */
+    writer.write_varint( tree->nodes_.size() );
+    writer.write_varint( tree->root_ );
+    Index line = 0;
+    for ( Index i = 0; i < tree->nodes_.size(); ++i ) {
+      const auto& node = tree->nodes_[i];
+      writer.write_byte( static_cast<uint8_t>( node.category_ )
+                         | static_cast<uint8_t>( node.expr_type_ ) << 4
+                         | ( node.l_child_ != StmtNode::null_index ? details::has_left : 0 )
+                         | ( node.r_child_ != StmtNode::null_index ? details::has_right : 0 ) );
+      if ( node.l_child_ != StmtNode::null_index )
+        writer.write_varint( i - node.l_child_ );
+      if ( node.r_child_ != StmtNode::null_index )
+        writer.write_varint( i - node.r_child_ );
+      writer.write_varint( node.num_siblings_ );
+      for ( const auto sibling :
+            span( tree->siblings_ ).subspan( node.siblings_, node.num_siblings_ ) )
+        writer.write_varint( i - sibling );
+      writer.write_varint(
+        details::zigzag( static_cast<int64_t>( node.line_ ) - static_cast<int64_t>( line ) ) );
+      line = node.line_;
+
+      if ( node.category_ != StmtNode::StmtKind::atom )
+        continue;
+      if ( node.expr_type_ == ExprNode::ExprKind::value ) {
+        writer.write_varint( details::zigzag( node.value_ ) );
+        continue;
+      }
+      const auto& word = node.word_;
+      writer.write_varint( strings.intern(
+        type::StrView( tree->tokens_ ).substr( word.token_.offset_, word.token_.size_ ) ) );
+      writer.write_varint( word.token_.size_ );
+      writer.write_varint( word.num_segments_ );
+      // The text of a segment is a part of the token of its word.
+      for ( const auto& segment :
+            span( tree->segments_ ).subspan( word.segments_, word.num_segments_ ) ) {
+        writer.write_varint( static_cast<uint64_t>( segment.text_.size_ ) << 2
+                             | static_cast<uint64_t>( segment.kind_ ) );
+        writer.write_varint( segment.text_.offset_ - word.token_.offset_ );
+      }
+    }
+  }
+
+  optional<ScriptCache> ScriptCache::build( const type::String& cache_path,
+                                            type::StrView script_path,
+                                            const struct stat& script_stat )
+  {
+    // The cache is written aside and renamed, so a reader never sees a partial file.
+    const auto temp_path = type::String( cache_path ).append( "." ).append( to_string( getpid() ) );
+    const auto fd = ::open( temp_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+    if ( fd < 0 )
+      return nullopt;
+
+    void* addr        = MAP_FAILED;
+    size_t image_size = 0;
+    try {
+      Header header {};
+      header.magic_       = details::cache_magic;
+      header.byte_order_  = details::byte_order;
+      header.layout_      = layout();
+      header.script_size_ = static_cast<uint64_t>( script_stat.st_size );
+      header.mtime_sec_   = script_stat.st_mtim.tv_sec;
+      header.mtime_nsec_  = script_stat.st_mtim.tv_nsec;
+      header.device_      = script_stat.st_dev;
+      header.inode_       = script_stat.st_ino;
+      header.version_     = details::version_field();
+      header.path_size_   = script_path.size();
+
+      Writer writer( fd );
+      writer.write( &header, sizeof( Header ) );
+      writer.write( script_path.data(), script_path.size() );
+
+      // Statements are parsed exactly like `BaseCLI` does, diagnostics are kept in their order.
+      const type::String script( script_path );
+      Parser prsr( LineBuffer( util::open_source( script.c_str() ) ) );
+      SyntaxTree tree;
+      StringTable strings;
+      header.statements_ = writer.offset();
+      while ( !prsr.empty() ) {
+        const SyntaxTree* parsed = addressof( tree );
+        type::String diagnostic;
+        try {
+          prsr.parse( tree );
+        } catch ( const error::SystemCallError& ) {
+          throw;
+        } catch ( const error::TraceBack& e ) {
+          parsed     = nullptr;
+          diagnostic = e.what();
+        }
+        store( writer, strings, parsed, diagnostic, prsr.exhausted() );
+        ++header.num_statements_;
+      }
+      header.statements_size_ = writer.offset() - header.statements_;
+
+      header.strings_      = writer.offset();
+      header.strings_size_ = strings.text().size();
+      writer.write( strings.text().data(), strings.text().size() );
+      writer.flush();
+      image_size = static_cast<size_t>( writer.offset() );
+
+      if ( pwrite( fd, &header, sizeof( Header ), 0 ) != static_cast<ssize_t>( sizeof( Header ) ) )
+        throw error::SystemCallError( "pwrite" );
+      addr = mmap( nullptr, image_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( addr == MAP_FAILED || rename( temp_path.c_str(), cache_path.c_str() ) < 0 )
+        throw error::SystemCallError( "ScriptCache" );
+    } catch ( const error::TraceBack& ) {
+      // The script is run from its source instead, which reports any error of its own.
+      if ( addr != MAP_FAILED )
+        munmap( addr, image_size );
+      close( fd );
+      unlink( temp_path.c_str() );
+      return nullopt;
+    }
+    close( fd );
+    return ScriptCache(
+      static_cast<const byte*>( addr ), image_size, type::String( script_path ), cache_path );
+  }
+
+  optional<ScriptCache> ScriptCache::open( const char* script )
+  {
+    struct stat script_stat;
+    if ( stat( script, &script_stat ) < 0 || !S_ISREG( script_stat.st_mode )
+         || static_cast<size_t>( script_stat.st_size ) < _min_script_size )
+      return nullopt;
+
+    const unique_ptr<char, decltype( &free )> real_path( realpath( script, nullptr ), &free );
+    const auto cache_dir = details::cache_directory();
+    if ( real_path == nullptr || !cache_dir.has_value() )
+      return nullopt;
+
+    // The name of the cache file is derived from both the script and the version of tish.
+    const type::StrView real_script { real_path.get(), strlen( real_path.get() ) + 1 };
+    array<char, 16> name {};
+    const auto name_end =
+      to_chars( name.data(),
+                name.data() + name.size(),
+                details::fnv1a( util::format_version(), details::fnv1a( real_script ) ),
+                16 )
+        .ptr;
+    const auto cache_path = type::String( *cache_dir )
+                              .append( "/" )
+                              .append( name.data(), name_end )
+                              .append( ".tishc" );
+
+    if ( auto cache = map( cache_path, real_path.get(), script_stat ); cache.has_value() )
+      return cache;
+    return build( cache_path, real_path.get(), script_stat );
+  }
+
+  bool ScriptCache::empty() const noexcept
+  {
+    return fallback_ != nullptr ? fallback_->empty() : next_ == num_statements_;
+  }
+
+  bool ScriptCache::exhausted() const noexcept
+  {
+    return fallback_ != nullptr ? fallback_->exhausted() : last_;
+  }
+
+  optional<type::StrView> ScriptCache::load( SyntaxTree& tree ) noexcept( false )
+  {
+    assert( !empty() );
+    if ( fallback_ == nullptr ) {
+      ++next_;
+      tree.reset();
+      if ( optional<type::StrView> diagnostic; unpack( tree, diagnostic ) )
+        return diagnostic;
+      tree.reset();
+      fall_back();
+    }
+
+    fallback_->parse( tree );
+    return nullopt;
+  }
+
+  bool ScriptCache::unpack( SyntaxTree& tree, optional<type::StrView>& diagnostic )
+  {
+    details::PackedReader reader( cursor_, end_ );
+    const auto flags = reader.read_byte();
+    if ( ( flags & details::diagnostic ) != 0 ) {
+      const auto offset = reader.read_index( strings_.size() + 1 );
+      const auto size   = reader.read_index( strings_.size() - offset + 1 );
+      if ( reader.failed() )
+        return false;
+      diagnostic = strings_.substr( offset, size );
+    } else {
+      const auto num_nodes = reader.read_count();
+      tree.root_           = reader.read_index();
+      Index line           = 0;
+      for ( Index i = 0; i < num_nodes && !reader.failed(); ++i ) {
+        const auto kinds = reader.read_byte();
+        auto& node       = tree.nodes_.emplace_back();
+        node.category_   = static_cast<StmtNode::StmtKind>( kinds & 0x0f );
+        node.expr_type_  = static_cast<ExprNode::ExprKind>( kinds >> 4 & 0x03 );
+        node.l_child_ =
+          ( kinds & details::has_left ) != 0 ? reader.read_child( i ) : StmtNode::null_index;
+        node.r_child_ =
+          ( kinds & details::has_right ) != 0 ? reader.read_child( i ) : StmtNode::null_index;
+        node.siblings_     = static_cast<Index>( tree.siblings_.size() );
+        node.num_siblings_ = reader.read_count();
+        for ( Index j = 0; j < node.num_siblings_ && !reader.failed(); ++j )
+          tree.siblings_.push_back( reader.read_child( i ) );
+        line       = static_cast<Index>( line + details::unzigzag( reader.read_varint() ) );
+        node.line_ = line;
+
+        if ( node.category_ != StmtNode::StmtKind::atom )
+          continue;
+        if ( node.expr_type_ == ExprNode::ExprKind::value ) {
+          node.value_ = static_cast<type::Eval>( details::unzigzag( reader.read_varint() ) );
+          continue;
+        }
+        auto& word         = node.word_;
+        word.token_        = { .offset_ = reader.read_index(), .size_ = reader.read_index() };
+        word.segments_     = static_cast<Index>( tree.segments_.size() );
+        word.num_segments_ = reader.read_count();
+        for ( Index j = 0; j < word.num_segments_ && !reader.failed(); ++j ) {
+          const auto kind_size = reader.read_varint();
+          const auto offset    = reader.read_index( StmtNode::null_index - word.token_.offset_ );
+          tree.segments_.push_back(
+            { .kind_ = static_cast<ExprNode::Segment::Kind>( kind_size & 0x03 ),
+              .text_ = { .offset_ = word.token_.offset_ + offset,
+                         .size_   = static_cast<Index>( kind_size >> 2 ) } } );
+        }
+      }
+      if ( reader.failed() )
+        return false;
+      // The text is read from the string table, which the tree doesn't own.
+      tree.view_ = { tree.nodes_, tree.siblings_, tree.segments_, strings_ };
+      if ( !verify( tree ) )
+        return false;
+    }
+
+    cursor_ = reader.position();
+    last_   = ( flags & details::last_statement ) != 0;
+    return true;
+  }
+
+  void ScriptCache::fall_back()
+  {
+    // Nothing more is loaded from the cache, even if the script can't be opened.
+    const auto num_loaded = exchange( next_, num_statements_ );
+    // The next run rebuilds the cache.
+    unlink( cache_path_.c_str() );
+
+    fallback_ = make_unique<Parser>( LineBuffer( util::open_source( script_path_.c_str() ) ) );
+    // The statements before the damaged one have run, they're skipped the way `build` counts them.
+    SyntaxTree skipped;
+    for ( size_t i = 1; i < num_loaded && !fallback_->empty(); ++i ) {
+      try {
+        fallback_->parse( skipped );
+      } catch ( const error::SystemCallError& ) {
+        throw;
+      } catch ( const error::TraceBack& ) {
+      }
+    }
+    if ( fallback_->empty() )
+      throw error::RuntimeError( "ScriptCache: the script is changed while it runs" );
+  }
+
+  bool ScriptCache::verify( const SyntaxTree& tree ) noexcept
+  {
+    const auto& [nodes, siblings, segments, tokens] = tree.view_;
+    // A token must be followed by its '\0'.
+    const auto valid_text = [&tokens]( SyntaxTree::TokenRef text, bool terminated ) noexcept {
+      return static_cast<uint64_t>( text.offset_ ) + text.size_ + terminated <= tokens.size()
+          && ( !terminated || tokens[text.offset_ + text.size_] == '\0' );
+    };
+
+    // Whether the node at `index` is an atom holding a value, or a word if `value` is false.
+    const auto is_atom = [&nodes]( Index index, bool value ) noexcept {
+      return nodes[index].category_ == StmtNode::StmtKind::atom
+          && ( nodes[index].expr_type_ == ExprNode::ExprKind::value ) == value;
+    };
+    /* The children and arguments of every kind of statement, they are what the lowering and the
+     * interpreter take for granted. The indices are known to be in range here. */
+    const auto valid_shape = [&]( const SyntaxTree::Node& node ) noexcept {
+      const bool has_left  = node.l_child_ != StmtNode::null_index;
+      const bool has_right = node.r_child_ != StmtNode::null_index;
+      const auto args      = siblings.subspan( node.siblings_, node.num_siblings_ );
+      if ( node.category_ != StmtNode::StmtKind::atom
+           && node.expr_type_ != ExprNode::ExprKind::value )
+        return false;
+
+      switch ( node.category_ ) {
+      case StmtNode::StmtKind::atom: {
+        if ( has_left || has_right )
+          return false;
+        // Only a command has arguments, and each of them is a word.
+        if ( node.expr_type_ != ExprNode::ExprKind::command )
+          return args.empty();
+        return ranges::all_of( args, [&is_atom]( Index arg ) { return is_atom( arg, false ); } );
+      }
+      case StmtNode::StmtKind::sequential:  [[fallthrough]];
+      case StmtNode::StmtKind::logical_not: [[fallthrough]];
+      case StmtNode::StmtKind::background:  {
+        return has_left && ( node.category_ == StmtNode::StmtKind::sequential || !has_right )
+            && args.empty();
+      }
+      case StmtNode::StmtKind::logical_and: [[fallthrough]];
+      case StmtNode::StmtKind::logical_or:  {
+        return has_left && has_right && args.empty();
+      }
+      case StmtNode::StmtKind::pipeline: {
+        return !has_left && !has_right && args.size() >= 2;
+      }
+      case StmtNode::StmtKind::timed: {
+        return has_left && !has_right && args.size() == 1 && is_atom( args[0], true )
+            && static_cast<uint64_t>( nodes[args[0]].value_ )
+                 <= static_cast<uint64_t>( util::Timing::Format::json );
+      }
+      // A redirection may have no statement to redirect, e.g. `> file`.
+      case StmtNode::StmtKind::ovrwrit_redrct: [[fallthrough]];
+      case StmtNode::StmtKind::appnd_redrct:   {
+        return !has_right && args.size() == 2 && is_atom( args[0], true )
+            && is_atom( args[1], false );
+      }
+      case StmtNode::StmtKind::merge_output: [[fallthrough]];
+      case StmtNode::StmtKind::merge_appnd:  [[fallthrough]];
+      case StmtNode::StmtKind::stdin_redrct: {
+        return !has_right && args.size() == 1 && is_atom( args[0], false );
+      }
+      case StmtNode::StmtKind::merge_stream: {
+        return !has_right && args.size() == 2 && is_atom( args[0], true )
+            && is_atom( args[1], true );
+      }
+      default: return false;
+      }
+    };
+
+    if ( tree.root_ >= nodes.size() )
+      return false;
+    for ( size_t i = 0; i < nodes.size(); ++i ) {
+      const auto& node = nodes[i];
+      // Children are always made before their parents, so this also rules out cycles.
+      if ( node.category_ > StmtNode::StmtKind::timed
+           || node.expr_type_ > ExprNode::ExprKind::value
+           || ( node.l_child_ != StmtNode::null_index && node.l_child_ >= i )
+           || ( node.r_child_ != StmtNode::null_index && node.r_child_ >= i )
+           || static_cast<uint64_t>( node.siblings_ ) + node.num_siblings_ > siblings.size()
+           || ranges::any_of( siblings.subspan( node.siblings_, node.num_siblings_ ),
+                              [i]( Index sibling ) { return sibling >= i; } )
+           || !valid_shape( node ) )
+        return false;
+      if ( node.category_ != StmtNode::StmtKind::atom
+           || node.expr_type_ == ExprNode::ExprKind::value )
+        continue;
+
+      const auto& word = node.word_;
+      if ( !valid_text( word.token_, true )
+           || static_cast<uint64_t>( word.segments_ ) + word.num_segments_ > segments.size()
+           || ranges::any_of( segments.subspan( word.segments_, word.num_segments_ ),
+                              [&valid_text]( const SyntaxTree::SegmentRef& segment ) {
+                                return segment.kind_ > ExprNode::Segment::Kind::home_dir
+                                    || !valid_text( segment.text_, false );
+                              } ) )
+        return false;
+    }
+    return true;
+  }
+} // namespace tish
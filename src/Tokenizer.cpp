@@ -1,21 +1,185 @@
 #include <Tokenizer.hpp>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cstdio>
 #include <util/Exception.hpp>
+#include <util/Metrics.hpp>
+#include <util/Tracer.hpp>
+#if defined( __AVX2__ )
+# include <immintrin.h>
+#elif defined( __SSE2__ )
+# include <emmintrin.h>
+#endif
 using namespace std;
 
 namespace tish {
+  namespace details {
+    enum CharClass : uint8_t {
+      blank     = 1 << 0, // whitespace except the line break
+      digit     = 1 << 1,
+      delimiter = 1 << 2, // characters which terminate a command token
+      reserved  = 1 << 3, // characters which can not start any token
+    };
+
+    /// @brief Character classes indexed by the byte value, it does not depend on the locale.
+    constexpr array<uint8_t, 256> char_classes = []() {
+      array<uint8_t, 256> table {};
+      for ( const unsigned char ch : " \t\v\f\r"sv )
+        table[ch] |= blank | delimiter;
+      for ( const unsigned char ch : "0123456789"sv )
+        table[ch] |= digit;
+      for ( const unsigned char ch : "\n&|!<>\"';:()^#"sv )
+        table[ch] |= delimiter;
+      for ( const unsigned char ch : "':^"sv )
+        table[ch] |= reserved;
+      return table;
+    }();
+
+    [[nodiscard]] constexpr bool is( type::Char character, CharClass cls ) noexcept
+    {
+      return char_classes[static_cast<unsigned char>( character )] & cls;
+    }
+
+#if defined( __AVX2__ ) || defined( __SSE2__ )
+# define TISH_SIMD_SCAN 1
+    struct Simd {
+# if defined( __AVX2__ )
+      using Vec = __m256i;
+      static Vec load( const char* ptr ) noexcept
+      {
+        return _mm256_loadu_si256( reinterpret_cast<const Vec*>( ptr ) );
+      }
+      static Vec splat( char ch ) noexcept { return _mm256_set1_epi8( ch ); }
+      static Vec eq( Vec a, Vec b ) noexcept { return _mm256_cmpeq_epi8( a, b ); }
+      static Vec max( Vec a, Vec b ) noexcept { return _mm256_max_epu8( a, b ); }
+      static Vec min( Vec a, Vec b ) noexcept { return _mm256_min_epu8( a, b ); }
+      static Vec either( Vec a, Vec b ) noexcept { return _mm256_or_si256( a, b ); }
+      static uint32_t mask( Vec a ) noexcept
+      {
+        return static_cast<uint32_t>( _mm256_movemask_epi8( a ) );
+      }
+# else
+      using Vec = __m128i;
+      static Vec load( const char* ptr ) noexcept
+      {
+        return _mm_loadu_si128( reinterpret_cast<const Vec*>( ptr ) );
+      }
+      static Vec splat( char ch ) noexcept { return _mm_set1_epi8( ch ); }
+      static Vec eq( Vec a, Vec b ) noexcept { return _mm_cmpeq_epi8( a, b ); }
+      static Vec max( Vec a, Vec b ) noexcept { return _mm_max_epu8( a, b ); }
+      static Vec min( Vec a, Vec b ) noexcept { return _mm_min_epu8( a, b ); }
+      static Vec either( Vec a, Vec b ) noexcept { return _mm_or_si128( a, b ); }
+      static uint32_t mask( Vec a ) noexcept
+      {
+        return static_cast<uint32_t>( _mm_movemask_epi8( a ) );
+      }
+# endif
+      static constexpr size_t width = sizeof( Vec );
+
+      /// @brief Bytes that are less than or equal to `bound` (unsigned).
+      static Vec at_most( Vec a, char bound ) noexcept
+      {
+        return eq( max( a, splat( bound ) ), splat( bound ) );
+      }
+      /// @brief Bytes within [`lower`, `upper`] (unsigned).
+      static Vec within( Vec a, char lower, char upper ) noexcept
+      {
+        return eq( min( max( a, splat( lower ) ), splat( upper ) ), a );
+      }
+    };
+#endif
+
+    /// @brief Returns the position of the first character in `str` that satisfies `pred`,
+    /// or the size of `str` if there is none.
+    /// @param candidates A vectorized superset test of `pred`, each byte it marks is rechecked with
+    /// `pred`.
+    template<typename Pred, typename Candidates>
+    [[nodiscard]] size_t find_first( type::StrView str,
+                                     Pred pred,
+                                     [[maybe_unused]] Candidates candidates ) noexcept
+    {
+      size_t pos = 0;
+#ifdef TISH_SIMD_SCAN
+      for ( ; pos + Simd::width <= str.size(); pos += Simd::width ) {
+        for ( auto mask = Simd::mask( candidates( Simd::load( str.data() + pos ) ) ); mask != 0;
+              mask &= mask - 1 ) {
+          if ( const auto found = pos + countr_zero( mask ); pred( str[found] ) )
+            return found;
+        }
+      }
+#endif
+      while ( pos < str.size() && !pred( str[pos] ) )
+        ++pos;
+      return pos;
+    }
+
+    /// @brief Returns the length of the command characters at the beginning of `str`.
+    [[nodiscard]] size_t command_length( type::StrView str ) noexcept
+    {
+      return find_first(
+        str,
+        []( char ch ) noexcept { return is( ch, delimiter ); },
+        []<typename Vec>( Vec chars ) noexcept {
+#ifdef TISH_SIMD_SCAN
+          /* All delimiters are either not greater than ')', within [':', '>'], or one of '^' and
+           * '|'. Some command characters such as '$' and '=' also fall in these ranges, which are
+           * filtered out by the scalar check later. */
+          return Simd::either(
+            Simd::either( Simd::at_most( chars, ')' ), Simd::within( chars, ':', '>' ) ),
+            Simd::either( Simd::eq( chars, Simd::splat( '^' ) ),
+                          Simd::eq( chars, Simd::splat( '|' ) ) ) );
+#else
+          return chars;
+#endif
+        } );
+    }
+
+    /// @brief Returns the length of the string body at the beginning of `str`.
+    [[nodiscard]] size_t string_length( type::StrView str ) noexcept
+    {
+      return find_first(
+        str,
+        []( char ch ) noexcept { return ch == '"' || ch == '\n'; },
+        []<typename Vec>( Vec chars ) noexcept {
+#ifdef TISH_SIMD_SCAN
+          return Simd::either( Simd::eq( chars, Simd::splat( '"' ) ),
+                               Simd::eq( chars, Simd::splat( '\n' ) ) );
+#else
+          return chars;
+#endif
+        } );
+    }
+
+    /// @brief Returns the length of the comment body at the beginning of `str`.
+    [[nodiscard]] size_t comment_length( type::StrView str ) noexcept
+    {
+      return find_first(
+        str,
+        []( char ch ) noexcept { return ch == '\n'; },
+        []<typename Vec>( Vec chars ) noexcept {
+#ifdef TISH_SIMD_SCAN
+          return Simd::eq( chars, Simd::splat( '\n' ) );
+#else
+          return chars;
+#endif
+        } );
+    }
+  } // namespace details
+
   void LineBuffer::swap_members( LineBuffer&& rhs ) noexcept
   {
     using std::swap;
     swap( received_eof_, rhs.received_eof_ );
     swap( line_pos_, rhs.line_pos_ );
+    swap( line_no_, rhs.line_no_ );
     swap( line_input_, rhs.line_input_ );
   }
 
   LineBuffer& LineBuffer::operator=( LineBuffer&& rhs ) noexcept
   {
     using std::swap;
-    swap( input_stream_, rhs.input_stream_ );
+    swap( source_, rhs.source_ );
     swap_members( move( rhs ) );
     return *this;
   }
@@ -28,12 +192,15 @@ namespace tish {
 
   type::Char LineBuffer::peek()
   {
-    assert( input_stream_ != nullptr );
+    assert( source_ != nullptr );
     if ( line_pos_ >= line_input_.size() ) {
       clear();
 
-      getline( *input_stream_, line_input_ );
-      if ( input_stream_->eof() ) {
+      util::TraceSpan span( "read line", "tokenize" );
+      const auto [line, complete] = source_->getline();
+      line_input_.assign( line );
+      ++line_no_;
+      if ( !complete ) {
         if ( received_eof_ )
           throw error::StreamClosed();
         else
@@ -42,7 +209,7 @@ namespace tish {
         line_input_.push_back( EOF );
       } else {
         received_eof_ = false;
-        // `getline` always discards the line break
+        // the source always discards the line break
         // but line break is a syntactic token, thus we need push a new one.
         line_input_.push_back( '\n' );
       }
@@ -56,6 +223,12 @@ namespace tish {
     ++line_pos_;
   }
 
+  void LineBuffer::consume( size_t num_chars ) noexcept
+  {
+    assert( line_pos_ + num_chars <= line_input_.size() );
+    line_pos_ += num_chars;
+  }
+
   void LineBuffer::backtrack( size_t num_chars ) noexcept
   {
     line_pos_ = line_pos_ <= num_chars ? 0 : line_pos_ - num_chars;
@@ -79,19 +252,21 @@ namespace tish {
 
   Tokenizer::Token& Tokenizer::peek()
   {
-    if ( !current_token_.has_value() )
+    if ( !current_token_.has_value() ) {
       current_token_ = next();
+      util::Metrics::inst().add( util::Metrics::Counter::tokens );
+    }
 
     return *current_token_;
   }
 
-  type::String Tokenizer::consume( TokenKind expect )
+  type::StrView Tokenizer::consume( TokenKind expect )
   {
     assert( current_token_.has_value() );
     if ( current_token_->is( expect ) ) {
-      type::String discard_tokens = move( current_token_->value_ );
+      const auto discard_token = text( *current_token_ );
       current_token_.reset();
-      return discard_tokens;
+      return discard_token;
     }
     throw error::SyntaxError( line_buf_.line_pos(),
                               line_buf_.context(),
@@ -102,7 +277,16 @@ namespace tish {
   Tokenizer::Token Tokenizer::next()
   {
     Token new_token;
-    auto& [token_str, token_type] = new_token;
+    auto& [token_type, token_offset, token_length] = new_token;
+
+    /* The characters of a token are always contiguous in the line, so only the position of the
+     * first saved character and the number of saved characters are recorded. */
+    const auto save_chars = [&]( size_t num_chars ) noexcept {
+      if ( token_length == 0 )
+        token_offset = line_buf_.line_pos();
+      assert( token_offset + token_length == line_buf_.line_pos() );
+      token_length += num_chars;
+    };
 
     enum class StateType : uint8_t {
       START,
@@ -111,7 +295,7 @@ namespace tish {
       INCMD,
       INDIGIT,
       INSTR, // "string"
-      INAND, // &&, &>
+      INAND, // &&, &>, &
       INMEG_OUTPUT,
       INMEG_STREAM, // &>, >&
       INPIPE_LIKE,  // ||, |
@@ -120,21 +304,23 @@ namespace tish {
 
     for ( StateType state = StateType::START; state != StateType::DONE; ) {
       const auto character = line_buf_.peek();
+      // Any byte may appear in the input, so the end of it is told by the position.
+      const bool end_of_input = line_buf_.at_end();
       bool save_char = true, discard_char = true;
 
       switch ( state ) {
       case StateType::START: {
-        if ( character != '\n' && isspace( character ) )
+        if ( end_of_input ) {
+          save_char  = false;
+          token_type = TokenKind::ENDFILE;
+          state      = StateType::DONE;
+        } else if ( details::is( character, details::blank ) )
           save_char = false;
-        else if ( isdigit( character ) )
+        else if ( details::is( character, details::digit ) )
           state = StateType::INDIGIT;
         else {
           state = StateType::DONE;
           switch ( character ) {
-          case EOF: {
-            save_char  = false;
-            token_type = TokenKind::ENDFILE;
-          } break;
           case '\0': [[fallthrough]];
           case '\n': {
             token_type = TokenKind::NEWLINE;
@@ -172,7 +358,7 @@ namespace tish {
             token_type = TokenKind::RPAREN;
           } break;
           default: {
-            if ( ( "':^%"sv ).find( character ) != type::StrView::npos )
+            if ( details::is( character, details::reserved ) )
               throw error::TokenError( line_buf_.line_pos(),
                                        line_buf_.context(),
                                        "any valid command character"sv,
@@ -189,16 +375,23 @@ namespace tish {
         if ( character == '\n' ) {
           token_type = TokenKind::NEWLINE;
           state      = StateType::DONE;
-        } else if ( character == EOF ) {
+        } else if ( end_of_input ) {
           token_type = TokenKind::ENDFILE;
           state      = StateType::DONE;
+        } else {
+          // skip the rest of the comment at once
+          line_buf_.consume( details::comment_length( line_buf_.remaining() ) );
+          discard_char = false;
         }
       } break;
 
       case StateType::INCMD: {
-        if ( isspace( character )
-             || ( "&|!<>\"';:()^%#"sv ).find( character ) != type::StrView::npos ) {
-          if ( token_str.empty() ) {
+        // `$!` is the only variable whose name is a delimiter.
+        if ( character == '!' && token_length > 0
+             && line_buf_.context()[line_buf_.line_pos() - 1] == '$' )
+          break;
+        if ( end_of_input || details::is( character, details::delimiter ) ) {
+          if ( token_length == 0 ) {
             throw error::TokenError( line_buf_.line_pos(),
                                      line_buf_.context(),
                                      "any valid command character"sv,
@@ -207,13 +400,20 @@ namespace tish {
           token_type = TokenKind::CMD;
           save_char  = ( discard_char = false );
           state      = StateType::DONE;
+        } else {
+          // the whole run of command characters is taken in one step
+          const auto run        = line_buf_.remaining();
+          const auto run_length = details::command_length( run );
+          save_chars( run_length );
+          line_buf_.consume( run_length );
+          save_char = ( discard_char = false );
         }
       } break;
 
       case StateType::INDIGIT: {
         if ( character == '>' ) // get (\d+)>, expecting '&' or '>'
           state = StateType::INRARR;
-        else if ( !isdigit( character ) ) { // get (\d+), then expecting CMD
+        else if ( !details::is( character, details::digit ) ) { // get (\d+), then expecting CMD
                                             // characters
           save_char = ( discard_char = false );
           state     = StateType::INCMD;
@@ -225,8 +425,15 @@ namespace tish {
           save_char  = false;
           token_type = TokenKind::STR;
           state      = StateType::DONE;
-        } else if ( ( "\n"sv ).find( character ) != type::StrView::npos || character == EOF )
+        } else if ( character == '\n' || end_of_input )
           throw error::TokenError( line_buf_.line_pos(), line_buf_.context(), '"', character );
+        else {
+          const auto run        = line_buf_.remaining();
+          const auto run_length = details::string_length( run );
+          save_chars( run_length );
+          line_buf_.consume( run_length );
+          save_char = ( discard_char = false );
+        }
       } break;
 
       case StateType::INAND: {
@@ -236,9 +443,10 @@ namespace tish {
         } else if ( character == '>' )
           state = StateType::INMEG_OUTPUT; // get &>, still expecting '>' or
                                            // nothing
-        else {
-          token_type = TokenKind::ERROR;
-          throw error::TokenError( line_buf_.line_pos(), line_buf_.context(), '&', character );
+        else { // get &, done
+          save_char  = ( discard_char = false );
+          state      = StateType::DONE;
+          token_type = TokenKind::AMP;
         }
       } break;
 
@@ -254,7 +462,7 @@ namespace tish {
 
       case StateType::INMEG_STREAM: { // get (\d*)>&, expecting (\d*) or
                                       // nothing
-        if ( !isdigit( character ) ) {
+        if ( !details::is( character, details::digit ) ) {
           save_char  = ( discard_char = false );
           token_type = TokenKind::MERG_STREAM;
           state      = StateType::DONE;
@@ -291,7 +499,7 @@ namespace tish {
       }
 
       if ( save_char )
-        token_str.push_back( character );
+        save_chars( 1 );
       if ( discard_char )
         line_buf_.consume();
     }
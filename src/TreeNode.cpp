@@ -0,0 +1,112 @@
+#include <TreeNode.hpp>
+#include <algorithm>
+#include <iterator>
+#include <util/Exception.hpp>
+#include <util/Metrics.hpp>
+using namespace std;
+
+namespace tish {
+  void SyntaxTree::reset() noexcept
+  {
+    nodes_.clear();
+    siblings_.clear();
+    segments_.clear();
+    tokens_.clear();
+    root_ = StmtNode::null_index;
+    sync();
+  }
+
+  SyntaxTree::Index SyntaxTree::push( StmtNode::StmtKind stmt_type,
+                                      ExprNode::ExprKind expr_type,
+                                      Index left_stmt,
+                                      Index right_stmt,
+                                      span<const Index> siblings )
+  {
+    if ( nodes_.size() >= StmtNode::null_index
+         || siblings_.size() + siblings.size() >= StmtNode::null_index ) [[unlikely]]
+      throw error::RuntimeError( "SyntaxTree: too many nodes in a single statement" );
+
+    const auto line = left_stmt != StmtNode::null_index ? nodes_[left_stmt].line_
+                    : !siblings.empty()                 ? nodes_[siblings.front()].line_
+                                                        : line_;
+    nodes_.push_back( { .category_     = stmt_type,
+                        .expr_type_    = expr_type,
+                        .l_child_      = left_stmt,
+                        .r_child_      = right_stmt,
+                        .siblings_     = static_cast<Index>( siblings_.size() ),
+                        .num_siblings_ = static_cast<Index>( siblings.size() ),
+                        .line_         = line,
+                        .value_        = {} } );
+    ranges::copy( siblings, back_inserter( siblings_ ) );
+    sync();
+    util::Metrics::inst().add( util::Metrics::Counter::nodes );
+    return static_cast<Index>( nodes_.size() - 1 );
+  }
+
+  SyntaxTree::TokenRef SyntaxTree::intern( type::StrView token )
+  {
+    if ( tokens_.size() + token.size() >= StmtNode::null_index ) [[unlikely]]
+      throw error::RuntimeError( "SyntaxTree: statement is too long" );
+
+    const TokenRef ref { static_cast<Index>( tokens_.size() ), static_cast<Index>( token.size() ) };
+    tokens_.append( token ).push_back( '\0' );
+    sync();
+    return ref;
+  }
+
+  SyntaxTree::Index SyntaxTree::make_stmt( StmtNode::StmtKind stmt_type,
+                                           Index left_stmt,
+                                           Index right_stmt,
+                                           span<const Index> siblings )
+  {
+    assert( stmt_type != StmtNode::StmtKind::atom );
+    return push( stmt_type, ExprNode::ExprKind::value, left_stmt, right_stmt, siblings );
+  }
+
+  SyntaxTree::Index SyntaxTree::make_expr( ExprNode::ExprKind expr_type,
+                                           type::StrView token,
+                                           span<const ExprNode::Segment> segments,
+                                           span<const Index> siblings )
+  {
+    if ( expr_type == ExprNode::ExprKind::value ) [[unlikely]]
+      throw error::RuntimeError(
+        "SyntaxTree: The parameter `token` does not match the type annotation `expr_type`" );
+    if ( segments_.size() + segments.size() >= StmtNode::null_index ) [[unlikely]]
+      throw error::RuntimeError( "SyntaxTree: too many nodes in a single statement" );
+
+    const auto token_ref = intern( token );
+    const auto first_seg = static_cast<Index>( segments_.size() );
+    for ( const auto& segment : segments ) {
+      // Segments share the text of the token instead of interning their own copies.
+      assert( segment.text_.empty()
+              || ( segment.text_.data() >= token.data()
+                   && segment.text_.data() + segment.text_.size()
+                        <= token.data() + token.size() ) );
+      const auto offset = segment.text_.empty() ? 0 : segment.text_.data() - token.data();
+      segments_.push_back( { .kind_ = segment.kind_,
+                             .text_ = { static_cast<Index>( token_ref.offset_ + offset ),
+                                        static_cast<Index>( segment.text_.size() ) } } );
+    }
+
+    const auto index    = push( StmtNode::StmtKind::atom,
+                             expr_type,
+                             StmtNode::null_index,
+                             StmtNode::null_index,
+                             siblings );
+    nodes_[index].word_ = { .token_        = token_ref,
+                            .segments_     = first_seg,
+                            .num_segments_ = static_cast<Index>( segments.size() ) };
+    return index;
+  }
+
+  SyntaxTree::Index SyntaxTree::make_value( type::Eval value )
+  {
+    const auto index     = push( StmtNode::StmtKind::atom,
+                             ExprNode::ExprKind::value,
+                             StmtNode::null_index,
+                             StmtNode::null_index,
+                             {} );
+    nodes_[index].value_ = value;
+    return index;
+  }
+} // namespace tish
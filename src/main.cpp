@@ -1,11 +1,16 @@
 #include <CLI.hpp>
 #include <Parser.hpp>
-#include <fstream>
+#include <ScriptCache.hpp>
+#include <cstdlib>
+#include <memory>
 #include <span>
-#include <unistd.h>
+#include <thread>
 #include <util/Exception.hpp>
+#include <util/InputSource.hpp>
 #include <util/Logger.hpp>
-#include <util/Pipe.hpp>
+#include <util/Metrics.hpp>
+#include <util/Profiler.hpp>
+#include <util/Tracer.hpp>
 #include <util/Util.hpp>
 using namespace std;
 
@@ -13,7 +18,37 @@ int main( int argc, char** argv )
 {
   if ( argc == 0 )
     abort();
-  else if ( argc == 1 )
+
+  // The metrics of the shell are written to the file on exit.
+  if ( const char* metrics_file = getenv( "TISH_METRICS_FILE" );
+       metrics_file != nullptr && metrics_file[0] != '\0' )
+    tish::util::Metrics::inst().export_to( metrics_file );
+
+  /* The options of the shell itself precede all other arguments.
+   * `--trace=file` records the execution into the file, and `--profile` reports the cost of each
+   * line of the script to the standard error, or to the file of `--profile=file`, on exit. */
+  while ( argc > 1 ) {
+    constexpr auto trace_option = "--trace="sv, profile_option = "--profile"sv;
+    const tish::type::StrView option = argv[1];
+    if ( option.starts_with( trace_option ) ) {
+      if ( !tish::util::Tracer::inst().open( argv[1] + trace_option.size() ) ) {
+        tish::iout::logger.print( tish::error::SystemCallError( argv[1] + trace_option.size() ) );
+        return EXIT_FAILURE;
+      }
+    } else if ( option == profile_option || option.starts_with( "--profile="sv ) ) {
+      const auto path = option == profile_option ? nullptr : argv[1] + profile_option.size() + 1;
+      if ( !tish::util::Profiler::inst().open( path ) ) {
+        tish::iout::logger.print( tish::error::SystemCallError( path ) );
+        return EXIT_FAILURE;
+      }
+    } else
+      break;
+    argv[1] = argv[0];
+    ++argv;
+    --argc;
+  }
+
+  if ( argc == 1 )
     return tish::cli::CLI().run();
 
   if ( "-c"sv == argv[1] || argc > 2 ) {
@@ -23,23 +58,36 @@ int main( int argc, char** argv )
       return EXIT_FAILURE;
     }
 
-    tish::util::Pipe pipe;
-    tish::util::rebind_fd( pipe.reader().get(), STDIN_FILENO );
+    tish::type::String script;
     ranges::for_each(
       "-c"sv == argv[1] ? span( argv + 2, argc - 2 ) : span( argv + 1, argc - 1 ),
-      [&writer = pipe.writer()]( const auto e ) noexcept { writer.push( e ).push( ' ' ); } );
-    pipe.writer().push( '\n' );
-    pipe.writer().close();
-    return tish::cli::BaseCLI().run();
+      [&script]( const auto e ) { script.append( e ).push_back( ' ' ); } );
+    script.push_back( '\n' );
+    if ( tish::util::Profiler::enabled() )
+      tish::util::Profiler::inst().script_text( script );
+    auto source = make_unique<tish::util::StringSource>( move( script ) );
+    return tish::cli::BaseCLI( tish::Parser( tish::LineBuffer( move( source ) ) ) ).run();
   } else if ( "-v"sv == argv[1] || "--version"sv == argv[1] ) {
     tish::iout::prmptr << format( "tish, version {}\n", tish::util::format_version() );
     return EXIT_SUCCESS;
   } else {
-    ifstream ifs { argv[1] };
-    if ( !ifs ) {
-      tish::iout::logger.print( tish::error::SystemCallError( format( "tish: {}", argv[1] ) ) );
+    if ( tish::util::Profiler::enabled() )
+      tish::util::Profiler::inst().script_file( argv[1] );
+    // Large scripts are run from their precompiled statements.
+    if ( auto cache = tish::ScriptCache::open( argv[1] ); cache.has_value() )
+      return tish::cli::CachedCLI( move( *cache ) ).run();
+
+    unique_ptr<tish::util::InputSource> source;
+    try {
+      source = tish::util::open_source( argv[1] );
+    } catch ( const tish::error::SystemCallError& e ) {
+      tish::iout::logger.print( e );
       return EXIT_FAILURE;
     }
-    return tish::cli::BaseCLI( tish::Parser( ifs ) ).run();
+    /* A script which can be read without waiting is parsed ahead of its evaluation, which only
+     * pays off if the parser has a processor of its own. */
+    if ( !source->may_block() && thread::hardware_concurrency() > 1 )
+      return tish::cli::PipelinedCLI( tish::Parser( tish::LineBuffer( move( source ) ) ) ).run();
+    return tish::cli::BaseCLI( tish::Parser( tish::LineBuffer( move( source ) ) ) ).run();
   }
 }
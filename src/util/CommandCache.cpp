@@ -0,0 +1,122 @@
+#include <cassert>
+#include <cstdlib>
+#include <ranges>
+#include <sys/stat.h>
+#include <util/CommandCache.hpp>
+#include <util/Metrics.hpp>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      [[nodiscard]] timespec modified_time( const type::String& path ) noexcept
+      {
+        struct stat file_stat;
+        if ( stat( path.c_str(), &file_stat ) < 0 )
+          return {};
+        return file_stat.st_mtim;
+      }
+
+      [[nodiscard]] bool is_executable( const type::String& path ) noexcept
+      {
+        struct stat file_stat;
+        return stat( path.c_str(), &file_stat ) == 0 && S_ISREG( file_stat.st_mode )
+            && ( file_stat.st_mode & ( S_IXUSR | S_IXGRP | S_IXOTH ) );
+      }
+    } // namespace details
+
+    void CommandCache::sync_envpath()
+    {
+      const char* envpath = getenv( "PATH" );
+      if ( envpath == nullptr )
+        envpath = "";
+      if ( envpath_ == envpath && ( !dirs_.empty() || envpath_.empty() ) )
+        return;
+
+      envpath_ = envpath;
+      dirs_.clear();
+      for ( auto&& dir : envpath_ | views::split( ':' ) ) {
+        // An empty entry refers to the current directory, like `execvp` does.
+        type::String path( ranges::begin( dir ), ranges::end( dir ) );
+        if ( path.empty() )
+          path = ".";
+        const auto mtime = details::modified_time( path );
+        dirs_.push_back( { .path_ = move( path ), .mtime_ = mtime } );
+      }
+      erase_if( entries_, []( const auto& item ) { return item.second.dir_index_ != seeded; } );
+    }
+
+    void CommandCache::sync_dirs( size_t last_dir ) noexcept
+    {
+      for ( size_t i = 0; i <= last_dir && i < dirs_.size(); ++i ) {
+        const auto mtime = details::modified_time( dirs_[i].path_ );
+        if ( mtime.tv_sec == dirs_[i].mtime_.tv_sec && mtime.tv_nsec == dirs_[i].mtime_.tv_nsec )
+          continue;
+        dirs_[i].mtime_ = mtime;
+        // A new file in directory `i` shadows the ones found later, and a file found in `i` may be
+        // gone.
+        erase_if( entries_, [i]( const auto& item ) {
+          return item.second.dir_index_ != seeded && item.second.dir_index_ >= i;
+        } );
+      }
+    }
+
+    type::StrView CommandCache::find( type::StrView name )
+    {
+      assert( name.find( '/' ) == type::StrView::npos );
+      sync_envpath();
+
+      if ( auto item = entries_.find( name ); item != entries_.end() ) {
+        const auto dir_index = item->second.dir_index_;
+        if ( dir_index != seeded )
+          sync_dirs( dir_index );
+        // `sync_dirs` may drop the entry.
+        if ( item = entries_.find( name ); item != entries_.end() ) {
+          ++item->second.hits_;
+          Metrics::inst().add( Metrics::Counter::path_hits );
+          return item->second.path_;
+        }
+      } else
+        sync_dirs( dirs_.size() );
+
+      Metrics::inst().add( Metrics::Counter::path_misses );
+
+      for ( size_t i = 0; i < dirs_.size(); ++i ) {
+        auto filepath = type::String( dirs_[i].path_ ).append( 1, '/' ).append( name );
+        if ( !details::is_executable( filepath ) )
+          continue;
+        // Paths relative to the working directory can't be reused after `cd`.
+        if ( dirs_[i].path_.front() != '/' ) {
+          uncached_ = move( filepath );
+          return uncached_;
+        }
+        auto& entry =
+          entries_
+            .insert_or_assign(
+              type::String( name ),
+              Entry { .path_ = move( filepath ), .dir_index_ = i, .hits_ = 1 } )
+            .first->second;
+        return entry.path_;
+      }
+      return {};
+    }
+
+    void CommandCache::seed( type::StrView name, type::String path )
+    {
+      entries_.insert_or_assign(
+        type::String( name ),
+        Entry { .path_ = move( path ), .dir_index_ = seeded, .hits_ = 0 } );
+    }
+
+    void CommandCache::forget( type::StrView name )
+    {
+      if ( const auto item = entries_.find( name ); item != entries_.end() )
+        entries_.erase( item );
+    }
+
+    void CommandCache::clear() noexcept
+    {
+      entries_.clear();
+    }
+  } // namespace util
+} // namespace tish
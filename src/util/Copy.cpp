@@ -0,0 +1,133 @@
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/Copy.hpp>
+#include <util/Util.hpp>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      // The most bytes requested from the kernel at once.
+      constexpr size_t chunk_size = 1 << 20;
+      // The size of the buffer if the data has to be copied by hand.
+      constexpr size_t buffer_size = 128 * 1024;
+
+      enum class Outcome : uint8_t { done, refused, failed };
+
+      /// @brief Whether the kernel can't move the data between these files, so it's copied by hand.
+      [[nodiscard]] bool refused( int err_num ) noexcept
+      {
+        return err_num == EINVAL || err_num == ENOSYS || err_num == EXDEV
+            || err_num == EOPNOTSUPP || err_num == EBADF;
+      }
+
+      /// @brief Call `transfer` until it reaches the end of input.
+      /// @brief A refused call leaves the file offsets after the data moved so far, so the copy can
+      /// be continued by another way.
+      template<typename Fn>
+      [[nodiscard]] Outcome drain( Fn&& transfer ) noexcept
+      {
+        for ( ;; ) {
+          if ( const auto moved = transfer(); moved > 0 )
+            continue;
+          else if ( moved == 0 )
+            return Outcome::done;
+          else if ( errno != EINTR )
+            return refused( errno ) ? Outcome::refused : Outcome::failed;
+        }
+      }
+
+      [[nodiscard]] bool copy_by_hand( type::FileDesc in_fd,
+                                       span<const type::FileDesc> out_fds ) noexcept
+      {
+        array<char, buffer_size> buffer;
+        for ( ;; ) {
+          const auto received = read( in_fd, buffer.data(), buffer.size() );
+          if ( received == 0 )
+            return true;
+          else if ( received < 0 ) {
+            if ( errno == EINTR )
+              continue;
+            return false;
+          }
+          for ( const auto out_fd : out_fds )
+            if ( !write_all( out_fd, { buffer.data(), static_cast<size_t>( received ) } ) )
+              return false;
+        }
+      }
+    } // namespace details
+
+    bool copy_fd( type::FileDesc in_fd, type::FileDesc out_fd ) noexcept
+    {
+      struct stat in_stat, out_stat;
+      if ( fstat( in_fd, &in_stat ) < 0 || fstat( out_fd, &out_stat ) < 0 )
+        return false;
+
+      auto outcome = details::Outcome::refused;
+      if ( S_ISFIFO( in_stat.st_mode ) || S_ISFIFO( out_stat.st_mode ) )
+        outcome = details::drain( [=]() noexcept {
+          return splice( in_fd, nullptr, out_fd, nullptr, details::chunk_size, SPLICE_F_MOVE );
+        } );
+      else if ( S_ISREG( in_stat.st_mode ) ) {
+        if ( S_ISREG( out_stat.st_mode ) )
+          outcome = details::drain( [=]() noexcept {
+            return copy_file_range( in_fd, nullptr, out_fd, nullptr, details::chunk_size, 0 );
+          } );
+        if ( outcome == details::Outcome::refused )
+          outcome = details::drain(
+            [=]() noexcept { return sendfile( out_fd, in_fd, nullptr, details::chunk_size ); } );
+      }
+
+      if ( outcome == details::Outcome::refused )
+        return details::copy_by_hand( in_fd, span( &out_fd, 1 ) );
+      return outcome == details::Outcome::done;
+    }
+
+    bool tee_fd( type::FileDesc in_fd, span<const type::FileDesc> out_fds ) noexcept
+    {
+      if ( out_fds.size() == 1 )
+        return copy_fd( in_fd, out_fds.front() );
+
+      /* `tee(2)` duplicates the data of a pipe into another pipe without consuming it, then the
+       * same data is spliced into the file. Since only one copy can be consumed, the kernel path
+       * is taken for a pipe and a single file which accepts `splice`. */
+      struct stat in_stat, out_stat, file_stat;
+      if ( out_fds.size() == 2 && fstat( in_fd, &in_stat ) == 0
+           && fstat( out_fds[0], &out_stat ) == 0 && fstat( out_fds[1], &file_stat ) == 0
+           && S_ISFIFO( in_stat.st_mode ) && S_ISFIFO( out_stat.st_mode )
+           && S_ISREG( file_stat.st_mode ) && ( fcntl( out_fds[1], F_GETFL ) & O_APPEND ) == 0 ) {
+        for ( bool teed = false;; ) {
+          auto duplicated = tee( in_fd, out_fds[0], details::chunk_size, 0 );
+          if ( duplicated == 0 )
+            return true;
+          else if ( duplicated < 0 ) {
+            if ( errno == EINTR )
+              continue;
+            if ( teed || !details::refused( errno ) )
+              return false;
+            break;
+          }
+
+          teed = true;
+          while ( duplicated > 0 ) {
+            const auto moved =
+              splice( in_fd, nullptr, out_fds[1], nullptr, duplicated, SPLICE_F_MOVE );
+            if ( moved < 0 ) {
+              if ( errno == EINTR )
+                continue;
+              return false;
+            }
+            duplicated -= moved;
+          }
+        }
+      }
+      return details::copy_by_hand( in_fd, out_fds );
+    }
+  } // namespace util
+} // namespace tish
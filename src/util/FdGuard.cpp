@@ -0,0 +1,87 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <ranges>
+#include <unistd.h>
+#include <util/Exception.hpp>
+#include <util/FdGuard.hpp>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    FdGuard::~FdGuard() noexcept
+    {
+      restore();
+      for ( const auto fd : opened_ )
+        close( fd );
+    }
+
+    void FdGuard::backup( type::FileDesc fd )
+    {
+      auto backup_fd = fcntl( fd, F_DUPFD_CLOEXEC, _min_backup_fd );
+      if ( backup_fd < 0 ) {
+        if ( errno != EBADF )
+          throw error::SystemCallError( "fcntl" );
+        backup_fd = -1;
+      }
+      backups_.push_back( { .fd_ = fd, .backup_ = backup_fd } );
+    }
+
+    type::FileDesc FdGuard::open( const char* path,
+                                  int flags,
+                                  const SpawnActions& pending ) noexcept
+    {
+      auto fd = openat( AT_FDCWD, path, flags | O_CLOEXEC, 0666 );
+      while ( fd >= 0 && pending.targets( fd ) ) {
+        const auto moved_fd = fcntl( fd, F_DUPFD_CLOEXEC, fd + 1 );
+        close( fd );
+        fd = moved_fd;
+      }
+      if ( fd >= 0 )
+        opened_.push_back( fd );
+      return fd;
+    }
+
+    void FdGuard::rebind( type::FileDesc src_fd, type::FileDesc dst_fd )
+    {
+      if ( src_fd == dst_fd )
+        return;
+      backup( dst_fd );
+      if ( dup2( src_fd, dst_fd ) < 0 )
+        throw error::SystemCallError( "dup2" );
+    }
+
+    void FdGuard::apply( const SpawnActions& actions )
+    {
+      for ( const auto& action : actions.actions() ) {
+        switch ( action.kind_ ) {
+        case SpawnActions::Action::Kind::open: {
+          const auto file_d = open( action.path_, action.flags_ );
+          if ( file_d < 0 )
+            throw error::SystemCallError( action.path_ );
+          rebind( file_d, action.fd_ );
+        } break;
+        case SpawnActions::Action::Kind::rebind: {
+          rebind( action.src_fd_, action.fd_ );
+        } break;
+        case SpawnActions::Action::Kind::close: {
+          backup( action.fd_ );
+          close( action.fd_ );
+        } break;
+        }
+      }
+    }
+
+    void FdGuard::restore() noexcept
+    {
+      for ( const auto& [fd, backup_fd] : backups_ | views::reverse ) {
+        if ( backup_fd < 0 )
+          close( fd );
+        else {
+          dup2( backup_fd, fd );
+          close( backup_fd );
+        }
+      }
+      backups_.clear();
+    }
+  } // namespace util
+} // namespace tish
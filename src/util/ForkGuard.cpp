@@ -1,13 +1,19 @@
+#include <cerrno>
+#include <chrono>
 #include <csignal>
 #include <cstring>
 #include <sys/wait.h>
 #include <util/Exception.hpp>
 #include <util/ForkGuard.hpp>
+#include <util/Metrics.hpp>
+#include <util/Profiler.hpp>
+#include <util/Tracer.hpp>
 using namespace std;
 
 namespace tish {
   namespace util {
-    ForkGuard::ForkGuard( bool block_sig ) : process_id_ {}, subp_ret_ {}, old_set_ { nullptr }
+    ForkGuard::ForkGuard( bool block_sig )
+      : process_id_ {}, subp_ret_ {}, usage_ {}, old_set_ { nullptr }
     {
       if ( block_sig ) {
         old_set_ = make_unique<sigset_t>();
@@ -19,13 +25,28 @@ namespace tish {
         sigprocmask( SIG_BLOCK, &new_set_, old_set_.get() );
       }
 
+      TraceSpan span( "fork", "exec" );
       if ( ( process_id_ = fork() ) < 0 )
         throw error::SystemCallError( "fork" );
+      if ( span.active() ) [[unlikely]] {
+        if ( process_id_ == 0 ) {
+          // The span belongs to the parent, the child starts a trace of its own.
+          span.discard();
+          Tracer::inst().forked();
+        } else
+          span.arg( "pid", process_id_ );
+      }
+      // A forked child stops profiling, its cost is charged by the parent.
+      if ( process_id_ == 0 && Profiler::enabled() ) [[unlikely]]
+        Profiler::inst().forked();
+      if ( process_id_ != 0 )
+        Metrics::inst().add( Metrics::Counter::forks );
     }
 
     ForkGuard::ForkGuard( ForkGuard&& rhs ) noexcept
       : process_id_ { rhs.process_id_ }
       , subp_ret_ { move( rhs.subp_ret_ ) }
+      , usage_ { rhs.usage_ }
       , old_set_ { move( rhs.old_set_ ) }
     {
       sigemptyset( &new_set_ );
@@ -61,8 +82,12 @@ namespace tish {
     {
       if ( is_parent() && !subp_ret_.has_value() ) {
         ExitCode status {};
-        if ( waitpid( process_id_, &status, 0 ) < 0 )
-          throw error::SystemCallError( "waitpid" );
+        const auto begin = chrono::steady_clock::now();
+        while ( wait4( process_id_, &status, 0, &usage_ ) < 0 ) {
+          if ( errno != EINTR )
+            throw error::SystemCallError( "wait4" );
+        }
+        Metrics::inst().observe_wait( chrono::steady_clock::now() - begin );
         subp_ret_ = status;
       }
     }
@@ -0,0 +1,127 @@
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/Exception.hpp>
+#include <util/InputSource.hpp>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      /// @brief Splits the first line out of `str`, returns the line and the characters consumed.
+      [[nodiscard]] pair<InputSource::Line, size_t> split_line( type::StrView str ) noexcept
+      {
+        if ( const auto line_end =
+               static_cast<const char*>( memchr( str.data(), '\n', str.size() ) );
+             line_end != nullptr ) {
+          const auto length = static_cast<size_t>( line_end - str.data() );
+          return { { .text_ = str.substr( 0, length ), .complete_ = true }, length + 1 };
+        }
+        return { { .text_ = str, .complete_ = false }, str.size() };
+      }
+    } // namespace details
+
+    MappedSource::MappedSource( type::FileDesc fd, size_t file_size )
+      : data_ { nullptr }, size_ { file_size }, pos_ {}
+    {
+      assert( file_size > 0 );
+      void* addr = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( addr == MAP_FAILED )
+        throw error::SystemCallError( "mmap" );
+      madvise( addr, size_, MADV_SEQUENTIAL );
+      data_ = static_cast<const char*>( addr );
+    }
+
+    MappedSource::~MappedSource() noexcept
+    {
+      munmap( const_cast<char*>( data_ ), size_ );
+    }
+
+    InputSource::Line MappedSource::getline()
+    {
+      const auto [line, consumed] = details::split_line( { data_ + pos_, size_ - pos_ } );
+      pos_ += consumed;
+      return line;
+    }
+
+    BlockSource::BlockSource( type::FileDesc fd, bool owns_fd )
+      : fd_ { fd }
+      , owns_fd_ { owns_fd }
+      , received_eof_ { false }
+      , buffer_( _block_size )
+      , begin_ {}
+      , end_ {}
+    {}
+
+    BlockSource::~BlockSource() noexcept
+    {
+      if ( owns_fd_ )
+        close( fd_ );
+    }
+
+    InputSource::Line BlockSource::getline()
+    {
+      // The previous line is no longer referenced, so only the unread part is checked.
+      for ( size_t scanned = 0;; ) {
+        const type::StrView unread { buffer_.data() + begin_, end_ - begin_ };
+        if ( const auto [line, consumed] = details::split_line( unread.substr( scanned ) );
+             line.complete_ || received_eof_ ) {
+          begin_ += scanned + consumed;
+          return { unread.substr( 0, scanned + line.text_.size() ), line.complete_ };
+        }
+        scanned = unread.size();
+
+        // Move the incomplete line to the front, and make room for another block.
+        if ( begin_ != 0 ) {
+          memmove( buffer_.data(), buffer_.data() + begin_, end_ - begin_ );
+          end_ -= begin_;
+          begin_ = 0;
+        }
+        if ( buffer_.size() - end_ < _block_size / 2 )
+          buffer_.resize( buffer_.size() * 2 );
+
+        ssize_t num_read = 0;
+        do
+          num_read = read( fd_, buffer_.data() + end_, buffer_.size() - end_ );
+        while ( num_read < 0 && errno == EINTR );
+
+        if ( num_read < 0 )
+          throw error::SystemCallError( "read" );
+        else if ( num_read == 0 )
+          received_eof_ = true;
+        end_ += static_cast<size_t>( num_read );
+      }
+    }
+
+    InputSource::Line StringSource::getline() noexcept
+    {
+      const auto [line, consumed] = details::split_line( type::StrView( text_ ).substr( pos_ ) );
+      pos_ += consumed;
+      return line;
+    }
+
+    unique_ptr<InputSource> open_source( const char* filename )
+    {
+      const auto fd = open( filename, O_RDONLY | O_CLOEXEC );
+      if ( fd < 0 )
+        throw error::SystemCallError( format( "tish: {}", filename ) );
+
+      struct stat file_stat;
+      if ( fstat( fd, &file_stat ) == 0 && S_ISREG( file_stat.st_mode ) && file_stat.st_size > 0 ) {
+        try {
+          auto source = make_unique<MappedSource>( fd, static_cast<size_t>( file_stat.st_size ) );
+          close( fd );
+          return source;
+        } catch ( const error::SystemCallError& ) {
+          // some file systems don't support `mmap`, just read them instead
+        }
+      }
+      return make_unique<BlockSource>( fd, true );
+    }
+  } // namespace util
+} // namespace tish
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <ranges>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <util/JobTable.hpp>
+#include <utility>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      // A process which can't be watched by a pidfd is checked again after this many milliseconds.
+      constexpr int unwatched_interval = 10;
+      // The status of a process which is reaped by someone else.
+      constexpr JobTable::ExitCode lost_status = 127;
+
+      void close_pidfd( JobTable::Process& process ) noexcept
+      {
+        if ( process.pidfd_ >= 0 ) {
+          ::close( process.pidfd_ );
+          process.pidfd_ = -1;
+        }
+      }
+    } // namespace details
+
+    JobTable::State JobTable::Job::state() const noexcept
+    {
+      if ( ranges::all_of( processes_,
+                           []( const Process& proc ) { return proc.status_.has_value(); } ) )
+        return State::done;
+      return ranges::any_of( processes_,
+                             []( const Process& proc ) {
+                               return !proc.status_.has_value() && proc.stopped_;
+                             } )
+             ? State::stopped
+             : State::running;
+    }
+
+    JobTable::ExitCode JobTable::Job::status() const noexcept
+    {
+      const auto failed = ranges::find_if( processes_, []( const Process& proc ) {
+        return proc.status_.value_or( EXIT_SUCCESS ) != EXIT_SUCCESS;
+      } );
+      return failed == processes_.cend() ? EXIT_SUCCESS : *failed->status_;
+    }
+
+    void JobTable::collect( Process& process, int options ) noexcept
+    {
+      int status = 0;
+      Pid reaped = 0;
+      do
+        reaped = waitpid( process.pid_, &status, options );
+      while ( reaped < 0 && errno == EINTR );
+      if ( reaped == 0 )
+        return;
+
+      if ( reaped < 0 )
+        process.status_ = details::lost_status;
+      else if ( WIFSTOPPED( status ) ) {
+        process.stopped_ = true;
+        return;
+      } else if ( WIFCONTINUED( status ) ) {
+        process.stopped_ = false;
+        return;
+      } else
+        process.status_ = WIFSIGNALED( status ) ? 128 + WTERMSIG( status ) : WEXITSTATUS( status );
+      process.stopped_ = false;
+      details::close_pidfd( process );
+    }
+
+    bool JobTable::poll( Job* job, int timeout )
+    {
+      pollfds_.clear();
+      polled_.clear();
+      bool unwatched = false;
+      const auto gather = [&]( Job& target ) {
+        for ( auto& process : target.processes_ ) {
+          if ( process.status_.has_value() )
+            continue;
+          if ( process.pidfd_ >= 0 ) {
+            pollfds_.push_back( { .fd = process.pidfd_, .events = POLLIN, .revents = 0 } );
+            polled_.push_back( &process );
+          } else {
+            collect( process, WNOHANG | WUNTRACED | WCONTINUED );
+            unwatched = unwatched || !process.status_.has_value();
+          }
+        }
+      };
+      if ( job != nullptr )
+        gather( *job );
+      else
+        ranges::for_each( jobs_, gather );
+
+      // An unwatched process can't wake up `poll`, so it's checked again after a while.
+      if ( unwatched && timeout != 0 )
+        timeout = timeout < 0 ? details::unwatched_interval
+                              : min( timeout, details::unwatched_interval );
+      if ( pollfds_.empty() && timeout == 0 )
+        return true;
+
+      const auto num_ready = ::poll( pollfds_.data(), pollfds_.size(), timeout );
+      if ( num_ready < 0 )
+        return false;
+      for ( size_t i = 0; i < pollfds_.size(); ++i ) {
+        if ( pollfds_[i].revents != 0 )
+          collect( *polled_[i], WNOHANG );
+      }
+      return true;
+    }
+
+    JobTable::JobTable( JobTable&& rhs ) noexcept
+      : jobs_ { move( rhs.jobs_ ) }
+      , finished_ { move( rhs.finished_ ) }
+      , unwaited_ { move( rhs.unwaited_ ) }
+      , pollfds_ { move( rhs.pollfds_ ) }
+      , polled_ { move( rhs.polled_ ) }
+    {
+      rhs.jobs_.clear();
+    }
+
+    JobTable& JobTable::operator=( JobTable&& rhs ) noexcept
+    {
+      using std::swap;
+      swap( jobs_, rhs.jobs_ );
+      swap( finished_, rhs.finished_ );
+      swap( unwaited_, rhs.unwaited_ );
+      swap( pollfds_, rhs.pollfds_ );
+      swap( polled_, rhs.polled_ );
+      return *this;
+    }
+
+    JobTable::~JobTable() noexcept
+    {
+      clear();
+    }
+
+    JobTable::Job& JobTable::add( Pid pgid, type::String command )
+    {
+      return jobs_.emplace_back( Job { .id_        = jobs_.empty() ? 1 : jobs_.back().id_ + 1,
+                                       .pgid_      = pgid,
+                                       .command_   = move( command ),
+                                       .processes_ = {} } );
+    }
+
+    JobTable::Process JobTable::watch( Pid pid ) noexcept
+    {
+      // The pid may belong to a removed job before, its status is stale now.
+      finished_.erase( pid );
+#ifdef SYS_pidfd_open
+      // A pidfd is always close-on-exec.
+      const auto pidfd = static_cast<type::FileDesc>( syscall( SYS_pidfd_open, pid, 0 ) );
+#else
+      const type::FileDesc pidfd = -1;
+#endif
+      return {
+        .pid_ = pid, .pidfd_ = pidfd < 0 ? -1 : pidfd, .status_ = nullopt, .stopped_ = false };
+    }
+
+    void JobTable::remove( const Job& job )
+    {
+      const auto pos = jobs_.begin() + ( addressof( job ) - jobs_.data() );
+      for ( auto& process : pos->processes_ ) {
+        if ( process.pid_ > 0 && process.status_.has_value() )
+          finished_.insert_or_assign( process.pid_, *process.status_ );
+        details::close_pidfd( process );
+      }
+      jobs_.erase( pos );
+    }
+
+    void JobTable::remove_done()
+    {
+      // From the back, so the positions of the jobs which are not checked yet are kept.
+      // Each job then goes before the later ones in `unwaited_`.
+      const auto oldest = static_cast<ptrdiff_t>( unwaited_.size() );
+      for ( auto i = jobs_.size(); i-- > 0; ) {
+        if ( const auto& job = jobs_[i]; job.state() == State::done ) {
+          unwaited_.emplace( unwaited_.begin() + oldest,
+                             job.processes_.empty() ? -1 : job.processes_.back().pid_,
+                             job.status() );
+          remove( job );
+        }
+      }
+    }
+
+    void JobTable::clear() noexcept
+    {
+      for ( auto& job : jobs_ )
+        ranges::for_each( job.processes_, details::close_pidfd );
+      jobs_.clear();
+      finished_.clear();
+      unwaited_.clear();
+    }
+
+    JobTable::Job* JobTable::find( type::StrView spec ) noexcept
+    {
+      if ( jobs_.empty() )
+        return nullptr;
+
+      const auto number = [spec]( size_t offset ) -> optional<size_t> {
+        size_t value {};
+        const auto digits    = spec.substr( offset );
+        const auto [ptr, ec] = from_chars( digits.data(), digits.data() + digits.size(), value );
+        if ( digits.empty() || ec != errc {} || ptr != digits.data() + digits.size() )
+          return nullopt;
+        return value;
+      };
+
+      if ( !spec.starts_with( '%' ) ) {
+        const auto pid = number( 0 );
+        const auto job = ranges::find_if( jobs_, [pid]( const Job& candidate ) {
+          return pid.has_value()
+              && ranges::any_of( candidate.processes_, [pid]( const Process& proc ) {
+                   return static_cast<size_t>( proc.pid_ ) == *pid;
+                 } );
+        } );
+        return job == jobs_.end() ? nullptr : addressof( *job );
+      }
+
+      const auto name = spec.substr( 1 );
+      if ( name.empty() || name == "%" || name == "+" )
+        return addressof( jobs_.back() );
+      if ( name == "-" )
+        return jobs_.size() < 2 ? nullptr : addressof( jobs_[jobs_.size() - 2] );
+      if ( const auto id = number( 1 ); id.has_value() ) {
+        const auto job = ranges::find( jobs_, *id, &Job::id_ );
+        return job == jobs_.end() ? nullptr : addressof( *job );
+      }
+      // `%name` is the most recent job whose command starts with `name`.
+      const auto job = ranges::find_if( jobs_ | views::reverse, [name]( const Job& candidate ) {
+        return candidate.command_.starts_with( name );
+      } );
+      return job == ranges::rend( jobs_ ) ? nullptr : addressof( *job );
+    }
+
+    optional<JobTable::ExitCode> JobTable::take_finished( Pid pid ) noexcept
+    {
+      const auto item = finished_.find( pid );
+      if ( item == finished_.end() )
+        return nullopt;
+      const auto status = item->second;
+      finished_.erase( item );
+      erase_if( unwaited_, [pid]( const auto& job ) { return job.first == pid; } );
+      return status;
+    }
+
+    optional<JobTable::ExitCode> JobTable::take_unwaited() noexcept
+    {
+      if ( unwaited_.empty() )
+        return nullopt;
+      const auto [pid, status] = unwaited_.front();
+      unwaited_.pop_front();
+      finished_.erase( pid );
+      return status;
+    }
+
+    void JobTable::reap()
+    {
+      if ( jobs_.empty() )
+        return;
+      [[maybe_unused]] const auto _ = poll( nullptr, 0 );
+    }
+
+    void JobTable::refresh()
+    {
+      for ( auto& job : jobs_ ) {
+        for ( auto& process : job.processes_ ) {
+          if ( !process.status_.has_value() )
+            collect( process, WNOHANG | WUNTRACED | WCONTINUED );
+        }
+      }
+    }
+
+    bool JobTable::wait( Job& job )
+    {
+      while ( job.state() != State::done ) {
+        if ( !poll( addressof( job ), -1 ) )
+          return false;
+      }
+      return true;
+    }
+
+    optional<size_t> JobTable::wait_any()
+    {
+      while ( true ) {
+        if ( const auto done = ranges::find( jobs_, State::done, &Job::state );
+             done != jobs_.end() )
+          return static_cast<size_t>( done - jobs_.begin() );
+        if ( !poll( nullptr, -1 ) )
+          return nullopt;
+      }
+    }
+
+    void JobTable::resume( Job& job ) noexcept
+    {
+      if ( job.pgid_ <= 0 || job.state() != State::stopped )
+        return;
+      kill( -job.pgid_, SIGCONT );
+      for ( auto& process : job.processes_ )
+        process.stopped_ = false;
+    }
+
+    void JobTable::foreground( Job& job ) noexcept
+    {
+      const bool handover = job.pgid_ > 0 && isatty( STDIN_FILENO )
+                         && tcgetpgrp( STDIN_FILENO ) == getpgrp();
+      if ( handover )
+        tcsetpgrp( STDIN_FILENO, job.pgid_ );
+      resume( job );
+
+      // A stop signal is sent to the whole group, so every process is waited until it stops.
+      for ( auto& process : job.processes_ ) {
+        while ( !process.status_.has_value() && !process.stopped_ )
+          collect( process, WUNTRACED );
+      }
+
+      if ( handover ) {
+        // The shell is in the background until it takes the terminal back.
+        sigset_t signals, old_signals;
+        sigemptyset( &signals );
+        sigaddset( &signals, SIGTTOU );
+        sigprocmask( SIG_BLOCK, &signals, &old_signals );
+        tcsetpgrp( STDIN_FILENO, getpgrp() );
+        sigprocmask( SIG_SETMASK, &old_signals, nullptr );
+      }
+    }
+  } // namespace util
+} // namespace tish
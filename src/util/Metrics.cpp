@@ -0,0 +1,152 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <format>
+#include <unistd.h>
+#include <util/Metrics.hpp>
+#include <util/Util.hpp>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      struct CounterInfo {
+        // The name in a table, and the one in the exposition format.
+        type::StrView label_, name_;
+        type::StrView help_;
+      };
+      // In the order of `Metrics::Counter`.
+      constexpr array<CounterInfo, Metrics::num_counters> counter_infos { {
+        { "statements parsed", "tish_statements_parsed_total", "Statements parsed." },
+        { "tokens", "tish_tokens_total", "Tokens produced by the tokenizer." },
+        { "syntax nodes", "tish_syntax_nodes_total", "Nodes allocated in syntax trees." },
+        { "forks", "tish_forks_total", "Processes forked by the shell." },
+        { "execs", "tish_execs_total", "Programs started by the shell." },
+        { "exec failures",
+          "tish_exec_failures_total",
+          "Programs which could not be started, including the ones not found." },
+        { "builtin output bytes",
+          "tish_builtin_output_bytes_total",
+          "Bytes written by the builtins through their output buffer." },
+        { "PATH cache hits", "tish_path_cache_hits_total", "Commands found in the PATH cache." },
+        { "PATH cache misses",
+          "tish_path_cache_misses_total",
+          "Commands searched in the directories of PATH." },
+      } };
+
+      /// @brief A number of seconds without losing any precision.
+      [[nodiscard]] type::String decimal_seconds( uint64_t micros )
+      {
+        return format( "{}.{:06}", micros / 1'000'000, micros % 1'000'000 );
+      }
+
+      [[nodiscard]] type::String readable_bound( uint64_t micros )
+      {
+        if ( micros < 1'000 )
+          return format( "{}us", micros );
+        if ( micros < 1'000'000 )
+          return format( "{}ms", micros / 1'000 );
+        return format( "{}s", micros / 1'000'000 );
+      }
+    } // namespace details
+
+    Metrics& Metrics::inst() noexcept
+    {
+      static Metrics metrics;
+      return metrics;
+    }
+
+    void Metrics::observe_wait( chrono::steady_clock::duration duration ) noexcept
+    {
+      const auto micros =
+        static_cast<uint64_t>( chrono::duration_cast<chrono::microseconds>( duration ).count() );
+      size_t bucket = 0;
+      while ( bucket < wait_bounds.size() && micros > wait_bounds[bucket] )
+        ++bucket;
+      waits_[bucket].fetch_add( 1, memory_order_relaxed );
+      wait_micros_.fetch_add( micros, memory_order_relaxed );
+    }
+
+    void Metrics::export_to( type::String path ) noexcept
+    {
+      path_  = move( path );
+      owner_ = getpid();
+    }
+
+    type::String Metrics::table() const
+    {
+      type::String out;
+      for ( size_t i = 0; i < num_counters; ++i )
+        out.append( format( "{:<24}{}\n",
+                            details::counter_infos[i].label_,
+                            counters_[i].load( memory_order_relaxed ) ) );
+
+      uint64_t num_waits = 0;
+      for ( const auto& bucket : waits_ )
+        num_waits += bucket.load( memory_order_relaxed );
+      out.append( format( "{:<24}{} in {}s\n",
+                          "waits",
+                          num_waits,
+                          details::decimal_seconds( wait_micros_.load( memory_order_relaxed ) ) ) );
+      for ( size_t i = 0; i < waits_.size(); ++i ) {
+        const auto bound = i < wait_bounds.size()
+                           ? format( "  <= {}", details::readable_bound( wait_bounds[i] ) )
+                           : format( "  > {}", details::readable_bound( wait_bounds.back() ) );
+        out.append( format( "{:<24}{}\n", bound, waits_[i].load( memory_order_relaxed ) ) );
+      }
+      return out;
+    }
+
+    type::String Metrics::exposition() const
+    {
+      type::String out;
+      for ( size_t i = 0; i < num_counters; ++i ) {
+        const auto& info = details::counter_infos[i];
+        out.append( format( "# HELP {} {}\n# TYPE {} counter\n{} {}\n",
+                            info.name_,
+                            info.help_,
+                            info.name_,
+                            info.name_,
+                            counters_[i].load( memory_order_relaxed ) ) );
+      }
+
+      out.append( "# HELP tish_wait_seconds Time the shell blocked waiting for a child.\n"
+                  "# TYPE tish_wait_seconds histogram\n" );
+      // The buckets of the format are cumulative.
+      uint64_t num_waits = 0;
+      for ( size_t i = 0; i < waits_.size(); ++i ) {
+        num_waits += waits_[i].load( memory_order_relaxed );
+        out.append( format( "tish_wait_seconds_bucket{{le=\"{}\"}} {}\n",
+                            i < wait_bounds.size() ? details::decimal_seconds( wait_bounds[i] )
+                                                   : type::String( "+Inf" ),
+                            num_waits ) );
+      }
+      out.append(
+        format( "tish_wait_seconds_sum {}\ntish_wait_seconds_count {}\n",
+                details::decimal_seconds( wait_micros_.load( memory_order_relaxed ) ),
+                num_waits ) );
+      return out;
+    }
+
+    void Metrics::dump() noexcept
+    {
+      if ( path_.empty() || getpid() != owner_ )
+        return;
+      try {
+        // Renamed over the file once it's complete.
+        const auto temp_path = format( "{}.{}.tmp", path_, owner_ );
+        const auto fd = open( temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 );
+        if ( fd < 0 )
+          return;
+        const bool written = write_all( fd, exposition() );
+        if ( close( fd ) == 0 && written )
+          rename( temp_path.c_str(), path_.c_str() );
+        else
+          unlink( temp_path.c_str() );
+      } catch ( ... ) {
+        // The metrics are lost, but the status of the shell is not changed by them.
+      }
+    }
+  } // namespace util
+} // namespace tish
@@ -9,8 +9,9 @@ namespace tish {
   namespace util {
     Pipe::Pipe() : pipefd_ {}, reader_closed_ { false }, writer_closed_ { false }
     {
-      if ( pipe( pipefd_.data() ) < 0 )
-        throw error::SystemCallError( "pipe" );
+      // Programs only receive the ends which are rebound to their standard streams.
+      if ( pipe2( pipefd_.data(), O_CLOEXEC ) < 0 )
+        throw error::SystemCallError( "pipe2" );
     }
 
     Pipe::Pipe( Pipe&& rhs ) noexcept
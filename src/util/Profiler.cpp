@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fcntl.h>
+#include <format>
+#include <memory>
+#include <numeric>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/Exception.hpp>
+#include <util/InputSource.hpp>
+#include <util/Profiler.hpp>
+#include <util/Util.hpp>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      [[nodiscard]] int64_t microseconds( Profiler::Clock::duration duration ) noexcept
+      {
+        return chrono::duration_cast<chrono::microseconds>( duration ).count();
+      }
+
+      /// @brief Returns the lines of the script, or nothing if they can't be read again.
+      [[nodiscard]] vector<type::String> source_lines( const type::String& script, bool is_file )
+      {
+        vector<type::String> lines;
+        try {
+          unique_ptr<InputSource> source;
+          if ( is_file ) {
+            // Anything but a regular file may block, or has been consumed by the shell already.
+            struct stat file_stat;
+            if ( stat( script.c_str(), &file_stat ) != 0 || !S_ISREG( file_stat.st_mode ) )
+              return lines;
+            source = open_source( script.c_str() );
+          } else
+            source = make_unique<StringSource>( script );
+
+          while ( !source->exhausted() )
+            lines.emplace_back( source->getline().text_ );
+        } catch ( const error::SystemCallError& ) {
+          // The report is still useful without the text.
+        }
+        return lines;
+      }
+    } // namespace details
+
+    Profiler& Profiler::inst() noexcept
+    {
+      static Profiler profiler;
+      return profiler;
+    }
+
+    bool Profiler::open( const char* path ) noexcept
+    {
+      if ( path == nullptr )
+        fd_ = STDERR_FILENO;
+      else if ( ( fd_ = ::open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 ) ) < 0 )
+        return false;
+      owner_   = getpid();
+      start_   = Clock::now();
+      enabled_ = true;
+      return true;
+    }
+
+    Profiler::Line& Profiler::at( uint32_t line )
+    {
+      if ( line >= lines_.size() )
+        lines_.resize( line + 1, {} );
+      return lines_[line];
+    }
+
+    void Profiler::run( uint32_t line, Clock::duration wall )
+    {
+      auto& stat = at( line );
+      stat.wall_ += wall;
+      ++stat.runs_;
+    }
+
+    void Profiler::child( uint32_t line, const rusage& usage )
+    {
+      auto& stat = at( line );
+      stat.user_ += to_microseconds( usage.ru_utime );
+      stat.sys_ += to_microseconds( usage.ru_stime );
+    }
+
+    void Profiler::start( uint32_t line, bool exec )
+    {
+      auto& stat = at( line );
+      ++stat.forks_;
+      if ( exec )
+        ++stat.execs_;
+    }
+
+    void Profiler::finish() noexcept
+    {
+      if ( fd_ < 0 || getpid() != owner_ )
+        return;
+      const auto fd = exchange( fd_, -1 );
+      enabled_      = false;
+
+      try {
+        const auto total = details::microseconds( Clock::now() - start_ );
+        vector<uint32_t> order;
+        for ( uint32_t line = 0; line < lines_.size(); ++line ) {
+          if ( lines_[line].runs_ > 0 || lines_[line].forks_ > 0 )
+            order.push_back( line );
+        }
+        ranges::stable_sort( order, [this]( uint32_t lhs, uint32_t rhs ) {
+          return lines_[lhs].wall_ > lines_[rhs].wall_;
+        } );
+        const auto source = details::source_lines( script_, script_is_file_ );
+
+        const auto charged = accumulate(
+          lines_.cbegin(), lines_.cend(), int64_t {}, []( int64_t sum, const Line& stat ) {
+            return sum + details::microseconds( stat.wall_ );
+          } );
+        auto out = format( "tish: profile of {} lines, {} wall, {} of it charged to commands\n",
+                           order.size(),
+                           format_seconds( total ),
+                           format_seconds( charged ) );
+        constexpr auto row = "{:>6}  {:>9}{:>7}{:>9}{:>9}{:>7}{:>7}{:>7}  {}\n";
+        out.append(
+          format( row, "line", "wall", "%", "user", "sys", "runs", "forks", "execs", "source" ) );
+        for ( const auto line : order ) {
+          const auto& stat = lines_[line];
+          const auto wall  = details::microseconds( stat.wall_ );
+          // In tenths of a percent.
+          const auto share = total > 0 ? wall * 1000 / total : 0;
+          type::StrView text;
+          if ( line > 0 && line <= source.size() ) {
+            text = source[line - 1];
+            text.remove_prefix( min( text.find_first_not_of( " \t" ), text.size() ) );
+            if ( const auto end = text.find_last_not_of( " \t" ); end != type::StrView::npos )
+              text = text.substr( 0, end + 1 );
+          }
+          out.append( format( row,
+                              line == 0 ? type::String( "?" ) : format( "{}", line ),
+                              format_seconds( wall ),
+                              format( "{}.{}", share / 10, share % 10 ),
+                              format_seconds( stat.user_ ),
+                              format_seconds( stat.sys_ ),
+                              stat.runs_,
+                              stat.forks_,
+                              stat.execs_,
+                              text ) );
+        }
+        static_cast<void>( write_all( fd, out ) );
+      } catch ( ... ) {
+        // The report is lost, but the status of the shell is not changed by it.
+      }
+      if ( fd != STDERR_FILENO )
+        close( fd );
+    }
+  } // namespace util
+} // namespace tish
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <util/Exception.hpp>
+#include <util/FdGuard.hpp>
+#include <util/Metrics.hpp>
+#include <util/Spawn.hpp>
+#include <util/Tracer.hpp>
+using namespace std;
+
+/* Since glibc 2.24 `posix_spawn` runs the child with `CLONE_VM | CLONE_VFORK` and reports the
+ * failure of `exec` as its return value. Other implementations may only let the child exit with
+ * 127, so a forked child which reports `errno` through a close-on-exec pipe is used instead. */
+#if defined( __GLIBC__ ) && ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 24 ) )
+# define TISH_USE_POSIX_SPAWN 1
+#endif
+
+extern char** environ;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      constexpr mode_t spawn_file_mode = 0666;
+
+#ifdef TISH_USE_POSIX_SPAWN
+      [[nodiscard]] int spawn_process( pid_t& pid,
+                                       const char* file,
+                                       char* const argv[],
+                                       const SpawnActions& actions ) noexcept
+      {
+        posix_spawn_file_actions_t file_actions;
+        posix_spawn_file_actions_init( &file_actions );
+        for ( const auto& action : actions.actions() ) {
+          switch ( action.kind_ ) {
+          case SpawnActions::Action::Kind::open: {
+            posix_spawn_file_actions_addopen( &file_actions,
+                                              action.fd_,
+                                              action.path_,
+                                              action.flags_,
+                                              spawn_file_mode );
+          } break;
+          case SpawnActions::Action::Kind::rebind: {
+            posix_spawn_file_actions_adddup2( &file_actions, action.src_fd_, action.fd_ );
+          } break;
+          case SpawnActions::Action::Kind::close: {
+            posix_spawn_file_actions_addclose( &file_actions, action.fd_ );
+          } break;
+          }
+        }
+
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init( &attributes );
+        sigset_t signals;
+        sigemptyset( &signals );
+        posix_spawnattr_setsigmask( &attributes, &signals );
+        sigaddset( &signals, SIGINT );
+        sigaddset( &signals, SIGTSTP );
+        posix_spawnattr_setsigdefault( &attributes, &signals );
+        short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+        if ( const auto pgroup = actions.process_group(); pgroup.has_value() ) {
+          posix_spawnattr_setpgroup( &attributes, *pgroup );
+          flags |= POSIX_SPAWN_SETPGROUP;
+        }
+        posix_spawnattr_setflags( &attributes, flags );
+
+        const auto err_num = posix_spawnp( &pid, file, &file_actions, &attributes, argv, environ );
+
+        posix_spawnattr_destroy( &attributes );
+        posix_spawn_file_actions_destroy( &file_actions );
+        return err_num;
+      }
+#else
+      /// @brief Only async-signal-safe functions can be called here.
+      [[nodiscard]] bool apply( const SpawnActions& actions ) noexcept
+      {
+        if ( const auto pgroup = actions.process_group();
+             pgroup.has_value() && setpgid( 0, *pgroup ) < 0 )
+          return false;
+        for ( const auto& action : actions.actions() ) {
+          switch ( action.kind_ ) {
+          case SpawnActions::Action::Kind::open: {
+            const auto file_d = ::open( action.path_, action.flags_, spawn_file_mode );
+            if ( file_d < 0 )
+              return false;
+            if ( file_d != action.fd_ ) {
+              if ( dup2( file_d, action.fd_ ) < 0 )
+                return false;
+              ::close( file_d );
+            }
+          } break;
+          case SpawnActions::Action::Kind::rebind: {
+            if ( action.src_fd_ == action.fd_ ) {
+              if ( fcntl( action.fd_, F_SETFD, 0 ) < 0 )
+                return false;
+            } else if ( dup2( action.src_fd_, action.fd_ ) < 0 )
+              return false;
+          } break;
+          case SpawnActions::Action::Kind::close: {
+            ::close( action.fd_ );
+          } break;
+          }
+        }
+        return true;
+      }
+
+      [[nodiscard]] int spawn_process( pid_t& pid,
+                                       const char* file,
+                                       char* const argv[],
+                                       const SpawnActions& actions )
+      {
+        type::FileDesc error_pipe[2];
+        if ( pipe2( error_pipe, O_CLOEXEC ) < 0 )
+          throw error::SystemCallError( "pipe2" );
+
+        if ( ( pid = fork() ) < 0 ) {
+          ::close( error_pipe[0] );
+          ::close( error_pipe[1] );
+          throw error::SystemCallError( "fork" );
+        } else if ( pid == 0 ) {
+          ::close( error_pipe[0] );
+          if ( apply( actions ) ) {
+            sigset_t signals;
+            sigemptyset( &signals );
+            sigprocmask( SIG_SETMASK, &signals, nullptr );
+            signal( SIGINT, SIG_DFL );
+            signal( SIGTSTP, SIG_DFL );
+            execvp( file, argv );
+          }
+          // The pipe is closed by a successful `exec`, so the parent only reads something on error.
+          const int err_num             = errno;
+          [[maybe_unused]] const auto _ = write( error_pipe[1], &err_num, sizeof( err_num ) );
+          _exit( 127 );
+        }
+
+        ::close( error_pipe[1] );
+        int err_num      = 0;
+        ssize_t num_read = 0;
+        do
+          num_read = read( error_pipe[0], &err_num, sizeof( err_num ) );
+        while ( num_read < 0 && errno == EINTR );
+        ::close( error_pipe[0] );
+
+        if ( num_read != sizeof( err_num ) )
+          return 0;
+        // The child has exited, collect it so it doesn't become a zombie.
+        while ( waitpid( pid, nullptr, 0 ) < 0 && errno == EINTR )
+          ;
+        return err_num;
+      }
+#endif
+    } // namespace details
+
+    int replace_process( const char* file,
+                         char* const argv[],
+                         const SpawnActions& actions ) noexcept
+    {
+      /* Output buffered by the shell would be lost along with its memory, and so would the trace
+       * and the metrics, which count the program in advance. */
+      fflush( nullptr );
+      if ( Tracer::enabled() ) [[unlikely]]
+        Tracer::inst().flush();
+      Metrics::inst().add( Metrics::Counter::execs );
+      Metrics::inst().dump();
+      // Descriptors backed up by the guard are close-on-exec, so the program never sees them.
+      FdGuard fd_guard;
+      try {
+        fd_guard.apply( actions );
+      } catch ( const error::SystemCallError& ) {
+        return errno;
+      }
+
+      struct sigaction default_action {}, old_sigint {}, old_sigtstp {};
+      default_action.sa_handler = SIG_DFL;
+      sigemptyset( &default_action.sa_mask );
+      sigaction( SIGINT, &default_action, &old_sigint );
+      sigaction( SIGTSTP, &default_action, &old_sigtstp );
+      sigset_t signals, old_signals;
+      sigemptyset( &signals );
+      sigprocmask( SIG_SETMASK, &signals, &old_signals );
+
+      execvp( file, argv );
+
+      const int err_num = errno;
+      // The caller spawns the program instead, which is counted then.
+      Metrics::inst().cancel( Metrics::Counter::execs );
+      sigprocmask( SIG_SETMASK, &old_signals, nullptr );
+      sigaction( SIGTSTP, &old_sigtstp, nullptr );
+      sigaction( SIGINT, &old_sigint, nullptr );
+      return err_num;
+    }
+
+    SpawnActions& SpawnActions::open( type::FileDesc fd, const char* path, int flags )
+    {
+      actions_.push_back(
+        { .kind_ = Action::Kind::open, .fd_ = fd, .src_fd_ = -1, .path_ = path, .flags_ = flags } );
+      return *this;
+    }
+
+    SpawnActions& SpawnActions::rebind( type::FileDesc src_fd, type::FileDesc dst_fd )
+    {
+      actions_.push_back( { .kind_   = Action::Kind::rebind,
+                            .fd_     = dst_fd,
+                            .src_fd_ = src_fd,
+                            .path_   = nullptr,
+                            .flags_  = 0 } );
+      return *this;
+    }
+
+    SpawnActions& SpawnActions::close( type::FileDesc fd )
+    {
+      actions_.push_back(
+        { .kind_ = Action::Kind::close, .fd_ = fd, .src_fd_ = -1, .path_ = nullptr, .flags_ = 0 } );
+      return *this;
+    }
+
+    SpawnActions& SpawnActions::group( pid_t pgid ) noexcept
+    {
+      pgroup_ = pgid;
+      return *this;
+    }
+
+    bool SpawnActions::targets( type::FileDesc fd ) const noexcept
+    {
+      return ranges::any_of( actions_, [fd]( const Action& action ) { return action.fd_ == fd; } );
+    }
+
+    SpawnGuard::SpawnGuard( const char* file, char* const argv[], const SpawnActions& actions )
+      : process_id_ {}, error_ {}, subp_ret_ {}, usage_ {}
+    {
+      error_ = details::spawn_process( process_id_, file, argv, actions );
+      Metrics::inst().add( error_ == 0 ? Metrics::Counter::execs
+                                       : Metrics::Counter::exec_failures );
+    }
+
+    SpawnGuard::SpawnGuard( SpawnGuard&& rhs ) noexcept
+      : process_id_ { rhs.process_id_ }
+      , error_ { rhs.error_ }
+      , subp_ret_ { move( rhs.subp_ret_ ) }
+      , usage_ { rhs.usage_ }
+    {
+      // the moved-from guard must not wait for the process
+      rhs.error_ = ECHILD;
+    }
+
+    optional<SpawnGuard::ExitCode> SpawnGuard::exit_code() const noexcept
+    {
+      if ( subp_ret_.has_value() )
+        return { static_cast<ExitCode>( WEXITSTATUS( *subp_ret_ ) ) };
+      return nullopt;
+    }
+
+    void SpawnGuard::wait()
+    {
+      if ( launched() && !subp_ret_.has_value() ) {
+        ExitCode status {};
+        const auto begin = chrono::steady_clock::now();
+        while ( wait4( process_id_, &status, 0, &usage_ ) < 0 ) {
+          if ( errno != EINTR )
+            throw error::SystemCallError( "wait4" );
+        }
+        Metrics::inst().observe_wait( chrono::steady_clock::now() - begin );
+        subp_ret_ = status;
+      }
+    }
+  } // namespace util
+} // namespace tish
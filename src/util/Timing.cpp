@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <util/Timing.hpp>
+#include <util/Util.hpp>
+#include <utility>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      // Only the thread which evaluates is measured, not the one parsing the script ahead.
+#ifdef RUSAGE_THREAD
+      constexpr int shell_usage = RUSAGE_THREAD;
+#else
+      constexpr int shell_usage = RUSAGE_SELF;
+#endif
+
+      /// @brief The resources in a report, the times are in microseconds.
+      struct Usage {
+        int64_t user_, sys_;
+        long maxrss_, majflt_, nvcsw_, nivcsw_;
+
+        Usage& operator+=( const Usage& rhs ) noexcept
+        {
+          user_ += rhs.user_;
+          sys_ += rhs.sys_;
+          // The peaks of different processes can't be added up.
+          maxrss_ = max( maxrss_, rhs.maxrss_ );
+          majflt_ += rhs.majflt_;
+          nvcsw_ += rhs.nvcsw_;
+          nivcsw_ += rhs.nivcsw_;
+          return *this;
+        }
+      };
+
+      [[nodiscard]] Usage usage_of( const rusage& usage ) noexcept
+      {
+        return { .user_   = to_microseconds( usage.ru_utime ),
+                 .sys_    = to_microseconds( usage.ru_stime ),
+                 .maxrss_ = usage.ru_maxrss,
+                 .majflt_ = usage.ru_majflt,
+                 .nvcsw_  = usage.ru_nvcsw,
+                 .nivcsw_ = usage.ru_nivcsw };
+      }
+
+      /// @brief The usage of the shell itself between two samples, its peak memory is not known.
+      [[nodiscard]] Usage usage_between( const rusage& begin, const rusage& end ) noexcept
+      {
+        const auto before = usage_of( begin ), after = usage_of( end );
+        return { .user_   = after.user_ - before.user_,
+                 .sys_    = after.sys_ - before.sys_,
+                 .maxrss_ = 0,
+                 .majflt_ = after.majflt_ - before.majflt_,
+                 .nvcsw_  = after.nvcsw_ - before.nvcsw_,
+                 .nivcsw_ = after.nivcsw_ - before.nivcsw_ };
+      }
+
+      /// @brief A JSON number of seconds without losing any precision.
+      [[nodiscard]] type::String json_seconds( int64_t micros )
+      {
+        return format( "{}.{:06}", micros / 1'000'000, micros % 1'000'000 );
+      }
+
+      void append_json_usage( type::String& out, const Usage& usage )
+      {
+        out.append( format( "\"user\":{},\"sys\":{},\"maxrss_kib\":{},\"majflt\":{},"
+                            "\"nvcsw\":{},\"nivcsw\":{}",
+                            json_seconds( usage.user_ ),
+                            json_seconds( usage.sys_ ),
+                            usage.maxrss_,
+                            usage.majflt_,
+                            usage.nvcsw_,
+                            usage.nivcsw_ ) );
+      }
+    } // namespace details
+
+    Timing::Timing( Format format ) noexcept
+      : format_ { format }, start_ { chrono::steady_clock::now() }, self_start_ {}
+    {
+      getrusage( details::shell_usage, &self_start_ );
+    }
+
+    void Timing::record( pid_t pid, type::Eval status, type::String command, const rusage& usage )
+    {
+      stages_.push_back(
+        { .pid_ = pid, .status_ = status, .command_ = move( command ), .usage_ = usage } );
+    }
+
+    void Timing::merge( Timing&& inner )
+    {
+      ranges::move( inner.stages_, back_inserter( stages_ ) );
+      inner.stages_.clear();
+    }
+
+    type::String Timing::report() const
+    {
+      const auto real = chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now()
+                                                                      - start_ )
+                          .count();
+      rusage self_end {};
+      getrusage( details::shell_usage, &self_end );
+      auto total = details::usage_between( self_start_, self_end );
+      for ( const auto& stage : stages_ )
+        total += details::usage_of( stage.usage_ );
+
+      type::String out;
+      if ( format_ == Format::json ) {
+        out.append( format( "{{\"real\":{},", details::json_seconds( real ) ) );
+        details::append_json_usage( out, total );
+        out.append( ",\"stages\":[" );
+        for ( const auto& stage : stages_ ) {
+          out.append(
+            format( "{{\"pid\":{},\"status\":{},\"command\":", stage.pid_, stage.status_ ) );
+          append_json_string( out, stage.command_ );
+          out.push_back( ',' );
+          details::append_json_usage( out, details::usage_of( stage.usage_ ) );
+          out.append( "}," );
+        }
+        if ( !stages_.empty() )
+          out.pop_back();
+        out.append( "]}\n" );
+        return out;
+      }
+
+      out.append( format( "real    {}\nuser    {}\nsys     {}\n"
+                          "maxrss  {} KiB\nmajflt  {}\nctxsw   {} voluntary, {} involuntary\n",
+                          format_seconds( real ),
+                          format_seconds( total.user_ ),
+                          format_seconds( total.sys_ ),
+                          total.maxrss_,
+                          total.majflt_,
+                          total.nvcsw_,
+                          total.nivcsw_ ) );
+      if ( stages_.size() > 1 ) {
+        constexpr auto row = "{:<8}{:<8}{:<10}{:<10}{:<12}{:<8}{:<12}{}\n";
+        out.append(
+          format( row, "pid", "status", "user", "sys", "maxrss", "majflt", "ctxsw", "command" ) );
+        for ( const auto& stage : stages_ ) {
+          const auto usage = details::usage_of( stage.usage_ );
+          out.append( format( row,
+                              stage.pid_,
+                              stage.status_,
+                              format_seconds( usage.user_ ),
+                              format_seconds( usage.sys_ ),
+                              format( "{} KiB", usage.maxrss_ ),
+                              usage.majflt_,
+                              format( "{}/{}", usage.nvcsw_, usage.nivcsw_ ),
+                              stage.command_ ) );
+        }
+      }
+      return out;
+    }
+  } // namespace util
+} // namespace tish
@@ -0,0 +1,153 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <fcntl.h>
+#include <format>
+#include <unistd.h>
+#include <util/Tracer.hpp>
+#include <util/Util.hpp>
+using namespace std;
+
+namespace tish {
+  namespace util {
+    namespace details {
+      // The buffer of a thread is written out once it grows beyond this size.
+      constexpr size_t trace_buffer_size = 64 * 1024;
+
+      /// @brief The events recorded by a thread, which are written out when the thread ends.
+      struct TraceBuffer {
+        type::String events_;
+        pid_t pid_, tid_;
+
+        TraceBuffer() : events_ {}, pid_ { getpid() }, tid_ { gettid() }
+        {
+          events_.reserve( trace_buffer_size );
+        }
+        ~TraceBuffer() noexcept { Tracer::inst().flush(); }
+      };
+
+      [[nodiscard]] TraceBuffer& trace_buffer()
+      {
+        thread_local TraceBuffer buffer;
+        return buffer;
+      }
+
+      /// @brief Microseconds since the boot, it's shared by all processes of a trace.
+      [[nodiscard]] type::String timestamp( Tracer::Clock::duration duration )
+      {
+        const auto nanos = chrono::duration_cast<chrono::nanoseconds>( duration ).count();
+        return format( "{}.{:03}", nanos / 1000, nanos % 1000 );
+      }
+    } // namespace details
+
+    Tracer::~Tracer() noexcept
+    {
+      if ( fd_ < 0 )
+        return;
+      // A forked process must not end the array, the others may still write to it.
+      if ( getpid() == owner_ )
+        static_cast<void>( write_all( fd_, "\n]\n" ) );
+      close( fd_ );
+    }
+
+    Tracer& Tracer::inst() noexcept
+    {
+      static Tracer tracer;
+      return tracer;
+    }
+
+    bool Tracer::open( const char* path ) noexcept
+    {
+      const auto fd = ::open( path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0666 );
+      if ( fd < 0 )
+        return false;
+      // Every event written later starts with a comma, so the file is always a valid prefix.
+      if ( !write_all(
+             fd,
+             format( "[{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"args\":{{\"name\":"
+                     "\"tish\"}}}}",
+                     getpid() ) ) ) {
+        const auto err_num = errno;
+        close( fd );
+        errno = err_num;
+        return false;
+      }
+      fd_      = fd;
+      owner_   = getpid();
+      enabled_ = true;
+      return true;
+    }
+
+    void Tracer::record( type::StrView name,
+                         type::StrView category,
+                         Clock::time_point begin,
+                         Clock::time_point end,
+                         type::StrView args )
+    {
+      auto& buffer = details::trace_buffer();
+      buffer.events_.append( ",\n{\"name\":" );
+      append_json_string( buffer.events_, name );
+      buffer.events_.append( format( ",\"cat\":\"{}\",\"ph\":\"X\",\"ts\":{},\"dur\":{},"
+                                     "\"pid\":{},\"tid\":{},\"args\":{{{}}}}}",
+                                     category,
+                                     details::timestamp( begin.time_since_epoch() ),
+                                     details::timestamp( end - begin ),
+                                     buffer.pid_,
+                                     buffer.tid_,
+                                     args ) );
+      if ( buffer.events_.size() >= details::trace_buffer_size )
+        flush();
+    }
+
+    void Tracer::flush() noexcept
+    {
+      if ( fd_ < 0 )
+        return;
+      auto& buffer = details::trace_buffer();
+      // Each write holds whole events, and an append never interleaves with another one.
+      static_cast<void>( write_all( fd_, buffer.events_ ) );
+      buffer.events_.clear();
+    }
+
+    void Tracer::forked() noexcept
+    {
+      auto& buffer = details::trace_buffer();
+      buffer.events_.clear();
+      buffer.pid_ = getpid();
+      buffer.tid_ = gettid();
+    }
+
+    void TraceSpan::arg( type::StrView key, type::StrView value )
+    {
+      if ( !active_ ) [[likely]]
+        return;
+      if ( !args_.empty() )
+        args_.push_back( ',' );
+      append_json_string( args_, key );
+      args_.push_back( ':' );
+      append_json_string( args_, value );
+    }
+
+    void TraceSpan::arg( type::StrView key, int64_t value )
+    {
+      if ( !active_ ) [[likely]]
+        return;
+      if ( !args_.empty() )
+        args_.push_back( ',' );
+      append_json_string( args_, key );
+      args_.append( format( ":{}", value ) );
+    }
+
+    void TraceSpan::finish() noexcept
+    {
+      if ( !active_ )
+        return;
+      active_ = false;
+      try {
+        Tracer::inst().record( name_, category_, begin_, Tracer::Clock::now(), args_ );
+      } catch ( ... ) {
+        // A span which can't be recorded is dropped, the traced program goes on.
+      }
+    }
+  } // namespace util
+} // namespace tish
@@ -1,11 +1,10 @@
 #include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <filesystem>
 #include <format>
-#include <fstream>
 #include <iterator>
 #include <limits>
 #include <pwd.h>
@@ -43,57 +42,60 @@ namespace tish {
       }
     }
 
-    bool create_file( type::StrView filename )
-    {
-      return ofstream( filename.data() ).is_open();
-    }
-
     type::StrView get_homedir() noexcept
     {
       return getpwuid( getuid() )->pw_dir;
     }
 
-    vector<type::String> get_envpath()
-    {
-      type::StrView envpath = getenv( "PATH" );
-
-      vector<type::String> ret;
-      ranges::transform( envpath | views::split( ':' ), back_inserter( ret ), []( auto&& path ) {
-        return type::String( ranges::begin( path ), ranges::end( path ) );
-      } );
-      return ret;
-    }
-
     type::String format_error( type::StrView __s )
     {
       return format( "{}: {}", __s, strerror( errno ) );
     }
 
-    pair<bool, smatch> match_string( const type::String& str, type::StrView reg_str )
+    bool rebind_fd( type::FileDesc old_fd, type::FileDesc new_fd ) noexcept
     {
-      regex pattern { reg_str.data() };
-      smatch matches;
-      bool result = regex_match( str, matches, pattern );
-      return { result, move( matches ) };
+      return dup2( old_fd, new_fd ) == -1;
     }
 
-    type::String search_filepath( std::span<const type::String> path_set, type::StrView filename )
+    bool write_all( type::FileDesc fd, type::StrView data ) noexcept
     {
-      for ( const auto& env_path : path_set ) {
-        try {
-          if ( const auto filepath = std::filesystem::path( env_path ) / filename;
-               std::filesystem::exists( filepath ) && std::filesystem::is_regular_file( filepath ) )
-            return filepath.string();
-        } catch ( const std::filesystem::filesystem_error& e ) {
-          // just ignore it
+      while ( !data.empty() ) {
+        const auto written = write( fd, data.data(), data.size() );
+        if ( written < 0 ) {
+          if ( errno == EINTR )
+            continue;
+          return false;
         }
+        data.remove_prefix( written );
       }
-      return {};
+      return true;
     }
 
-    bool rebind_fd( type::FileDesc old_fd, type::FileDesc new_fd ) noexcept
+    void append_json_string( type::String& out, type::StrView text )
     {
-      return dup2( old_fd, new_fd ) == -1;
+      constexpr type::StrView hex_digits = "0123456789abcdef";
+      out.push_back( '"' );
+      for ( const auto character : text ) {
+        if ( character == '"' || character == '\\' )
+          out.append( { '\\', character } );
+        else if ( static_cast<unsigned char>( character ) < 0x20 )
+          out.append( "\\u00" ).append(
+            { hex_digits[character >> 4], hex_digits[character & 0xf] } );
+        else
+          out.push_back( character );
+      }
+      out.push_back( '"' );
+    }
+
+    int64_t to_microseconds( const timeval& time ) noexcept
+    {
+      return static_cast<int64_t>( time.tv_sec ) * 1'000'000 + time.tv_usec;
+    }
+
+    type::String format_seconds( int64_t micros )
+    {
+      const auto millis = ( micros + 500 ) / 1000;
+      return format( "{}.{:03}s", millis / 1000, millis % 1000 );
     }
   } // namespace util
 } // namespace tish
@@ -0,0 +1,20 @@
+# Helpers shared by the tests, each test is run as `sh tests/test_<name>.sh path/to/tish`.
+
+tish=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failures=0
+
+# expect <what> <expected> <actual>
+expect() {
+  if [ "$2" != "$3" ]; then
+    printf 'FAIL: %s\n  expected: %s\n  actual:   %s\n' "$1" "$2" "$3" >&2
+    failures=$((failures + 1))
+  fi
+}
+
+# Exits with the result of the test.
+finish() {
+  [ "$failures" -eq 0 ]
+  exit
+}
@@ -0,0 +1,32 @@
+# The diagnostics of the builtins go to the standard error the builtin runs with.
+. "$(dirname "$0")/common.sh"
+
+# check <what> <script> <expected output> <expected errors>
+check() {
+  "$tish" -c "$2" > "$work/out" 2> "$work/err"
+  expect "$1: output" "$3" "$(cat "$work/out")"
+  expect "$1: errors" "$4" "$(cat "$work/err")"
+}
+
+check "printf number" 'printf %d x || echo failed' "0failed" "printf: x: invalid number"
+check "printf format" 'printf "a%" || echo failed' "afailed" "printf: \`%': missing format character"
+check "printf piped" 'printf %d x 2>&1 | cat' "printf: x: invalid number
+0" ""
+check "printf redirected" "printf %d x 2> $work/file" "0" ""
+expect "printf redirected: file" "printf: x: invalid number" "$(cat "$work/file")"
+
+check "test integer" '[ 1 -lt x ] || echo failed' "failed" "[: x: integer expression expected"
+check "test bracket" '[ 1 = 1 || echo failed' "failed" "[: missing \`]'"
+check "test operator" 'test a -zz b c || echo failed' "failed" "test: -zz: unexpected argument"
+check "test piped" 'test a -zz b c 2>&1 | cat' "test: -zz: unexpected argument" ""
+
+check "cat missing" 'cat /nonexistent || echo failed' "failed" \
+  "cat: /nonexistent: No such file or directory"
+check "cat piped" 'cat /nonexistent 2>&1 | cat' "cat: /nonexistent: No such file or directory" ""
+check "tee missing" 'echo a | tee /nonexistent/file' "a" \
+  "tee: /nonexistent/file: No such file or directory"
+check "cp operand" 'cp a || echo failed' "failed" "cp: missing file operand"
+check "cp missing" "cp /nonexistent $work/copy 2>&1 | cat" \
+  "cp: /nonexistent: No such file or directory" ""
+
+finish
@@ -0,0 +1,60 @@
+# Background jobs, `$!`, `wait` and `jobs`.
+. "$(dirname "$0")/common.sh"
+
+# `$!` is the pid of the last background job.
+"$tish" -c "sh -c \"echo \\\$\\\$\" > $work/pid &
+wait
+echo \$!" > "$work/out"
+expect "\$! of a background job" "$(cat "$work/pid")" "$(cat "$work/out")"
+
+# `wait` returns the status of the job it waited for.
+expect "wait for a job which failed" failed "$("$tish" -c 'false &
+wait $! || echo failed')"
+expect "wait for a job which succeeded" ok "$("$tish" -c 'true &
+wait $! && echo ok')"
+expect "wait for a job by its spec" failed "$("$tish" -c 'sh -c "sleep 0.1; exit 3" &
+wait %1 || echo failed')"
+
+# Without arguments, `wait` returns once every job is done.
+"$tish" -c "sh -c \"sleep 0.2; echo first\" > $work/a &
+sh -c \"sleep 0.1; echo second\" > $work/b &
+wait
+cat $work/a $work/b" > "$work/out"
+expect "wait for every job" "first second " "$(tr '\n' ' ' < "$work/out")"
+
+# `wait -n` returns the status of the next job which finishes, the others keep running. A job
+# which finished before is found as well, though it's no longer listed.
+"$tish" -c "sleep 5 > /dev/null &
+false &
+sleep 0.1
+wait -n || echo failed
+jobs
+jobs -p > $work/pid" > "$work/out"
+kill "$(cat "$work/pid")"
+expect "wait for the next job" \
+  "failed [1]+  Running                 sleep 5 > /dev/null & " "$(tr '\n' ' ' < "$work/out")"
+expect "wait for the next job without jobs" none "$("$tish" -c 'wait -n || echo none')"
+
+# `jobs` lists the running jobs, `jobs -p` their process groups.
+expect "list the jobs" "[1]+  Running                 sleep 0.2 &" "$("$tish" -c 'sleep 0.2 &
+jobs')"
+"$tish" -c 'sleep 0.2 &
+jobs -p
+echo $!' > "$work/out"
+expect "list the pids of the jobs" "$(tail -n 1 "$work/out")" "$(head -n 1 "$work/out")"
+
+# The errors of the builtins are written to the standard error.
+expect "wait for a process which isn't a child" \
+  "wait: pid 12345 is not a child of this shell" "$("$tish" -c 'wait 12345' 2>&1)"
+expect "jobs with an unknown option" "jobs: usage: jobs [-l | -p]" "$("$tish" -c 'jobs -x' 2>&1)"
+
+# Background jobs which finished are reaped once the next statement runs, none is left a zombie.
+expect "no zombie after the jobs finished" "" "$("$tish" -c 'sleep 0.1 &
+sleep 0.1 &
+sleep 0.1 &
+sleep 0.1 &
+sleep 0.5
+sh -c "ps -o stat= --ppid \$PPID | grep Z"
+true')"
+
+finish
@@ -0,0 +1,57 @@
+# The `parallel` builtin: its job limit, the output and the status of the jobs, and `-f`.
+. "$(dirname "$0")/common.sh"
+
+# A job prints its name before and after it sleeps, records how many jobs run meanwhile, then
+# exits with the status given: `job.sh <name> <seconds> [status]`.
+mkdir "$work/running"
+cat > "$work/job.sh" << EOF
+touch $work/running/\$1
+echo "\$1 start"
+sleep \$2
+ls $work/running | wc -l >> $work/counts
+echo "\$1 end"
+rm $work/running/\$1
+exit \${3:-0}
+EOF
+job="sh $work/job.sh"
+
+# The status of a failed command is only shown by the prompt of the interactive shell.
+esc=$(printf '\033')
+status() {
+  printf '%s\n' "$1" | "$tish" 2> /dev/null | sed "s/$esc\[[0-9;]*[A-Za-z]//g" \
+    | grep -o '\[[0-9]*\]#' | tail -n 1
+}
+
+# No more jobs than `-j` run at once.
+"$tish" -c "parallel -j 2 \"$job a 0.2\" \"$job b 0.2\" \"$job c 0.2\" \"$job d 0.2\"" > /dev/null
+expect "at most 2 jobs" 2 "$(sort -n "$work/counts" | tail -n 1)"
+rm "$work/counts"
+"$tish" -c "parallel -j 4 \"$job a 0.2\" \"$job b 0.2\" \"$job c 0.2\" \"$job d 0.2\"" > /dev/null
+expect "at most 4 jobs" 4 "$(sort -n "$work/counts" | tail -n 1)"
+
+# The output of a job is written at once when it's done, so the jobs never interleave.
+expect "output of each job in one piece" "b start
+b end
+a start
+a end" "$("$tish" -c "parallel -j 2 \"$job a 0.3\" \"$job b 0.1\"")"
+
+# The status is the one of the first job which failed.
+expect "status of the first failure" "[3]#" \
+  "$(status "parallel -j 3 \"$job a 0.3 5\" \"$job b 0.1 3\" \"$job c 0.2\" > /dev/null")"
+expect "status without failures" "" "$(status "parallel -j 2 true \"$job a 0\" > /dev/null")"
+
+# With `-f`, the first failure terminates the jobs which are still running.
+begin=$(date +%s)
+expect "-f status" "[1]#" "$(status 'parallel -j 2 -f "sleep 5" false')"
+expect "-f terminates the running jobs" yes "$([ $(($(date +%s) - begin)) -lt 3 ] && echo yes)"
+
+# Without commands, each line of the standard input is one, and the empty lines are skipped.
+printf '%s\n\n%s\n' "$job a 0" "$job b 0.1" > "$work/jobs"
+expect "jobs read from the input" "a start a end b start b end " \
+  "$("$tish" -c 'parallel -j 1' < "$work/jobs" | tr '\n' ' ')"
+
+# The errors are written to the standard error.
+expect "invalid job limit" "parallel: usage: parallel [-j jobs] [-f] [command ...]" \
+  "$("$tish" -c 'parallel -j 0 true' 2>&1)"
+
+finish
@@ -0,0 +1,42 @@
+# A damaged cache file is dropped, and the rest of the script is parsed from its source.
+. "$(dirname "$0")/common.sh"
+
+export XDG_CACHE_HOME="$work/cache"
+mkdir -p "$XDG_CACHE_HOME"
+# Large enough to be cached.
+seq 1 3000 | sed 's/^/echo /' > "$work/script.tish"
+seq 1 3000 > "$work/expected"
+
+run() {
+  "$tish" "$work/script.tish" > "$work/out" 2> "$work/err"
+  echo $?
+}
+
+expect "first run status" 0 "$(run)"
+expect "first run output" "" "$(cmp "$work/expected" "$work/out" 2>&1)"
+cache=$(ls "$XDG_CACHE_HOME"/tish/*.tishc)
+cp "$cache" "$work/intact"
+
+# The text of the tokens is stored once, the nodes are packed.
+expect "cache size" yes \
+  "$([ "$(wc -c < "$cache")" -le $(($(wc -c < "$work/script.tish") * 3)) ] && echo yes)"
+
+# Truncated in the middle of the statements.
+head -c $(($(wc -c < "$work/intact") / 2)) "$work/intact" > "$cache"
+expect "truncated status" 0 "$(run)"
+expect "truncated output" "" "$(cmp "$work/expected" "$work/out" 2>&1)"
+expect "truncated errors" "" "$(cat "$work/err")"
+expect "truncated cache rebuilt" "" "$(cmp "$work/intact" "$cache" 2>&1)"
+
+# Overwritten in the middle of the statements.
+head -c 4096 /dev/zero | tr '\0' '\377' \
+  | dd of="$cache" bs=1 seek=$(($(wc -c < "$work/intact") / 2)) conv=notrunc 2> /dev/null
+expect "mutated status" 0 "$(run)"
+expect "mutated output" "" "$(cmp "$work/expected" "$work/out" 2>&1)"
+expect "mutated errors" "" "$(cat "$work/err")"
+expect "mutated cache removed" no "$([ -e "$cache" ] && echo yes || echo no)"
+expect "rebuilt status" 0 "$(run)"
+expect "rebuilt output" "" "$(cmp "$work/expected" "$work/out" 2>&1)"
+expect "mutated cache rebuilt" "" "$(cmp "$work/intact" "$cache" 2>&1)"
+
+finish
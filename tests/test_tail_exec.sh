@@ -0,0 +1,22 @@
+# The last command of `-c` replaces the shell instead of being forked.
+. "$(dirname "$0")/common.sh"
+
+"$tish" -c 'sh -c "echo \$\$"' > "$work/out" &
+shell_pid=$!
+wait
+expect "pid of the last command" "$shell_pid" "$(cat "$work/out")"
+
+# A command in a pipeline is started by the shell itself.
+"$tish" -c 'sh -c "echo \$PPID" | cat' > "$work/out" &
+shell_pid=$!
+wait
+expect "parent of a pipeline stage" "$shell_pid" "$(cat "$work/out")"
+
+# Anything which still has to run after the command keeps the fork.
+"$tish" -c 'sh -c "echo \$\$"; true' > "$work/out" &
+shell_pid=$!
+wait
+expect "pid of a command followed by another is not the shell's" \
+  yes "$([ "$(cat "$work/out")" != "$shell_pid" ] && echo yes)"
+
+finish